@@ -0,0 +1,39 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Each benchmark prints its own results to stdout.
+void runTransformBenchmark();
+void runJobScalingBenchmark();
+void runObjParserBenchmark();
+void runImageDecodeBenchmark();
+
+// Runs fn `iterations` times and returns the average time per run in milliseconds
+template <class Function>
+double averageMilliseconds(int iterations, Function fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        fn();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+// Thread counts to measure scaling at: 1 and the powers of two below
+// maxThreads, then maxThreads itself, e.g. 1, 2, 4, 6 for 6 threads
+inline std::vector<unsigned int> threadCounts(unsigned int maxThreads)
+{
+    maxThreads = std::max(1u, maxThreads);
+    std::vector<unsigned int> counts;
+    for (unsigned int threads = 1; threads < maxThreads; threads *= 2)
+    {
+        counts.push_back(threads);
+    }
+    counts.push_back(maxThreads);
+    return counts;
+}
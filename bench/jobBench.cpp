@@ -0,0 +1,125 @@
+// Measures how the per-frame scene work scales with the number of job system
+// threads: a full transform update, camera culling of the result, and draw
+// packet generation for the visible nodes. Each is checked against the serial run.
+
+#include "benchmarks.hpp"
+#include "sceneGraph.hpp"
+#include "culling.hpp"
+#include "renderQueue.hpp"
+#include "utilities/jobSystem.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <fmt/format.h>
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+// A wide, shallow scene like the exhibit halls: groups of a few hundred
+// objects, each with a couple of attached parts
+static SceneNode *buildScene(TransformHierarchy *hierarchy, int groupCount, int objectsPerGroup)
+{
+    AABB unitBox;
+    unitBox.min = glm::vec3(-0.5f);
+    unitBox.max = glm::vec3(0.5f);
+
+    SceneNode *root = createSceneNode(hierarchy);
+    for (int g = 0; g < groupCount; g++)
+    {
+        SceneNode *group = createSceneNode(hierarchy);
+        group->setPosition(glm::vec3(float(g % 20) * 40.0f - 400.0f, 0.0f, float(g / 20) * 40.0f - 400.0f));
+        addChild(root, group);
+        for (int o = 0; o < objectsPerGroup; o++)
+        {
+            SceneNode *object = createSceneNode(hierarchy);
+            object->vertexArrayObjectID = 1;
+            object->setLocalBounds(unitBox);
+            object->setPosition(glm::vec3(float(o % 16) * 2.0f, 0.0f, float(o / 16) * 2.0f));
+            object->setRotation(glm::vec3(0.0f, 0.1f * float(o), 0.0f));
+            addChild(group, object);
+            for (int p = 0; p < 2; p++)
+            {
+                SceneNode *part = createSceneNode(hierarchy);
+                part->vertexArrayObjectID = 1;
+                part->setLocalBounds(unitBox);
+                part->setPosition(glm::vec3(0.0f, 1.0f + float(p), 0.0f));
+                addChild(object, part);
+            }
+        }
+    }
+    return root;
+}
+
+// Packets are generated in slot order whatever the thread count, so the
+// queues should match packet for packet
+static bool samePackets(const RenderQueue &a, const RenderQueue &b)
+{
+    if (a.packetCount != b.packetCount || a.mainPass.count != b.mainPass.count
+        || a.shadowPasses[0].count != b.shadowPasses[0].count)
+    {
+        return false;
+    }
+    for (unsigned int i = 0; i < a.packetCount; i++)
+    {
+        const DrawPacket &p = a.packets[i], &q = b.packets[i];
+        if (p.vertexArrayObjectID != q.vertexArrayObjectID || p.indexCount != q.indexCount
+            || p.passMask != q.passMask || p.cascadeMask != q.cascadeMask || p.modelMatrix != q.modelMatrix)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void runJobScalingBenchmark()
+{
+    TransformHierarchy hierarchy;
+    SceneNode *root = buildScene(&hierarchy, 400, 250);
+    glm::mat4 VP = glm::perspective(glm::radians(80.0f), 16.0f / 9.0f, 0.1f, 350.f)
+                 * glm::lookAt(glm::vec3(0, 100, 200), glm::vec3(0), glm::vec3(0, 1, 0));
+    Frustum frustum = frustumFromMatrix(VP);
+    updateTransformHierarchy(hierarchy, VP);
+    std::vector<glm::mat4> reference = hierarchy.worldMatrices;
+    // The nodes have no shader of their own, and none is needed without drawing
+    CullResult referenceCulling;
+    cullHierarchy(hierarchy, frustum, referenceCulling);
+    RenderQueue referenceQueue;
+    buildRenderQueue(referenceQueue, hierarchy, nullptr, referenceCulling.visible.data());
+
+    unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << fmt::format("{} nodes, up to {} hardware threads", hierarchy.nodes.size(), maxThreads) << std::endl;
+    std::cout << fmt::format("{:>8} {:>12} {:>9} {:>12} {:>9} {:>12} {:>9} {:>10}", "threads", "update ms",
+                             "speedup", "cull ms", "speedup", "packets ms", "speedup", "identical") << std::endl;
+
+    const int iterations = 50;
+    double serialUpdate = 0.0, serialCull = 0.0, serialPackets = 0.0;
+    for (unsigned int threads : threadCounts(maxThreads))
+    {
+        JobSystem jobs(threads - 1);
+        CullResult culling;
+        RenderQueue queue;
+        double update = averageMilliseconds(iterations, [&]() {
+            markTransformDirty(hierarchy, root->transformIndex);
+            updateTransformHierarchy(hierarchy, VP, &jobs);
+        });
+        double cull = averageMilliseconds(iterations, [&]() {
+            cullHierarchy(hierarchy, frustum, culling, &jobs);
+        });
+        double packets = averageMilliseconds(iterations, [&]() {
+            buildRenderQueue(queue, hierarchy, nullptr, culling.visible.data(), nullptr, 1, &jobs);
+        });
+        bool identical = std::equal(reference.begin(), reference.end(), hierarchy.worldMatrices.begin())
+                      && culling.visible == referenceCulling.visible
+                      && samePackets(queue, referenceQueue);
+        if (threads == 1)
+        {
+            serialUpdate = update;
+            serialCull = cull;
+            serialPackets = packets;
+        }
+        std::cout << fmt::format("{:>8} {:>12.3f} {:>8.2f}x {:>12.3f} {:>8.2f}x {:>12.3f} {:>8.2f}x {:>10}",
+                                 threads, update, serialUpdate / update, cull, serialCull / cull,
+                                 packets, serialPackets / packets, identical ? "yes" : "no") << std::endl;
+    }
+
+    destroySceneSubtree(root);
+}
@@ -0,0 +1,44 @@
+// Stand-alone CPU benchmarks. These do not open a window or touch OpenGL.
+//
+//     ./glowbox_bench            runs every benchmark
+//     ./glowbox_bench transform  runs only the named benchmark
+
+#include "benchmarks.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+struct Benchmark {
+    const char *name;
+    void (*run)();
+};
+
+static const Benchmark benchmarks[] = {
+    {"transform", runTransformBenchmark},
+    {"jobs", runJobScalingBenchmark},
+    {"obj", runObjParserBenchmark},
+    {"image", runImageDecodeBenchmark},
+};
+
+int main(int argc, const char *argv[])
+{
+    bool ranAny = false;
+    for (const Benchmark &benchmark : benchmarks)
+    {
+        if (argc > 1 && std::strcmp(argv[1], benchmark.name) != 0)
+        {
+            continue;
+        }
+        std::cout << "=== " << benchmark.name << " ===" << std::endl;
+        benchmark.run();
+        ranAny = true;
+    }
+
+    if (!ranAny)
+    {
+        std::cerr << "Unknown benchmark: " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
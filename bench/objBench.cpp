@@ -0,0 +1,136 @@
+// Compares the memory mapped, multi-threaded OBJ reader against tinyobjloader
+// on a large scan-like file, and times normal generation serially and in
+// parallel. The file is generated next to the executable and removed afterwards.
+
+#include "benchmarks.hpp"
+#include "utilities/jobSystem.hpp"
+#include "utilities/modelLoader.hpp"
+#include "utilities/objParser.hpp"
+
+#include <fmt/format.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+
+static const char BENCH_OBJ_PATH[] = "glowbox_bench_grid.obj";
+
+// A gently rolling height field of side x side vertices, with positions only,
+// like the output of a scanner. 2237 vertices a side gives 10M triangles.
+static bool writeGridOBJ(const char *path, int side)
+{
+    FILE *file = std::fopen(path, "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    std::string buffer;
+    buffer.reserve(1 << 20);
+    auto flush = [&]() {
+        std::fwrite(buffer.data(), 1, buffer.size(), file);
+        buffer.clear();
+    };
+    buffer += "# glowbox_bench grid\n";
+    for (int z = 0; z < side; z++)
+    {
+        for (int x = 0; x < side; x++)
+        {
+            float height = 0.5f * std::sin(float(x) * 0.05f) * std::cos(float(z) * 0.07f);
+            buffer += fmt::format("v {:.4f} {:.4f} {:.4f}\n", float(x) * 0.01f, height, float(z) * 0.01f);
+        }
+        if (buffer.size() > (1 << 20) - 4096)
+        {
+            flush();
+        }
+    }
+    for (int z = 0; z + 1 < side; z++)
+    {
+        for (int x = 0; x + 1 < side; x++)
+        {
+            // OBJ indices are one-based
+            int i = z * side + x + 1;
+            buffer += fmt::format("f {} {} {}\nf {} {} {}\n", i, i + side, i + 1, i + 1, i + side, i + side + 1);
+        }
+        if (buffer.size() > (1 << 20) - 4096)
+        {
+            flush();
+        }
+    }
+    flush();
+    return std::fclose(file) == 0;
+}
+
+// Whether both meshes describe the same triangles, whatever their vertex order
+static bool sameTriangles(const Mesh &a, const Mesh &b)
+{
+    if (a.indices.size() != b.indices.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.indices.size(); i++)
+    {
+        if (a.vertices[a.indices[i]] != b.vertices[b.indices[i]])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void runObjParserBenchmark()
+{
+    const int side = 2237;
+    if (!writeGridOBJ(BENCH_OBJ_PATH, side))
+    {
+        std::cerr << "Could not write " << BENCH_OBJ_PATH << std::endl;
+        return;
+    }
+
+    unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::string texture;
+    Mesh reference;
+    double tinyobj = averageMilliseconds(1, [&]() {
+        readOBJWithTinyobj(BENCH_OBJ_PATH, "", reference, texture);
+    });
+    std::cout << fmt::format("{} vertices, {} triangles, up to {} hardware threads",
+                             reference.vertices.size(), reference.indices.size() / 3, maxThreads) << std::endl;
+    std::cout << fmt::format("{:>24} {:>8} {:>12} {:>9} {:>10}", "", "threads", "ms", "speedup", "identical")
+              << std::endl;
+    std::cout << fmt::format("{:>24} {:>8} {:>12.1f} {:>9} {:>10}", "tinyobjloader", 1, tinyobj, "", "") << std::endl;
+
+    Mesh mesh;
+    for (unsigned int threads : threadCounts(maxThreads))
+    {
+        JobSystem jobs(threads - 1);
+        double parse = averageMilliseconds(3, [&]() {
+            readOBJ(BENCH_OBJ_PATH, "", mesh, texture, &jobs);
+        });
+        std::cout << fmt::format("{:>24} {:>8} {:>12.1f} {:>8.2f}x {:>10}", "readOBJ", threads, parse,
+                                 tinyobj / parse, sameTriangles(reference, mesh) ? "yes" : "no") << std::endl;
+    }
+    std::remove(BENCH_OBJ_PATH);
+
+    double serialNormals = averageMilliseconds(3, [&]() {
+        computeNormalsForMesh(mesh);
+    });
+    std::vector<glm::vec3> serialResult = mesh.normals;
+    std::cout << fmt::format("{:>24} {:>8} {:>12.1f} {:>9} {:>10}", "computeNormalsForMesh", 1, serialNormals, "", "")
+              << std::endl;
+    for (unsigned int threads : threadCounts(maxThreads))
+    {
+        // The serial run is the one above
+        if (threads == 1)
+        {
+            continue;
+        }
+        JobSystem jobs(threads - 1);
+        double normals = averageMilliseconds(3, [&]() {
+            computeNormalsForMesh(mesh, &jobs);
+        });
+        bool identical = std::equal(serialResult.begin(), serialResult.end(), mesh.normals.begin());
+        std::cout << fmt::format("{:>24} {:>8} {:>12.1f} {:>8.2f}x {:>10}", "computeNormalsForMesh", threads,
+                                 normals, serialNormals / normals, identical ? "yes" : "no") << std::endl;
+    }
+}
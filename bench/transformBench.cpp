@@ -0,0 +1,130 @@
+// Compares the linear TransformHierarchy update with the recursive
+// per-node walk that scenelogic.cpp used before, and shows how the cost of
+// an incremental update depends on what changed rather than on scene size.
+
+#include "benchmarks.hpp"
+#include "sceneGraph.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <fmt/format.h>
+#include <iostream>
+
+// The original recursive update, kept here as a reference point
+static void updateNodeTransformationsRecursive(SceneNode *node, glm::mat4 parentModel, glm::mat4 parentVP,
+                                               std::vector<glm::mat4> &models, std::vector<glm::mat4> &MVPs)
+{
+    glm::mat4 transformationMatrix =
+        glm::translate(glm::mat4(1.0f), node->position()) *
+        glm::translate(glm::mat4(1.0f), node->referencePoint()) *
+        glm::rotate(glm::mat4(1.0f), node->rotation().y, glm::vec3(0,1,0)) *
+        glm::rotate(glm::mat4(1.0f), node->rotation().x, glm::vec3(1,0,0)) *
+        glm::rotate(glm::mat4(1.0f), node->rotation().z, glm::vec3(0,0,1)) *
+        glm::scale(glm::mat4(1.0f), node->scale()) *
+        glm::translate(glm::mat4(1.0f), -node->referencePoint());
+    glm::mat4 model = parentModel * transformationMatrix;
+    glm::mat4 MVP = parentVP * transformationMatrix;
+    models[node->transformIndex] = model;
+    MVPs[node->transformIndex] = MVP;
+    for (SceneNode *child = node->firstChild; child != nullptr; child = child->nextSibling)
+        updateNodeTransformationsRecursive(child, model, MVP, models, MVPs);
+}
+
+// Builds a tree where every node has up to `fanOut` children. Nodes are
+// linked up in a shuffled order, so that their hierarchy slots and pool
+// slots resemble a scene that was built up over time rather than in one go.
+static SceneNode *buildTestScene(TransformHierarchy *hierarchy, int nodeCount, int fanOut)
+{
+    std::vector<SceneNode*> nodes;
+    nodes.reserve(nodeCount);
+    for (int i = 0; i < nodeCount; i++)
+    {
+        nodes.push_back(createSceneNode(hierarchy));
+    }
+
+    srand(1234);
+    for (int i = nodeCount - 1; i > 1; i--)
+    {
+        std::swap(nodes[i], nodes[1 + rand() % i]);
+    }
+
+    for (int i = 0; i < nodeCount; i++)
+    {
+        SceneNode *node = nodes[i];
+        float f = float(i);
+        node->setPosition(glm::vec3(std::sin(f), std::cos(f), 0.1f * f));
+        node->setRotation(glm::vec3(0.01f * f, 0.02f * f, 0.03f * f));
+        node->setScale(glm::vec3(1.0f + 0.001f * (i % 7)));
+        node->setReferencePoint(glm::vec3(0.5f, 0.0f, -0.5f));
+        if (i > 0)
+        {
+            addChild(nodes[(i - 1) / fanOut], node);
+        }
+    }
+    return nodes[0];
+}
+
+static float maxDifference(const std::vector<glm::mat4> &a, const std::vector<glm::mat4> &b)
+{
+    float difference = 0.0f;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        for (int column = 0; column < 4; column++)
+        {
+            glm::vec4 delta = glm::abs(a[i][column] - b[i][column]);
+            difference = std::max(difference, std::max(std::max(delta.x, delta.y), std::max(delta.z, delta.w)));
+        }
+    }
+    return difference;
+}
+
+void runTransformBenchmark()
+{
+    const int fanOut = 4;
+    glm::mat4 VP = glm::perspective(glm::radians(80.0f), 16.0f / 9.0f, 0.1f, 350.f)
+                 * glm::lookAt(glm::vec3(0, 100, 200), glm::vec3(0), glm::vec3(0, 1, 0));
+
+    glm::mat4 otherVP = VP * glm::rotate(glm::mat4(1.0f), 0.1f, glm::vec3(0, 1, 0));
+
+    std::cout << fmt::format("{:>8} {:>14} {:>14} {:>9} {:>12} {:>12} {:>12} {:>12}",
+                             "nodes", "recursive ms", "linear ms", "speedup", "max error",
+                             "1 leaf ms", "camera ms", "static ms") << std::endl;
+    for (int nodeCount : {1000, 10000, 100000})
+    {
+        TransformHierarchy hierarchy;
+        SceneNode *root = buildTestScene(&hierarchy, nodeCount, fanOut);
+        int iterations = std::max(10, 2000000 / nodeCount);
+
+        // Sort once up front so the timed runs only measure the update itself
+        sortTransformHierarchy(hierarchy);
+
+        std::vector<glm::mat4> models(nodeCount), MVPs(nodeCount);
+        double recursive = averageMilliseconds(iterations, [&]() {
+            updateNodeTransformationsRecursive(root, glm::mat4(1.0f), VP, models, MVPs);
+        });
+        // Dirtying the root invalidates every node, forcing a full pass
+        double linear = averageMilliseconds(iterations, [&]() {
+            markTransformDirty(hierarchy, 0);
+            updateTransformHierarchy(hierarchy, VP);
+        });
+        float error = maxDifference(models, hierarchy.worldMatrices);
+
+        unsigned int leaf = hierarchy.nodes.size() - 1;
+        double oneLeaf = averageMilliseconds(iterations, [&]() {
+            markTransformDirty(hierarchy, leaf);
+            updateTransformHierarchy(hierarchy, VP);
+        });
+        int frame = 0;
+        double cameraOnly = averageMilliseconds(iterations, [&]() {
+            updateTransformHierarchy(hierarchy, (frame++ % 2) ? VP : otherVP);
+        });
+        double nothing = averageMilliseconds(iterations, [&]() {
+            updateTransformHierarchy(hierarchy, VP);
+        });
+
+        std::cout << fmt::format("{:>8} {:>14.4f} {:>14.4f} {:>8.2f}x {:>12.3g} {:>12.4f} {:>12.4f} {:>12.4f}",
+                                 nodeCount, recursive, linear, recursive / linear, error,
+                                 oneLeaf, cameraOnly, nothing) << std::endl;
+
+        destroySceneSubtree(root);
+    }
+}
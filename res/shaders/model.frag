@@ -1,70 +1,284 @@
 #version 430 core
+// BINDLESS_TEXTURES is defined by the application when the driver supports it.
+#ifdef BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : require
+#endif
 
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
-in vec4 ShadowCoord;
+flat in uint Material;    // Index into the material buffer, 0 for untextured objects.
+flat in vec3 Tint;        // Per-instance color, white for ordinary objects.
 
-uniform vec3 baseAmbient;   // Base ambient light (e.g., vec3(0.2))
-uniform vec3 sunDir;        // Direction TO the sun (normalized; note light comes from -sunDir)
-uniform vec3 sunColor;      // Sun light color (and intensity)
-uniform vec3 moonDir;       // Direction TO the moon (normalized; for our system we set moonDir = -sunDir)
-uniform vec3 moonColor;     // Moon light color (usually lower intensity)
-uniform vec3 cameraPos;     // For specular calculations.
+// Per-frame data shared by all shaders, see FrameConstants in frameData.hpp.
+layout(std140, binding = 0) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 lightSpaceMatrices[4]; // One per shadow cascade.
+    vec4 cascadeSplits;         // View depth at which each cascade ends.
+    vec4 cascadeTexelSizes;
+    vec4 shadowParams;          // x = cascade count, y = blend fraction, z = 1 / shadow map size.
+    vec4 cameraPos;     // For specular calculations.
+    vec4 sunDir;        // Direction TO the sun (normalized; note light comes from -sunDir)
+    vec4 sunColor;      // Sun light color (and intensity)
+    vec4 moonDir;       // Direction TO the moon (normalized; for our system we set moonDir = -sunDir)
+    vec4 moonColor;     // Moon light color (usually lower intensity)
+    vec4 baseAmbient;   // Ambient light the sky probe leaves out, e.g. starlight
+    vec4 dayFactor;
+    vec4 atmosphere;    // x: km per world unit, y: viewer height in km, z: sky exposure
+};
 
-uniform sampler2D diffuseTexture;
-uniform bool useTexture;
+// Per-material data, see MaterialData in textureCache.hpp.
+struct MaterialData {
+    uvec2 textureHandle;   // Bindless handle of the texture array; unused without bindless textures.
+    uint layer;            // Of the texture within its array.
+    uint textured;         // 0 until the texture is resident.
+};
+layout(std430, binding = 3) readonly buffer Materials {
+    MaterialData materials[];
+};
 
-uniform sampler2D shadowMap; // Shadow map from the sun's perspective.
+// Diffuse light from the sky probe as nine spherical harmonic coefficients,
+// already convolved with the cosine lobe and divided by pi. See skyProbe.comp.
+layout(std430, binding = 4) readonly buffer SkyIrradiance {
+    vec4 irradianceSH[9];
+};
+
+#ifndef BINDLESS_TEXTURES
+// Without bindless handles, the texture array of the draw's batch is bound to unit 0.
+uniform sampler2DArray diffuseTextures;
+#endif
+
+// The shadow filtering is chosen by the application: SHADOW_PCF for one
+// hardware-filtered tap, SHADOW_POISSON with SHADOW_TAPS taps, or SHADOW_EVSM.
+#ifdef SHADOW_EVSM
+uniform sampler2DArray shadowMoments; // Blurred EVSM moments, one layer per cascade.
+// EVSM_POSITIVE_EXPONENT and EVSM_NEGATIVE_EXPONENT are defined by the
+// application, the same as for evsmBlur.comp.
+// Cuts off the tail of the Chebyshev bound, which shows as light bleeding
+// where shadows overlap.
+#define EVSM_BLEED_REDUCTION 0.3
+#else
+// Sun's shadow map, one layer per cascade. Lookups compare against the
+// reference depth and filter the results bilinearly.
+uniform sampler2DArrayShadow shadowMap;
+#endif
 uniform float shininess;     // Specular exponent.
+// The sky around the camera, from Atmosphere. It is also the light the air
+// scatters towards the camera in front of the scene.
+uniform sampler2D skyViewLut;
+// Reflections of the sky probe, blurred for rougher surfaces with each mip level.
+uniform samplerCube skySpecular;
 
 out vec4 FragColor;
 
+#ifdef SHADOW_POISSON
+// Radius of the disc, in texels of the cascade.
+#define SHADOW_FILTER_RADIUS 2.0
+const vec2 poissonDisc[16] = vec2[](
+    vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+    vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+    vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464),
+    vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+    vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420),
+    vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+    vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590),
+    vec2(0.19984126, 0.78641367), vec2(0.14383161, -0.14100790)
+);
+
+// Rotates the disc per pixel, which turns banding into fine noise.
+float interleavedGradientNoise(vec2 position) {
+    return fract(52.9829189 * fract(dot(position, vec2(0.06711056, 0.00583715))));
+}
+#endif
+
+#ifdef SHADOW_EVSM
+// Upper bound on the fraction of light getting past the occluders.
+float chebyshevUpperBound(vec2 moments, float mean, float minVariance) {
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = mean - moments.x;
+    float pMax = variance / (variance + d * d);
+    pMax = clamp((pMax - EVSM_BLEED_REDUCTION) / (1.0 - EVSM_BLEED_REDUCTION), 0.0, 1.0);
+    return mean <= moments.x ? 1.0 : pMax;
+}
+#endif
+
 //
-// A simple shadow calculation using perspective division and bias.
+// Fraction of the sun's light reaching the point in one cascade. The position
+// is pushed out along the normal by about a texel of that cascade, so coarser
+// cascades get a larger offset.
 //
-float ShadowCalculation(vec4 shadowCoord, vec3 normal, vec3 lightDir) {
-    vec3 projCoords = shadowCoord.xyz / shadowCoord.w;
-    projCoords = projCoords * 0.5 + 0.5;
-    float closestDepth = texture(shadowMap, projCoords.xy).r;
-    float currentDepth = projCoords.z;
-    // Bias reduces shadow acne.
-    float bias = max(0.005 * (1.0 - dot(normal, lightDir)), 0.001);
-    float shadow = currentDepth - bias > closestDepth ? 0.5 : 1.0;
+float CascadeLight(int cascade, vec3 normal, vec3 lightDir) {
+    float cosTheta = clamp(dot(normal, lightDir), 0.0, 1.0);
+    vec3 offset = normal * cascadeTexelSizes[cascade] * (1.0 - cosTheta + 0.5);
+    // Orthographic, so there is no perspective division.
+    vec3 projCoords = (lightSpaceMatrices[cascade] * vec4(FragPos + offset, 1.0)).xyz * 0.5 + 0.5;
     if(projCoords.z > 1.0)
-        shadow = 1.0;
+        return 1.0;
+#ifdef SHADOW_EVSM
+    vec4 moments = texture(shadowMoments, vec3(projCoords.xy, float(cascade)));
+    float depth = 2.0 * projCoords.z - 1.0;
+    float positive = exp(EVSM_POSITIVE_EXPONENT * depth);
+    float negative = -exp(-EVSM_NEGATIVE_EXPONENT * depth);
+    // Scaled by the slope of the warp, so the minimum is the same at any depth.
+    vec2 minDeviation = 0.0001 * vec2(EVSM_POSITIVE_EXPONENT * positive, EVSM_NEGATIVE_EXPONENT * negative);
+    return min(chebyshevUpperBound(moments.xy, positive, minDeviation.x * minDeviation.x),
+               chebyshevUpperBound(moments.zw, negative, minDeviation.y * minDeviation.y));
+#else
+    // Bias reduces shadow acne.
+    float bias = max(0.005 * (1.0 - cosTheta), 0.001);
+    vec4 reference = vec4(projCoords.xy, float(cascade), projCoords.z - bias);
+#ifdef SHADOW_POISSON
+    float angle = 6.28318531 * interleavedGradientNoise(gl_FragCoord.xy);
+    mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+    // shadowParams.z is the size of a texel in texture coordinates.
+    float radius = SHADOW_FILTER_RADIUS * shadowParams.z;
+    float light = 0.0;
+    for(int i = 0; i < SHADOW_TAPS; i++) {
+        vec2 tap = rotation * poissonDisc[i] * radius;
+        light += texture(shadowMap, reference + vec4(tap, 0.0, 0.0));
+    }
+    return light / float(SHADOW_TAPS);
+#else
+    return texture(shadowMap, reference);
+#endif
+#endif
+}
+
+// Shadowed surfaces keep half of the sun's light.
+float CascadeShadow(int cascade, vec3 normal, vec3 lightDir) {
+    return mix(0.5, 1.0, CascadeLight(cascade, normal, lightDir));
+}
+
+//
+// Picks the cascade by view depth. Over the last part of each cascade, the
+// shadow fades into the next one's, and past the last one into no shadow,
+// so the change in resolution doesn't show as a line.
+//
+float ShadowCalculation(vec3 normal, vec3 lightDir) {
+    float depth = -(view * vec4(FragPos, 1.0)).z;
+    int cascadeCount = int(shadowParams.x);
+    int cascade = 0;
+    while(cascade < cascadeCount && depth > cascadeSplits[cascade])
+        cascade++;
+    if(cascade == cascadeCount)
+        return 1.0;
+
+    float shadow = CascadeShadow(cascade, normal, lightDir);
+    float start = cascade == 0 ? 0.0 : cascadeSplits[cascade - 1];
+    float blendStart = mix(cascadeSplits[cascade], start, shadowParams.y);
+    if(depth > blendStart) {
+        float next = cascade + 1 < cascadeCount ? CascadeShadow(cascade + 1, normal, lightDir) : 1.0;
+        shadow = mix(shadow, next, smoothstep(blendStart, cascadeSplits[cascade], depth));
+    }
     return shadow;
 }
 
+// Keep the planet, the air at the ground and the sky-view LUT's mapping in sync with atmosphere.comp.
+const float PI = 3.14159265;
+const float BOTTOM_RADIUS = 6360.0;
+const vec3 RAYLEIGH_SCATTERING = vec3(5.802, 13.558, 33.1) * 1e-3;
+const float RAYLEIGH_SCALE_HEIGHT = 8.0;
+const float MIE_EXTINCTION = 4.440e-3;
+const float MIE_SCALE_HEIGHT = 1.2;
+
+vec2 SkyViewUv(vec3 dir, float viewHeight) {
+    float horizonDistance = sqrt(max(viewHeight * viewHeight - BOTTOM_RADIUS * BOTTOM_RADIUS, 0.0));
+    float beta = acos(clamp(horizonDistance / viewHeight, -1.0, 1.0));
+    float zenithHorizonAngle = PI - beta;
+    float viewZenithAngle = acos(clamp(dir.y, -1.0, 1.0));
+    vec2 uv;
+    if(viewZenithAngle < zenithHorizonAngle) {
+        uv.y = 0.5 * (1.0 - sqrt(max(1.0 - viewZenithAngle / zenithHorizonAngle, 0.0)));
+    } else {
+        uv.y = 0.5 + 0.5 * sqrt(clamp((viewZenithAngle - zenithHorizonAngle) / beta, 0.0, 1.0));
+    }
+    vec2 horizontal = dir.xz, sunHorizontal = sunDir.xz;
+    float lightViewCos = 1.0;
+    if(dot(horizontal, horizontal) > 1e-8 && dot(sunHorizontal, sunHorizontal) > 1e-8)
+        lightViewCos = dot(normalize(horizontal), normalize(sunHorizontal));
+    uv.x = sqrt(clamp(0.5 - 0.5 * lightViewCos, 0.0, 1.0));
+    return uv;
+}
+
+// Haze over the distance to the camera. The scene is only a few km across, so
+// the air along the path is taken to be that at the camera's altitude, and the
+// light it scatters in to be the sky's in the same direction, which is what a
+// path long enough to be opaque would show.
+vec3 AerialPerspective(vec3 color) {
+    vec3 toFragment = FragPos - cameraPos.xyz;
+    float distanceKm = length(toFragment) * atmosphere.x;
+    float altitude = max(atmosphere.y - BOTTOM_RADIUS, 0.0);
+    vec3 extinction = RAYLEIGH_SCATTERING * exp(-altitude / RAYLEIGH_SCALE_HEIGHT)
+                    + vec3(MIE_EXTINCTION * exp(-altitude / MIE_SCALE_HEIGHT));
+    vec3 transmittance = exp(-extinction * distanceKm);
+    vec3 inScattered = texture(skyViewLut, SkyViewUv(normalize(toFragment), atmosphere.y)).rgb * atmosphere.z;
+    return color * transmittance + inScattered * (1.0 - transmittance);
+}
+
+// Ambient light reaching a surface facing n, from the sky around it.
+vec3 SkyAmbient(vec3 n) {
+    vec3 irradiance = irradianceSH[0].rgb * 0.282095
+                    + irradianceSH[1].rgb * (0.488603 * n.y)
+                    + irradianceSH[2].rgb * (0.488603 * n.z)
+                    + irradianceSH[3].rgb * (0.488603 * n.x)
+                    + irradianceSH[4].rgb * (1.092548 * n.x * n.y)
+                    + irradianceSH[5].rgb * (1.092548 * n.y * n.z)
+                    + irradianceSH[6].rgb * (0.315392 * (3.0 * n.z * n.z - 1.0))
+                    + irradianceSH[7].rgb * (1.092548 * n.x * n.z)
+                    + irradianceSH[8].rgb * (0.546274 * (n.x * n.x - n.y * n.y));
+    // The nine coefficients can ring below zero opposite a bright sky
+    return max(irradiance, vec3(0.0));
+}
+
+// The sky reflected off a dielectric surface, mostly at grazing angles.
+// The roughness comes from the specular exponent, and picks the mip level.
+vec3 SkyReflection(vec3 norm, vec3 viewDir) {
+    float roughness = sqrt(2.0 / (shininess + 2.0));
+    float lod = roughness * float(textureQueryLevels(skySpecular) - 1);
+    vec3 reflected = textureLod(skySpecular, reflect(-viewDir, norm), lod).rgb;
+    float fresnel = 0.04 + 0.96 * pow(1.0 - max(dot(norm, viewDir), 0.0), 5.0);
+    return reflected * fresnel;
+}
+
 void main() {
     vec3 norm = normalize(Normal);
-    vec3 viewDir = normalize(cameraPos - FragPos);
+    vec3 viewDir = normalize(cameraPos.xyz - FragPos);
 
-    // Ambient term.
-    vec3 ambient = baseAmbient;
+    // Ambient term, from the sky around the scene.
+    vec3 ambient = baseAmbient.rgb + SkyAmbient(norm);
 
     // Diffuse and specular for the sun.
-    float diffSun = max(dot(norm, -sunDir), 0.0);
-    vec3 reflectSun = reflect(sunDir, norm);
+    float diffSun = max(dot(norm, -sunDir.xyz), 0.0);
+    vec3 reflectSun = reflect(sunDir.xyz, norm);
     float specSun = pow(max(dot(viewDir, reflectSun), 0.0), shininess);
     
     // Diffuse and specular for the moon.
-    float diffMoon = max(dot(norm, -moonDir), 0.0);
-    vec3 reflectMoon = reflect(moonDir, norm);
+    float diffMoon = max(dot(norm, -moonDir.xyz), 0.0);
+    vec3 reflectMoon = reflect(moonDir.xyz, norm);
     float specMoon = pow(max(dot(viewDir, reflectMoon), 0.0), shininess);
 
     // Only the sun casts shadows.
-    float shadow = ShadowCalculation(ShadowCoord, norm, -sunDir);
+    float shadow = ShadowCalculation(norm, -sunDir.xyz);
 
     // Combine diffuse and specular contributions.
-    vec3 diffuse = sunColor * diffSun * shadow + moonColor * diffMoon;
-    vec3 specular = (sunColor * specSun * shadow + moonColor * specMoon) * 0.2;
+    vec3 diffuse = sunColor.rgb * diffSun * shadow + moonColor.rgb * diffMoon;
+    vec3 specular = (sunColor.rgb * specSun * shadow + moonColor.rgb * specMoon) * 0.2;
     
     vec3 lighting = ambient + diffuse + specular;
 
-    vec3 objectColor = vec3(1.0);
-    if(useTexture)
-        objectColor = texture(diffuseTexture, TexCoords).rgb;
+    vec3 objectColor = Tint;
+    MaterialData material = materials[Material];
+    if(material.textured != 0u) {
+        vec3 texCoords = vec3(TexCoords, float(material.layer));
+#ifdef BINDLESS_TEXTURES
+        // Every fragment of a draw has the same material, so the handle is dynamically uniform.
+        objectColor *= texture(sampler2DArray(material.textureHandle), texCoords).rgb;
+#else
+        objectColor *= texture(diffuseTextures, texCoords).rgb;
+#endif
+    }
     
-    FragColor = vec4(objectColor * lighting, 1.0);
+    FragColor = vec4(AerialPerspective(objectColor * lighting + SkyReflection(norm, viewDir)), 1.0);
 }
@@ -1,25 +1,84 @@
 #version 430 core
 
+// See PackedVertex in vertexFormat.hpp: aPos is quantised against the mesh
+// bounds and aNormal is octahedral-encoded.
 layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aNormal;
+layout(location = 1) in vec2 aNormal;
 layout(location = 2) in vec2 aTexCoords;
+// Per-instance; equals the draw's baseInstance, see OBJECT_INDEX_ATTRIBUTE in geometryPool.hpp.
+layout(location = 3) in uint aObjectIndex;
 
-uniform mat4 modelMatrix;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat3 normalMatrix;     // Inverse transpose of modelMatrix.
-uniform mat4 lightSpaceMatrix; // For shadow mapping.
+// Per-frame data shared by all shaders, see FrameConstants in frameData.hpp.
+layout(std140, binding = 0) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 lightSpaceMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
+    vec4 shadowParams;
+    vec4 cameraPos;
+    vec4 sunDir;
+    vec4 sunColor;
+    vec4 moonDir;
+    vec4 moonColor;
+    vec4 baseAmbient;
+    vec4 dayFactor;
+    vec4 atmosphere;
+};
+
+// Per-object data, see ObjectData in frameData.hpp.
+struct ObjectData {
+    mat4 modelMatrix;
+    mat4 normalMatrix;     // Inverse transpose of modelMatrix, upper 3x3.
+    uvec4 flags;           // x = material index (0 = untextured), y = instanced, z = first instance.
+    vec4 positionScale;    // Model-space position = aPos * positionScale + positionOffset.
+    vec4 positionOffset;
+};
+layout(std430, binding = 1) readonly buffer Objects {
+    ObjectData objects[];
+};
+
+// Per-instance data of instanced objects, see InstanceData in instanceData.hpp.
+struct InstanceData {
+    mat4 transform;        // Relative to the object's modelMatrix.
+    mat4 normalMatrix;
+    vec4 tint;
+};
+layout(std430, binding = 2) readonly buffer Instances {
+    InstanceData instances[];
+};
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
-out vec4 ShadowCoord;
+flat out uint Material;
+flat out vec3 Tint;
+
+vec3 decodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if(n.z < 0.0)
+        n.xy = (1.0 - abs(e.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
 
 void main() {
-    vec4 worldPos = modelMatrix * vec4(aPos, 1.0);
+    // aObjectIndex is baseInstance + gl_InstanceID.
+    ObjectData object = objects[aObjectIndex - uint(gl_InstanceID)];
+    mat4 modelMatrix = object.modelMatrix;
+    mat3 normalMatrix = mat3(object.normalMatrix);
+    Tint = vec3(1.0);
+    if(object.flags.y != 0u) {
+        InstanceData instance = instances[object.flags.z + uint(gl_InstanceID)];
+        modelMatrix = modelMatrix * instance.transform;
+        normalMatrix = normalMatrix * mat3(instance.normalMatrix);
+        Tint = instance.tint.rgb;
+    }
+    vec3 position = aPos * object.positionScale.xyz + object.positionOffset.xyz;
+    vec4 worldPos = modelMatrix * vec4(position, 1.0);
     FragPos = worldPos.xyz;
-    Normal = normalize(normalMatrix * aNormal);
+    Normal = normalize(normalMatrix * decodeOctahedral(aNormal));
     TexCoords = aTexCoords;
-    ShadowCoord = lightSpaceMatrix * worldPos;
-    gl_Position = projection * view * worldPos;
+    Material = object.flags.x;
+    gl_Position = viewProjection * worldPos;
 }
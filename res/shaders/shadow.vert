@@ -1,10 +1,59 @@
 #version 430 core
 
+// Quantised against the mesh bounds, see PackedVertex in vertexFormat.hpp.
 layout (location = 0) in vec3 aPos;
+// Per-instance; equals the draw's baseInstance, see OBJECT_INDEX_ATTRIBUTE in geometryPool.hpp.
+layout (location = 3) in uint aObjectIndex;
 
-uniform mat4 modelMatrix;
-uniform mat4 lightSpaceMatrix;
+// Per-frame data shared by all shaders, see FrameConstants in frameData.hpp.
+layout(std140, binding = 0) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 lightSpaceMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
+    vec4 shadowParams;
+    vec4 cameraPos;
+    vec4 sunDir;
+    vec4 sunColor;
+    vec4 moonDir;
+    vec4 moonColor;
+    vec4 baseAmbient;
+    vec4 dayFactor;
+    vec4 atmosphere;
+};
+
+// Per-object data, see ObjectData in frameData.hpp.
+struct ObjectData {
+    mat4 modelMatrix;
+    mat4 normalMatrix;
+    uvec4 flags;
+    vec4 positionScale;
+    vec4 positionOffset;
+};
+layout(std430, binding = 1) readonly buffer Objects {
+    ObjectData objects[];
+};
+
+// Per-instance data of instanced objects, see InstanceData in instanceData.hpp.
+struct InstanceData {
+    mat4 transform;
+    mat4 normalMatrix;
+    vec4 tint;
+};
+layout(std430, binding = 2) readonly buffer Instances {
+    InstanceData instances[];
+};
+
+uniform int cascade; // The shadow cascade being rendered.
 
 void main() {
-    gl_Position = lightSpaceMatrix * modelMatrix * vec4(aPos, 1.0);
+    // aObjectIndex is baseInstance + gl_InstanceID.
+    ObjectData object = objects[aObjectIndex - uint(gl_InstanceID)];
+    mat4 modelMatrix = object.modelMatrix;
+    if(object.flags.y != 0u)
+        modelMatrix = modelMatrix * instances[object.flags.z + uint(gl_InstanceID)].transform;
+    vec3 position = aPos * object.positionScale.xyz + object.positionOffset.xyz;
+    gl_Position = lightSpaceMatrices[cascade] * modelMatrix * vec4(position, 1.0);
 }
@@ -1,35 +1,95 @@
 #version 430 core
 
-in vec3 vPos;
+in vec3 vDirection;
 out vec4 FragColor;
 
-uniform vec3 sunDir;       // Direction to the sun.
-uniform vec3 moonDir;      // Direction to the moon.
-uniform float dayFactor;   // 1.0 = full day, 0.0 = full night.
-uniform float skyboxIntensity; // Overall intensity (e.g., 0.5)
+// Per-frame data shared by all shaders, see FrameConstants in frameData.hpp.
+layout(std140, binding = 0) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 lightSpaceMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
+    vec4 shadowParams;
+    vec4 cameraPos;
+    vec4 sunDir;       // Direction to the sun.
+    vec4 sunColor;
+    vec4 moonDir;      // Direction to the moon.
+    vec4 moonColor;
+    vec4 baseAmbient;
+    vec4 dayFactor;    // x: 1.0 = full day, 0.0 = full night.
+    vec4 atmosphere;   // x: km per world unit, y: viewer height in km, z: sky exposure.
+};
+
+// Precomputed scattering from Atmosphere, on the units in atmosphere.hpp
+uniform sampler2D transmittanceLut;
+uniform sampler2D skyViewLut;
+
+// Keep the planet and the lookup table mappings in sync with atmosphere.comp.
+const float PI = 3.14159265;
+const float BOTTOM_RADIUS = 6360.0;
+const float TOP_RADIUS = 6460.0;
+
+vec2 transmittanceUv(float height, float zenithCos) {
+    float horizon = sqrt(TOP_RADIUS * TOP_RADIUS - BOTTOM_RADIUS * BOTTOM_RADIUS);
+    float rho = sqrt(max(height * height - BOTTOM_RADIUS * BOTTOM_RADIUS, 0.0));
+    float discriminant = height * height * (zenithCos * zenithCos - 1.0) + TOP_RADIUS * TOP_RADIUS;
+    float distanceToTop = max(0.0, -height * zenithCos + sqrt(max(discriminant, 0.0)));
+    float minDistance = TOP_RADIUS - height, maxDistance = rho + horizon;
+    return vec2((distanceToTop - minDistance) / (maxDistance - minDistance), rho / horizon);
+}
+
+// Inverse of the sky-view LUT's mapping in atmosphere.comp
+vec2 skyViewUv(vec3 dir, float viewHeight) {
+    float horizonDistance = sqrt(max(viewHeight * viewHeight - BOTTOM_RADIUS * BOTTOM_RADIUS, 0.0));
+    float beta = acos(clamp(horizonDistance / viewHeight, -1.0, 1.0));
+    float zenithHorizonAngle = PI - beta;
+    float viewZenithAngle = acos(clamp(dir.y, -1.0, 1.0));
+    vec2 uv;
+    if(viewZenithAngle < zenithHorizonAngle) {
+        uv.y = 0.5 * (1.0 - sqrt(max(1.0 - viewZenithAngle / zenithHorizonAngle, 0.0)));
+    } else {
+        uv.y = 0.5 + 0.5 * sqrt(clamp((viewZenithAngle - zenithHorizonAngle) / beta, 0.0, 1.0));
+    }
+    // Angle to the sun around the zenith
+    vec2 horizontal = dir.xz, sunHorizontal = sunDir.xz;
+    float lightViewCos = 1.0;
+    if(dot(horizontal, horizontal) > 1e-8 && dot(sunHorizontal, sunHorizontal) > 1e-8)
+        lightViewCos = dot(normalize(horizontal), normalize(sunHorizontal));
+    uv.x = sqrt(clamp(0.5 - 0.5 * lightViewCos, 0.0, 1.0));
+    return uv;
+}
+
+// Cosine of the radius of the sun's disc, about 1.8 degrees: larger than the real one, so it reads on screen
+const float SUN_DISC_COS = 0.9995;
+// Radiance of the disc relative to the sky's exposed radiance
+const float SUN_DISC_INTENSITY = 8.0;
 
 void main() {
-    vec3 dir = normalize(vPos);
+    vec3 dir = normalize(vDirection);
+    float viewHeight = atmosphere.y;
+    vec3 sky = texture(skyViewLut, skyViewUv(dir, viewHeight)).rgb * atmosphere.z;
+
+#ifndef SKY_PROBE
+    // The sun's disc, dimmed and reddened by the air in front of it, unless the planet is.
+    // The sky probe leaves it out, as model.frag lights with the sun directly.
+    float sunCos = dot(dir, sunDir.xyz);
+    float horizonCos = -sqrt(max(viewHeight * viewHeight - BOTTOM_RADIUS * BOTTOM_RADIUS, 0.0)) / viewHeight;
+    if(dir.y > horizonCos) {
+        float disc = smoothstep(SUN_DISC_COS - 0.0002, SUN_DISC_COS, sunCos);
+        sky += texture(transmittanceLut, transmittanceUv(viewHeight, dir.y)).rgb * disc * SUN_DISC_INTENSITY;
+    }
+#endif
+
+    // The night sky has no sun to scatter, so its faint gradient and the moon stay hand-picked
     float t = clamp(dir.y * 0.5 + 0.5, 0.0, 1.0);
-    
-    // Define gradient colors.
-    vec3 dayTop = vec3(0.2, 0.5, 0.9);
-    vec3 dayHorizon = vec3(0.8, 0.6, 0.3);
     vec3 nightTop = vec3(0.02, 0.02, 0.1);
     vec3 nightHorizon = vec3(0.1, 0.1, 0.2);
-    
-    vec3 dayColor = mix(dayHorizon, dayTop, t);
-    vec3 nightColor = mix(nightHorizon, nightTop, t);
-    vec3 baseColor = mix(nightColor, dayColor, dayFactor);
-    
-    // Sun glow – appears when looking toward the sun.
-    float sunGlow = smoothstep(0.995, 0.98, dot(dir, sunDir)) * dayFactor;
-    vec3 sunDisc = vec3(1.0, 0.9, 0.7) * sunGlow;
-    
-    // Moon glow – appears when the day is fading.
-    float moonGlow = smoothstep(0.995, 0.98, dot(dir, moonDir)) * (1.0 - dayFactor);
-    vec3 moonDisc = vec3(0.9, 0.9, 1.0) * moonGlow;
-    
-    vec3 finalColor = (baseColor + sunDisc + moonDisc) * skyboxIntensity;
-    FragColor = vec4(finalColor, 1.0);
+    float moonGlow = smoothstep(0.98, 0.995, dot(dir, moonDir.xyz));
+    vec3 night = mix(nightHorizon, nightTop, t) + vec3(0.9, 0.9, 1.0) * moonGlow;
+    // Picked as display colours at half intensity; the framebuffer expects linear ones
+    sky += pow(night * 0.5, vec3(2.2)) * (1.0 - dayFactor.x);
+
+    FragColor = vec4(sky, 1.0);
 }
@@ -1,13 +1,41 @@
 #version 430 core
 
-layout (location = 0) in vec3 aPos;
-out vec3 vPos;
+// One triangle covering the screen, made from gl_VertexID without any vertex data
+out vec3 vDirection;
 
-uniform mat4 view;
-uniform mat4 projection;
+#ifdef SKY_PROBE
+// Maps the triangle onto a face of the sky probe's cubemap instead of the screen
+uniform mat3 faceBasis;
+#endif
+
+// Per-frame data shared by all shaders, see FrameConstants in frameData.hpp.
+layout(std140, binding = 0) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 lightSpaceMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeTexelSizes;
+    vec4 shadowParams;
+    vec4 cameraPos;
+    vec4 sunDir;
+    vec4 sunColor;
+    vec4 moonDir;
+    vec4 moonColor;
+    vec4 baseAmbient;
+    vec4 dayFactor;
+    vec4 atmosphere;
+};
 
 void main() {
-    vPos = aPos;
-    vec4 pos = projection * view * vec4(aPos, 1.0);
-    gl_Position = pos.xyww;
+    vec2 position = vec2(float((gl_VertexID & 1) << 2) - 1.0, float((gl_VertexID & 2) << 1) - 1.0);
+#ifdef SKY_PROBE
+    vDirection = faceBasis * vec3(position, 1.0);
+#else
+    // The view ray through the vertex, without the camera's translation so the sky stays centred on it
+    vec4 viewRay = inverse(projection) * vec4(position, 1.0, 1.0);
+    vDirection = transpose(mat3(view)) * (viewRay.xyz / viewRay.w);
+#endif
+    // On the far plane, so the sky only shows where nothing was drawn
+    gl_Position = vec4(position, 1.0, 1.0);
 }
@@ -0,0 +1,116 @@
+#include "atmosphere.hpp"
+#include "utilities/shader.hpp"
+#include <glm/gtc/constants.hpp>
+#include <cmath>
+
+// Lookup table sizes, as in Hillaire's paper
+static const int TRANSMITTANCE_WIDTH = 256, TRANSMITTANCE_HEIGHT = 64;
+static const int MULTIPLE_SCATTERING_SIZE = 32;
+static const int SKY_VIEW_WIDTH = 192, SKY_VIEW_HEIGHT = 108;
+// Only read by the compute shaders
+static const int MULTIPLE_SCATTERING_LUT_UNIT = 6;
+
+// The sky-view table is remade once the sun's elevation changes by this much,
+// or the camera's altitude by this many km
+static const float SKY_VIEW_SUN_THRESHOLD = glm::radians(0.1f);
+static const float SKY_VIEW_HEIGHT_THRESHOLD = 0.01f;
+
+static GLuint createLut(int width, int height)
+{
+    GLuint texture;
+    glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+    glTextureStorage2D(texture, 1, GL_RGBA16F, width, height);
+    glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+// atmosphere.comp compiled to make one of the tables
+static Gloom::Shader *createLutShader(const char *table)
+{
+    Gloom::Shader *shader = new Gloom::Shader();
+    shader->define(table);
+    shader->attach("../res/shaders/atmosphere.comp");
+    shader->link();
+    shader->uniform<int>("transmittanceLut").set(int(TRANSMITTANCE_LUT_UNIT));
+    shader->uniform<int>("multipleScatteringLut").set(MULTIPLE_SCATTERING_LUT_UNIT);
+    return shader;
+}
+
+static void dispatchLut(Gloom::Shader &shader, GLuint lut, int width, int height)
+{
+    shader.activate();
+    glBindImageTexture(0, lut, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glDispatchCompute(GLuint(width + 7) / 8, GLuint(height + 7) / 8, 1);
+    // The next table and the draws read this one through samplers
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void Atmosphere::init()
+{
+    transmittanceLut = createLut(TRANSMITTANCE_WIDTH, TRANSMITTANCE_HEIGHT);
+    multipleScatteringLut = createLut(MULTIPLE_SCATTERING_SIZE, MULTIPLE_SCATTERING_SIZE);
+    skyViewLut = createLut(SKY_VIEW_WIDTH, SKY_VIEW_HEIGHT);
+
+    // The tables that never change are made once, and their shaders dropped
+    Gloom::Shader *transmittanceShader = createLutShader("TRANSMITTANCE_LUT");
+    dispatchLut(*transmittanceShader, transmittanceLut, TRANSMITTANCE_WIDTH, TRANSMITTANCE_HEIGHT);
+    transmittanceShader->destroy();
+    delete transmittanceShader;
+
+    glBindTextureUnit(TRANSMITTANCE_LUT_UNIT, transmittanceLut);
+    Gloom::Shader *multipleScatteringShader = createLutShader("MULTIPLE_SCATTERING_LUT");
+    dispatchLut(*multipleScatteringShader, multipleScatteringLut, MULTIPLE_SCATTERING_SIZE, MULTIPLE_SCATTERING_SIZE);
+    multipleScatteringShader->destroy();
+    delete multipleScatteringShader;
+
+    skyViewShader = createLutShader("SKY_VIEW_LUT");
+    sunZenithCosUniform = skyViewShader->uniform<float>("sunZenithCos");
+    viewHeightUniform = skyViewShader->uniform<float>("viewHeight");
+    skyViewSunSine = 2.0f;
+    skyViewHeight = ATMOSPHERE_PLANET_RADIUS_KM + ATMOSPHERE_GROUND_ALTITUDE_KM;
+    glUseProgram(0);
+}
+
+void Atmosphere::destroy()
+{
+    if (skyViewShader != nullptr) {
+        skyViewShader->destroy();
+        delete skyViewShader;
+        skyViewShader = nullptr;
+    }
+    GLuint textures[] = {transmittanceLut, multipleScatteringLut, skyViewLut};
+    glDeleteTextures(3, textures);
+    transmittanceLut = multipleScatteringLut = skyViewLut = 0;
+}
+
+bool Atmosphere::update(const glm::vec3 &directionToSun, const glm::vec3 &cameraPosition)
+{
+    float sunSine = glm::normalize(directionToSun).y;
+    // Kept just above the ground, as the tables don't cover viewers below it
+    float height = ATMOSPHERE_PLANET_RADIUS_KM
+                 + std::fmax(ATMOSPHERE_GROUND_ALTITUDE_KM + cameraPosition.y * ATMOSPHERE_KM_PER_UNIT, 0.001f);
+    bool sunMoved = skyViewSunSine > 1.0f
+                 || std::fabs(std::asin(sunSine) - std::asin(skyViewSunSine)) > SKY_VIEW_SUN_THRESHOLD;
+    if (!sunMoved && std::fabs(height - skyViewHeight) <= SKY_VIEW_HEIGHT_THRESHOLD)
+        return false;
+
+    skyViewSunSine = sunSine;
+    skyViewHeight = height;
+    sunZenithCosUniform.set(sunSine);
+    viewHeightUniform.set(height);
+    glBindTextureUnit(TRANSMITTANCE_LUT_UNIT, transmittanceLut);
+    glBindTextureUnit(MULTIPLE_SCATTERING_LUT_UNIT, multipleScatteringLut);
+    dispatchLut(*skyViewShader, skyViewLut, SKY_VIEW_WIDTH, SKY_VIEW_HEIGHT);
+    glUseProgram(0);
+    skyViewUpdates++;
+    return true;
+}
+
+void Atmosphere::bind() const
+{
+    glBindTextureUnit(TRANSMITTANCE_LUT_UNIT, transmittanceLut);
+    glBindTextureUnit(SKY_VIEW_LUT_UNIT, skyViewLut);
+}
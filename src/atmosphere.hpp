@@ -0,0 +1,56 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "utilities/shader.hpp"
+
+// Texture units the lookup tables are bound to for skybox.frag and model.frag
+const unsigned int TRANSMITTANCE_LUT_UNIT = 4;
+const unsigned int SKY_VIEW_LUT_UNIT = 5;
+
+// Where the scene sits in the atmosphere: kilometres per world unit, and the
+// altitude of y = 0. Scaled up from the scene's real size so that the far
+// side of it is hazy.
+const float ATMOSPHERE_KM_PER_UNIT = 0.02f;
+const float ATMOSPHERE_GROUND_ALTITUDE_KM = 0.2f;
+// Keep in sync with BOTTOM_RADIUS in the shaders
+const float ATMOSPHERE_PLANET_RADIUS_KM = 6360.0f;
+// Scales the radiance of a sun of illuminance 1 to the framebuffer's range
+const float ATMOSPHERE_EXPOSURE = 10.0f;
+
+// Lookup tables of precomputed atmospheric scattering, made with compute
+// shaders from atmosphere.comp. Transmittance to the top of the atmosphere and
+// the multiple scattering approximation don't depend on the sun, so they are
+// made once. The sky-view table holds the sky's radiance around a viewer at
+// the camera's altitude for the current sun elevation, and is remade only
+// when those have changed enough to show.
+//
+// The sky is drawn from the sky-view table, and model.frag uses it for the
+// haze between the camera and the scene.
+class Atmosphere {
+public:
+    void init();
+    void destroy();
+
+    // Remakes the sky-view table if the sun's elevation or the camera's
+    // altitude moved past their thresholds since it was last made, and
+    // returns whether it did
+    bool update(const glm::vec3 &directionToSun, const glm::vec3 &cameraPosition);
+    void bind() const;
+
+    // Distance from the planet's centre the sky-view table was made for, in km
+    float viewHeight() const { return skyViewHeight; }
+    // Times the sky-view table was remade, for the stats output
+    unsigned int skyViewUpdates = 0;
+
+private:
+    GLuint transmittanceLut = 0;
+    GLuint multipleScatteringLut = 0;
+    GLuint skyViewLut = 0;
+    Gloom::Shader *skyViewShader = nullptr;
+    Gloom::Uniform<float> sunZenithCosUniform, viewHeightUniform;
+
+    // What the sky-view table was made for; a sine above 1 until it is first made
+    float skyViewSunSine = 2.0f;
+    float skyViewHeight = 0.0f;
+};
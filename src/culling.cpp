@@ -0,0 +1,124 @@
+#include "culling.hpp"
+#include "transformHierarchy.hpp"
+#include "utilities/jobSystem.hpp"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define CULLING_USE_SSE 1
+#include <xmmintrin.h>
+#endif
+
+#if CULLING_USE_SSE
+// Tests four boxes against all six planes at once, one box per SIMD lane.
+// Unbounded boxes have infinite extents, which never compare as outside.
+static void testBoxBatch(const Frustum &frustum, const std::vector<AABB> &boxes,
+                         const unsigned int *indices, unsigned char *visible)
+{
+    alignas(16) float center[3][4], extent[3][4];
+    for (int lane = 0; lane < 4; lane++) {
+        const AABB &box = boxes[indices[lane]];
+        for (int axis = 0; axis < 3; axis++) {
+            center[axis][lane] = (box.min[axis] + box.max[axis]) * 0.5f;
+            extent[axis][lane] = (box.max[axis] - box.min[axis]) * 0.5f;
+        }
+    }
+    __m128 cx = _mm_load_ps(center[0]), cy = _mm_load_ps(center[1]), cz = _mm_load_ps(center[2]);
+    __m128 ex = _mm_load_ps(extent[0]), ey = _mm_load_ps(extent[1]), ez = _mm_load_ps(extent[2]);
+
+    __m128 outside = _mm_setzero_ps();
+    for (const glm::vec4 &plane : frustum.planes) {
+        // distance of the center plus the box's projected radius onto the normal
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx),
+                                                _mm_mul_ps(_mm_set1_ps(plane.y), cy)),
+                                     _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), cz),
+                                                _mm_set1_ps(plane.w)));
+        __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::fabs(plane.x)), ex),
+                                              _mm_mul_ps(_mm_set1_ps(std::fabs(plane.y)), ey)),
+                                   _mm_mul_ps(_mm_set1_ps(std::fabs(plane.z)), ez));
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+    }
+    int outsideMask = _mm_movemask_ps(outside);
+    for (int lane = 0; lane < 4; lane++)
+        visible[indices[lane]] = (outsideMask >> lane) & 1 ? 0 : 1;
+}
+#endif
+
+// Tests the boxes of candidates[begin, end) and returns how many were culled
+static unsigned int testCandidates(const TransformHierarchy &hierarchy, const Frustum &frustum,
+                                   const unsigned int *candidates, unsigned int count, unsigned char *visible)
+{
+    unsigned int next = 0;
+#if CULLING_USE_SSE
+    for (; next + 4 <= count; next += 4)
+        testBoxBatch(frustum, hierarchy.worldBounds, &candidates[next], visible);
+#endif
+    for (; next < count; next++) {
+        unsigned int index = candidates[next];
+        visible[index] = testAABB(frustum, hierarchy.worldBounds[index]) != OUTSIDE_FRUSTUM;
+    }
+    unsigned int culled = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        if (!visible[candidates[i]])
+            culled++;
+    }
+    return culled;
+}
+
+// Candidates tested by one job
+static const unsigned int CULLING_GRAIN = 4096;
+
+void cullHierarchy(const TransformHierarchy &hierarchy, const Frustum &frustum, CullResult &result,
+                   JobSystem *jobs)
+{
+    unsigned int count = hierarchy.nodes.size();
+    result.visible.assign(count, 0);
+    result.tested = 0;
+    result.culled = 0;
+    result.candidates.clear();
+
+    unsigned int i = 0;
+    while (i < count) {
+        unsigned int end = hierarchy.subtreeEnds[i];
+        if (end - i > 1) {
+            result.tested++;
+            FrustumTest test = testAABB(frustum, hierarchy.subtreeBounds[i]);
+            if (test == OUTSIDE_FRUSTUM) {
+                for (unsigned int j = i; j < end; j++) {
+                    if (!hierarchy.worldBounds[j].isEmpty())
+                        result.culled++;
+                }
+                i = end;
+                continue;
+            }
+            if (test == INSIDE_FRUSTUM) {
+                for (unsigned int j = i; j < end; j++)
+                    result.visible[j] = hierarchy.worldBounds[j].isEmpty() ? 0 : 1;
+                i = end;
+                continue;
+            }
+        }
+        // A leaf, or a subtree straddling the frustum: test the node's own box
+        // and carry on with its children
+        if (!hierarchy.worldBounds[i].isEmpty())
+            result.candidates.push_back(i);
+        i++;
+    }
+
+    const std::vector<unsigned int> &candidates = result.candidates;
+    unsigned int candidateCount = candidates.size();
+    result.tested += candidateCount;
+    if (jobs == nullptr || candidateCount <= CULLING_GRAIN) {
+        result.culled += testCandidates(hierarchy, frustum, candidates.data(), candidateCount, result.visible.data());
+        return;
+    }
+
+    // Each job writes the visibility of its own candidates and its own count,
+    // so they need no locking; the counts are summed afterwards
+    unsigned int jobCount = (candidateCount + CULLING_GRAIN - 1) / CULLING_GRAIN;
+    std::vector<unsigned int> culledPerJob(jobCount, 0);
+    jobs->parallelFor(candidateCount, CULLING_GRAIN, [&](unsigned int begin, unsigned int end) {
+        culledPerJob[begin / CULLING_GRAIN] = testCandidates(hierarchy, frustum, &candidates[begin], end - begin,
+                                                             result.visible.data());
+    });
+    for (unsigned int culled : culledPerJob)
+        result.culled += culled;
+}
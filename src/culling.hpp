@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+
+#include "utilities/bounds.hpp"
+
+struct TransformHierarchy;
+class JobSystem;
+
+// Which slots of a TransformHierarchy lie at least partly inside a frustum,
+// plus counters for the --stats output
+struct CullResult {
+    std::vector<unsigned char> visible;  // Indexed like the hierarchy's slots
+    unsigned int tested = 0;             // Boxes tested against the frustum planes
+    unsigned int culled = 0;             // Nodes with bounds found to be outside
+
+    // Scratch list of slots whose own box still needs testing, kept to avoid reallocating
+    std::vector<unsigned int> candidates;
+};
+
+// Tests the hierarchy's bounds against the frustum. Subtrees entirely outside
+// or inside are decided with one test; the remaining nodes are tested four at
+// a time, spread over the job system's threads if one is given. Nodes without
+// bounds are never visible, as they draw nothing.
+// Uses the world bounds from the last updateTransformHierarchy().
+void cullHierarchy(const TransformHierarchy &hierarchy, const Frustum &frustum, CullResult &result,
+                   JobSystem *jobs = nullptr);
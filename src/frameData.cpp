@@ -0,0 +1,51 @@
+#include "frameData.hpp"
+#include "renderQueue.hpp"
+#include "utilities/persistentBuffer.hpp"
+
+void writeObjectData(const RenderQueue &queue, PersistentRingBuffer &objectBuffer)
+{
+    // The buffer must never be empty, as binding a zero-sized range is an error
+    unsigned int count = queue.packetCount > 0 ? queue.packetCount : 1;
+    ObjectData *objects = static_cast<ObjectData*>(objectBuffer.beginWrite(count * sizeof(ObjectData)));
+    for (unsigned int i = 0; i < queue.packetCount; i++) {
+        const DrawPacket &packet = queue.packets[i];
+        // The mapping is write-only memory, so fill in whole structs without reading back
+        ObjectData object;
+        object.modelMatrix = packet.modelMatrix;
+        object.normalMatrix = glm::mat4(packet.normalMatrix);
+        object.flags = glm::uvec4(packet.material, packet.instanced ? 1 : 0, packet.firstInstance, 0);
+        object.positionScale = glm::vec4(packet.positionScale, 0.0f);
+        object.positionOffset = glm::vec4(packet.positionOffset, 0.0f);
+        objects[i] = object;
+    }
+}
+
+static void writePassCommands(const RenderQueue &queue, const PassPackets &pass, bool shadow,
+                              DrawElementsIndirectCommand *commands)
+{
+    for (unsigned int i = 0; i < pass.count; i++) {
+        const DrawPacket *packet = pass.packets[i];
+        DrawElementsIndirectCommand command;
+        command.count = shadow ? packet->shadowIndexCount : packet->indexCount;
+        command.instanceCount = packet->instanceCount;
+        command.firstIndex = shadow ? packet->shadowFirstIndex : packet->firstIndex;
+        command.baseVertex = packet->baseVertex;
+        command.baseInstance = unsigned(packet - queue.packets);
+        commands[i] = command;
+    }
+}
+
+void writeIndirectCommands(const RenderQueue &queue, PersistentRingBuffer &commandBuffer)
+{
+    // The main pass's commands come last
+    unsigned int count = queue.mainPass.firstCommand + queue.mainPass.count;
+    if (count == 0)
+        count = 1;
+    DrawElementsIndirectCommand *commands = static_cast<DrawElementsIndirectCommand*>(
+        commandBuffer.beginWrite(count * sizeof(DrawElementsIndirectCommand)));
+    for (unsigned int cascade = 0; cascade < queue.shadowPassCount; cascade++) {
+        for (const PassPackets *pass : {&queue.shadowPasses[cascade], &queue.dynamicShadowPasses[cascade]})
+            writePassCommands(queue, *pass, true, commands + pass->firstCommand);
+    }
+    writePassCommands(queue, queue.mainPass, false, commands + queue.mainPass.firstCommand);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "shadowProjection.hpp"
+
+struct RenderQueue;
+class PersistentRingBuffer;
+
+// Binding points shared with the shaders. Keep these in sync with the
+// layout(binding = ...) qualifiers in res/shaders/.
+const unsigned int FRAME_CONSTANTS_BINDING = 0;
+const unsigned int OBJECT_DATA_BINDING = 1;
+const unsigned int INSTANCE_DATA_BINDING = 2;  // See InstanceData in instanceData.hpp
+const unsigned int MATERIAL_DATA_BINDING = 3;  // See MaterialData in textureCache.hpp
+const unsigned int SKY_IRRADIANCE_BINDING = 4; // See SkyProbe in skyProbe.hpp
+
+// Mirrors the std140 FrameConstants uniform block declared in model.vert,
+// model.frag, shadow.vert and skybox.vert/.frag. Only mat4 and vec4 members
+// are used so the C++ and std140 layouts match without padding.
+struct FrameConstants {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    // Light space of each shadow cascade, see ShadowCascades
+    glm::mat4 lightSpaceMatrices[MAX_SHADOW_CASCADES];
+    glm::vec4 cascadeSplits;      // View depth at which each cascade ends
+    glm::vec4 cascadeTexelSizes;  // World-space size of a texel of each cascade
+    glm::vec4 shadowParams;       // x = cascade count, y = fraction of a cascade blended into the next,
+                                  // z = 1 / shadow map size
+    glm::vec4 cameraPos;
+    glm::vec4 sunDir;
+    glm::vec4 sunColor;
+    glm::vec4 moonDir;
+    glm::vec4 moonColor;
+    glm::vec4 baseAmbient;
+    glm::vec4 dayFactor;     // x = 0 at night, 1 at full day
+    glm::vec4 atmosphere;    // x = km per world unit, y = viewer's distance from the planet's centre in km,
+                             // z = exposure of the sky's radiance, see Atmosphere
+};
+
+// Mirrors one element of the std430 ObjectData storage buffer
+struct ObjectData {
+    glm::mat4 modelMatrix;
+    glm::mat4 normalMatrix;  // Only the upper 3x3 is used
+    glm::uvec4 flags;        // x = material index, 0 if untextured, y = 1 if instanced,
+                             // z = first instance in the InstancePool
+    // Model-space position = quantised position * positionScale + positionOffset
+    glm::vec4 positionScale;
+    glm::vec4 positionOffset;
+};
+
+// Writes one ObjectData per packet in the queue, indexed like queue.packets
+void writeObjectData(const RenderQueue &queue, PersistentRingBuffer &objectBuffer);
+
+// Writes the indirect draw commands of each shadow cascade's pass followed by
+// those of the main pass. Each command's baseInstance is the packet's object index; the
+// shaders subtract gl_InstanceID from the object index attribute to recover it.
+void writeIndirectCommands(const RenderQueue &queue, PersistentRingBuffer &commandBuffer);
@@ -0,0 +1,88 @@
+#include "instanceData.hpp"
+#include "sceneGraph.hpp"
+#include <algorithm>
+
+InstancePool &sharedInstancePool()
+{
+    static InstancePool pool;
+    return pool;
+}
+
+static GLuint createInstanceStorage(unsigned int capacity)
+{
+    GLuint buffer;
+    glCreateBuffers(1, &buffer);
+    glNamedBufferStorage(buffer, GLsizeiptr(capacity) * sizeof(InstanceData), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    return buffer;
+}
+
+void InstancePool::init(unsigned int initialCapacity)
+{
+    allocator = RangeAllocator(initialCapacity);
+    buffer = createInstanceStorage(initialCapacity);
+}
+
+void InstancePool::destroy()
+{
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+}
+
+void InstancePool::grow(unsigned int minimumCapacity)
+{
+    unsigned int oldCapacity = allocator.size();
+    unsigned int newCapacity = std::max(2 * oldCapacity, minimumCapacity);
+    GLuint larger = createInstanceStorage(newCapacity);
+    glCopyNamedBufferSubData(buffer, larger, 0, 0, GLsizeiptr(oldCapacity) * sizeof(InstanceData));
+    glDeleteBuffers(1, &buffer);
+    buffer = larger;
+    allocator.grow(newCapacity);
+}
+
+InstanceRange InstancePool::allocate(unsigned int count)
+{
+    InstanceRange range;
+    range.count = count;
+    while (!allocator.allocate(count, range.first))
+        grow(allocator.size() + count);
+    return range;
+}
+
+void InstancePool::release(const InstanceRange &range)
+{
+    allocator.release(range.first, range.count);
+}
+
+void InstancePool::update(const InstanceRange &range, const InstanceData *instances)
+{
+    glNamedBufferSubData(buffer, GLintptr(range.first) * sizeof(InstanceData),
+                         GLsizeiptr(range.count) * sizeof(InstanceData), instances);
+    updates++;
+}
+
+void InstancePool::bind(GLuint binding) const
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+}
+
+void setNodeInstances(SceneNode *node, const AABB &meshBounds, const std::vector<glm::mat4> &transforms,
+                      const std::vector<glm::vec4> &tints)
+{
+    InstancePool &pool = sharedInstancePool();
+    if (node->instances.count != transforms.size()) {
+        pool.release(node->instances);
+        node->instances = pool.allocate(transforms.size());
+    }
+
+    std::vector<InstanceData> instances(transforms.size());
+    AABB bounds;
+    for (size_t i = 0; i < transforms.size(); i++) {
+        bounds.grow(transformAABB(transforms[i], meshBounds));
+        instances[i].transform = transforms[i];
+        instances[i].normalMatrix = glm::mat4(glm::transpose(glm::inverse(glm::mat3(transforms[i]))));
+        instances[i].tint = i < tints.size() ? tints[i] : glm::vec4(1.0f);
+    }
+    if (!instances.empty())
+        pool.update(node->instances, instances.data());
+    node->setLocalBounds(bounds);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <vector>
+
+#include "utilities/bounds.hpp"
+#include "utilities/rangeAllocator.hpp"
+
+struct SceneNode;
+
+// Mirrors one element of the std430 InstanceData storage buffer
+struct InstanceData {
+    glm::mat4 transform;     // Relative to the owning node
+    glm::mat4 normalMatrix;  // Only the upper 3x3 is used
+    glm::vec4 tint;          // Multiplies the surface color; rgb only
+};
+
+// Where the instances of one INSTANCED_GEOMETRY node live in the InstancePool
+struct InstanceRange {
+    unsigned int first = 0;
+    unsigned int count = 0;
+};
+
+// A GPU buffer holding the per-instance data of every instanced node. Instances
+// are only uploaded when they change, so drawing thousands of them costs no
+// per-frame CPU work beyond one indirect command.
+class InstancePool {
+public:
+    void init(unsigned int initialCapacity = 1 << 10);
+    void destroy();
+
+    InstanceRange allocate(unsigned int count);
+    void release(const InstanceRange &range);
+    void update(const InstanceRange &range, const InstanceData *instances);
+
+    // Binds the whole buffer to the given shader storage binding point
+    void bind(GLuint binding) const;
+
+    // Bumped by every update(), so anything cached from the instances can tell they changed
+    unsigned int version() const { return updates; }
+
+private:
+    void grow(unsigned int minimumCapacity);
+
+    GLuint buffer = 0;
+    RangeAllocator allocator;
+    unsigned int updates = 0;
+};
+
+// The pool used for scene instances. Call init() once a GL context exists.
+InstancePool &sharedInstancePool();
+
+// Gives an INSTANCED_GEOMETRY node one instance per transform, replacing any it
+// had. Tints are optional and default to white. meshBounds are the local bounds
+// of the node's mesh; the node's bounds become those of all its instances.
+void setNodeInstances(SceneNode *node, const AABB &meshBounds, const std::vector<glm::mat4> &transforms,
+                      const std::vector<glm::vec4> &tints = std::vector<glm::vec4>());
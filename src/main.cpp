@@ -7,6 +7,7 @@
 #include <GLFW/glfw3.h>
 
 // Standard headers
+#include <algorithm>
 #include <cstdlib>
 #include <arrrgh.hpp>
 
@@ -27,7 +28,7 @@ GLFWwindow *initialise()
 
     // Set core window options (adjust version numbers if needed)
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     // Enable the GLFW runtime error callback function defined previously.
@@ -36,6 +37,8 @@ GLFWwindow *initialise()
     // Set additional window options
     glfwWindowHint(GLFW_RESIZABLE, windowResizable);
     glfwWindowHint(GLFW_SAMPLES, windowSamples); // MSAA
+    // Shading happens in linear space; the framebuffer encodes to sRGB on write
+    glfwWindowHint(GLFW_SRGB_CAPABLE, GL_TRUE);
 
     // Create window using GLFW
     GLFWwindow *window = glfwCreateWindow(windowWidth, windowHeight, windowTitle.c_str(), nullptr, nullptr);
@@ -67,6 +70,15 @@ int main(int argc, const char *argb[])
     const auto &showHelp = parser.add<bool>("help", "Show this help message.", 'h', arrrgh::Optional, false);
     const auto &enableMusic = parser.add<bool>("enable-music", "Play background music while the game is playing", 'm', arrrgh::Optional, false);
     const auto &enableAutoplay = parser.add<bool>("autoplay", "Let the game play itself automatically. Useful for testing.", 'a', arrrgh::Optional, false);
+    const auto &enableStats = parser.add<bool>("stats", "Print per-frame rendering statistics every few seconds.", 's', arrrgh::Optional, false);
+    const auto &threadCount = parser.add<int>("threads", "Threads used for the per-frame scene update. 0 uses all hardware threads, 1 disables multithreading.", 't', arrrgh::Optional, 0);
+    const auto &sundialCopies = parser.add<int>("sundials", "Number of extra sundials to draw around the main one, as instances of it.", 'n', arrrgh::Optional, 0);
+    const auto &anisotropy = parser.add<int>("anisotropy", "Maximum anisotropic filtering of textures, clamped to what the GPU supports. 1 disables it.", 'f', arrrgh::Optional, 8);
+    const auto &shadowCascades = parser.add<int>("shadow-cascades", "Number of shadow map cascades the view is split into, from 1 to 4.", 'c', arrrgh::Optional, 3);
+    const auto &shadowMapSize = parser.add<int>("shadow-size", "Resolution of each shadow map cascade, clamped to what the GPU supports.", 'z', arrrgh::Optional, 2048);
+    const auto &shadowCacheAngle = parser.add<float>("shadow-cache-angle", "Degrees the sun moves before the cached shadows of static objects are redrawn. 0 redraws all shadows every frame.", 'g', arrrgh::Optional, 0.5f);
+    const auto &shadowQuality = parser.add<std::string>("shadow-quality", "Shadow filtering: pcf (one hardware-filtered tap), poisson (several taps on a rotated disc) or evsm (blurred exponential variance shadow maps).", 'q', arrrgh::Optional, "poisson");
+    const auto &shadowTaps = parser.add<int>("shadow-taps", "Taps per cascade of the poisson shadow quality, from 4 to 16.", 'p', arrrgh::Optional, 12);
 
     // If you want to add more program arguments, define them here,
     // but do not request their value here (they have not been parsed yet at this point).
@@ -91,6 +103,27 @@ int main(int argc, const char *argb[])
     CommandLineOptions options;
     options.enableMusic = enableMusic.value();
     options.enableAutoplay = enableAutoplay.value();
+    options.enableStats = enableStats.value();
+    options.threadCount = threadCount.value() > 0 ? threadCount.value() : 0;
+    options.sundialCopies = sundialCopies.value() > 0 ? sundialCopies.value() : 0;
+    options.anisotropy = anisotropy.value() > 1 ? anisotropy.value() : 1;
+    options.shadowCascades = std::min(std::max(shadowCascades.value(), 1), 4);
+    options.shadowMapSize = std::max(shadowMapSize.value(), 64);
+    options.shadowCacheAngle = std::max(shadowCacheAngle.value(), 0.0f);
+    options.shadowQuality = SHADOW_QUALITY_POISSON;
+    if (shadowQuality.value() == "pcf")
+    {
+        options.shadowQuality = SHADOW_QUALITY_PCF;
+    }
+    else if (shadowQuality.value() == "evsm")
+    {
+        options.shadowQuality = SHADOW_QUALITY_EVSM;
+    }
+    else if (shadowQuality.value() != "poisson")
+    {
+        std::cerr << "Unknown shadow quality " << shadowQuality.value() << ", using poisson." << std::endl;
+    }
+    options.shadowTaps = std::min(std::max(shadowTaps.value(), 4), 16);
 
     // Initialise window using GLFW
     GLFWwindow *window = initialise();
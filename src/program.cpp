@@ -9,10 +9,10 @@
 #include <SFML/Audio.hpp>
 #include <SFML/System/Time.hpp>
 #include <utilities/shapes.h>
-#include <utilities/glutils.h>
 #include <utilities/shader.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <utilities/timeutils.h>
+#include <utilities/assetStreamer.hpp>
 
 void runProgram(GLFWwindow *window, CommandLineOptions options)
 {
@@ -30,11 +30,18 @@ void runProgram(GLFWwindow *window, CommandLineOptions options)
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    // Set default colour after clearing the colour buffer
-    glClearColor(0.3f, 0.5f, 0.8f, 1.0f);
+    // Write linear colours to the sRGB framebuffer, encoding them on the way
+    glEnable(GL_FRAMEBUFFER_SRGB);
+
+    // Set default colour after clearing the colour buffer (sRGB 0.3, 0.5, 0.8 in linear terms)
+    glClearColor(0.073f, 0.214f, 0.604f, 1.0f);
 
     initScene(window, options);
 
+    // Startup times count from glfwInit(), the first thing main() does
+    bool firstFramePresented = false;
+    bool assetsResident = false;
+
     // Rendering Loop
     while (!glfwWindowShouldClose(window))
     {
@@ -50,6 +57,17 @@ void runProgram(GLFWwindow *window, CommandLineOptions options)
 
         // Flip buffers
         glfwSwapBuffers(window);
+
+        if (!firstFramePresented)
+        {
+            std::cout << "Time to first frame: " << 1000.0 * glfwGetTime() << " ms." << std::endl;
+            firstFramePresented = true;
+        }
+        if (!assetsResident && sharedAssetStreamer().idle())
+        {
+            std::cout << "All streamed assets resident " << 1000.0 * glfwGetTime() << " ms after startup." << std::endl;
+            assetsResident = true;
+        }
     }
 }
 
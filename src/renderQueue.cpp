@@ -0,0 +1,391 @@
+#include "renderQueue.hpp"
+#include "sceneGraph.hpp"
+#include "utilities/shader.hpp"
+#include "utilities/jobSystem.hpp"
+#include "utilities/textureCache.hpp"
+#include "utilities/hash.hpp"
+#include "instanceData.hpp"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+// Splits a sorted pass into runs that share shader, VAO and texture array.
+// The shadow pass ignores shader and textures. pass.batches must have room for
+// one batch per packet.
+static void buildBatches(PassPackets &pass, bool shadow)
+{
+    pass.batchCount = 0;
+    DrawBatch *current = nullptr;
+    for (unsigned int i = 0; i < pass.count; i++) {
+        const DrawPacket *packet = pass.packets[i];
+        bool sameState = current != nullptr
+            && current->vertexArrayObjectID == packet->vertexArrayObjectID
+            && (shadow || (current->shader == packet->shader && current->textureArray == packet->textureArray));
+        if (sameState) {
+            current->packetCount++;
+            current->instanceCount += packet->instanceCount;
+            continue;
+        }
+        current = &pass.batches[pass.batchCount++];
+        current->shader = packet->shader;
+        current->vertexArrayObjectID = packet->vertexArrayObjectID;
+        current->indexType = packet->indexType;
+        current->textureArray = shadow ? 0 : packet->textureArray;
+        current->firstPacket = i;
+        current->packetCount = 1;
+        current->instanceCount = packet->instanceCount;
+    }
+}
+
+// Collects the packets for which include(packet) is true
+template <class Filter>
+static PassPackets collectPass(RenderQueue &queue, Filter include)
+{
+    PassPackets result;
+    result.packets = queue.arena.allocate<const DrawPacket*>(queue.packetCount);
+    for (unsigned int i = 0; i < queue.packetCount; i++) {
+        if (include(queue.packets[i]))
+            result.packets[result.count++] = &queue.packets[i];
+    }
+    result.batches = queue.arena.allocate<DrawBatch>(result.count);
+    return result;
+}
+
+// The passes the node in slot i is drawn in this frame, or 0 if none, and the
+// shadow cascades it casts into
+static unsigned int packetPassMask(const TransformHierarchy &hierarchy, unsigned int i,
+                                   const unsigned char *mainVisibility, const unsigned char *const *shadowVisibility,
+                                   unsigned int shadowCascadeCount, unsigned int &cascadeMask)
+{
+    cascadeMask = 0;
+    const SceneNode *node = hierarchy.nodes[i];
+    bool instanced = node->nodeType == INSTANCED_GEOMETRY;
+    if ((node->nodeType != GEOMETRY && !instanced) || node->vertexArrayObjectID == -1)
+        return 0;
+    if (instanced && node->instances.count == 0)
+        return 0;
+    unsigned int passMask = node->renderPasses;
+    if (mainVisibility != nullptr && !mainVisibility[i])
+        passMask &= ~MAIN_PASS;
+    if (passMask & SHADOW_PASS) {
+        for (unsigned int cascade = 0; cascade < shadowCascadeCount; cascade++) {
+            if (shadowVisibility == nullptr || shadowVisibility[cascade][i])
+                cascadeMask |= 1u << cascade;
+        }
+        if (cascadeMask == 0)
+            passMask &= ~SHADOW_PASS;
+    }
+    return passMask;
+}
+
+// The coarsest level whose error, times errorScale, stays within maxError,
+// using a tighter limit for moving to a coarser level than the one drawn before.
+// Levels get coarser and their errors larger with the level number.
+static unsigned int selectLod(const GeometryRange &geometry, float errorScale, float maxError, float hysteresis,
+                              unsigned int previous)
+{
+    unsigned int withinLimit = 0, withinCoarserLimit = 0;
+    for (unsigned int level = 1; level < geometry.lodCount; level++) {
+        float error = geometry.lods[level].error * errorScale;
+        if (error <= maxError)
+            withinLimit = level;
+        if (error <= maxError * (1.0f - hysteresis))
+            withinCoarserLimit = level;
+    }
+    if (previous > withinLimit)
+        return withinLimit;
+    return std::max(previous, withinCoarserLimit);
+}
+
+// Picks the levels of detail of both passes and remembers them in the node
+static void selectLods(DrawPacket &packet, SceneNode *node, const TransformHierarchy &hierarchy, unsigned int i,
+                       const LodSelection *selection)
+{
+    const GeometryRange &geometry = node->geometry;
+    if (geometry.lodCount == 0) {
+        // Not from the GeometryPool, so there is only the one mesh
+        packet.indexCount = packet.shadowIndexCount = node->VAOIndexCount;
+        packet.firstIndex = packet.shadowFirstIndex = geometry.firstIndex;
+        return;
+    }
+
+    unsigned int mainLod = 0, shadowLod = 0;
+    const AABB &bounds = hierarchy.worldBounds[i];
+    if (selection != nullptr && geometry.lodCount > 1 && !bounds.isEmpty() && !bounds.isUnbounded()) {
+        // Model-space errors grow with the largest scale of the node's transform
+        const glm::mat4 &model = hierarchy.worldMatrices[i];
+        float scaleSquared = 0.0f;
+        for (int axis = 0; axis < 3; axis++)
+            scaleSquared = std::max(scaleSquared, glm::dot(glm::vec3(model[axis]), glm::vec3(model[axis])));
+        glm::vec3 nearest = glm::clamp(selection->cameraPosition, bounds.min, bounds.max);
+        float distance = glm::length(nearest - selection->cameraPosition);
+        // From inside the bounds, only the finest level will do
+        if (distance > 0.0f) {
+            float pixelsPerError = std::sqrt(scaleSquared) * selection->pixelsPerUnit / distance;
+            mainLod = selectLod(geometry, pixelsPerError, selection->maxPixelError, selection->hysteresis,
+                                node->mainPassLod);
+            shadowLod = selectLod(geometry, pixelsPerError, selection->maxPixelError * selection->shadowErrorScale,
+                                  selection->hysteresis, node->shadowPassLod);
+        }
+    }
+    if (packet.passMask & MAIN_PASS)
+        node->mainPassLod = (unsigned char)mainLod;
+    if (packet.passMask & SHADOW_PASS)
+        node->shadowPassLod = (unsigned char)shadowLod;
+
+    packet.indexCount = geometry.lods[mainLod].indexCount;
+    packet.firstIndex = geometry.firstIndex + geometry.lods[mainLod].firstIndex;
+    packet.shadowIndexCount = geometry.lods[shadowLod].indexCount;
+    packet.shadowFirstIndex = geometry.firstIndex + geometry.lods[shadowLod].firstIndex;
+}
+
+// Only ever called for one slot by one job, so writing the node's LOD state is safe
+static void fillPacket(DrawPacket &packet, const TransformHierarchy &hierarchy, unsigned int i,
+                       unsigned int passMask, unsigned int cascadeMask, Gloom::Shader *defaultShader,
+                       const LodSelection *lodSelection)
+{
+    SceneNode *node = hierarchy.nodes[i];
+    bool instanced = node->nodeType == INSTANCED_GEOMETRY;
+    packet.shader = node->shader != nullptr ? node->shader : defaultShader;
+    packet.vertexArrayObjectID = node->vertexArrayObjectID;
+    packet.indexType = node->geometry.indexType;
+    packet.passMask = passMask;
+    packet.cascadeMask = cascadeMask;
+    packet.dynamicCaster = node->dynamicShadowCaster;
+    selectLods(packet, node, hierarchy, i, lodSelection);
+    packet.baseVertex = int(node->geometry.baseVertex);
+    packet.instanced = instanced;
+    packet.instanceCount = instanced ? node->instances.count : 1;
+    packet.firstInstance = node->instances.first;
+    // Only reads the cache, which nothing changes while the queue is built
+    packet.material = node->material;
+    packet.textureArray = sharedTextureCache().bindingFor(node->material);
+    packet.modelMatrix = hierarchy.worldMatrices[i];
+    packet.normalMatrix = hierarchy.normalMatrices[i];
+    packet.positionScale = node->geometry.quantization.scale;
+    packet.positionOffset = node->geometry.quantization.offset;
+}
+
+// Nodes handled by one job when generating packets in parallel
+static const unsigned int PACKET_GRAIN = 2048;
+
+// Generates the packets in parallel. Each job first counts the packets of its
+// own chunk of slots; a prefix sum over the counts then gives every chunk its
+// own output range, so the jobs fill the packet array without any locking and
+// the result is in the same order as the serial version.
+static void generatePacketsParallel(RenderQueue &queue, const TransformHierarchy &hierarchy, Gloom::Shader *defaultShader,
+                                    const unsigned char *mainVisibility, const unsigned char *const *shadowVisibility,
+                                    unsigned int shadowCascadeCount, const LodSelection *lodSelection, JobSystem &jobs)
+{
+    unsigned int nodeCount = hierarchy.nodes.size();
+    unsigned int chunkCount = (nodeCount + PACKET_GRAIN - 1) / PACKET_GRAIN;
+    unsigned char *passMasks = queue.arena.allocate<unsigned char>(nodeCount);
+    unsigned char *cascadeMasks = queue.arena.allocate<unsigned char>(nodeCount);
+    unsigned int *chunkOffsets = queue.arena.allocate<unsigned int>(chunkCount + 1);
+    unsigned int *chunkInstances = queue.arena.allocate<unsigned int>(chunkCount);
+
+    jobs.parallelFor(nodeCount, PACKET_GRAIN, [&](unsigned int begin, unsigned int end) {
+        unsigned int packets = 0;
+        for (unsigned int i = begin; i < end; i++) {
+            unsigned int cascadeMask;
+            passMasks[i] = (unsigned char)packetPassMask(hierarchy, i, mainVisibility, shadowVisibility,
+                                                         shadowCascadeCount, cascadeMask);
+            cascadeMasks[i] = (unsigned char)cascadeMask;
+            if (passMasks[i] != 0)
+                packets++;
+        }
+        chunkOffsets[begin / PACKET_GRAIN + 1] = packets;
+    });
+
+    chunkOffsets[0] = 0;
+    for (unsigned int chunk = 0; chunk < chunkCount; chunk++)
+        chunkOffsets[chunk + 1] += chunkOffsets[chunk];
+
+    jobs.parallelFor(nodeCount, PACKET_GRAIN, [&](unsigned int begin, unsigned int end) {
+        unsigned int chunk = begin / PACKET_GRAIN;
+        DrawPacket *out = queue.packets + chunkOffsets[chunk];
+        unsigned int instances = 0;
+        for (unsigned int i = begin; i < end; i++) {
+            if (passMasks[i] == 0)
+                continue;
+            fillPacket(*out, hierarchy, i, passMasks[i], cascadeMasks[i], defaultShader, lodSelection);
+            instances += out->instanceCount;
+            out++;
+        }
+        chunkInstances[chunk] = instances;
+    });
+
+    queue.packetCount = chunkOffsets[chunkCount];
+    for (unsigned int chunk = 0; chunk < chunkCount; chunk++)
+        queue.instanceCount += chunkInstances[chunk];
+}
+
+void buildRenderQueue(RenderQueue &queue, const TransformHierarchy &hierarchy, Gloom::Shader *defaultShader,
+                      const unsigned char *mainVisibility, const unsigned char *const *shadowVisibility,
+                      unsigned int shadowCascadeCount, JobSystem *jobs, const LodSelection *lodSelection)
+{
+    shadowCascadeCount = std::min(shadowCascadeCount, MAX_SHADOW_CASCADES);
+    queue.arena.reset();
+    unsigned int nodeCount = hierarchy.nodes.size();
+    queue.packets = queue.arena.allocate<DrawPacket>(nodeCount);
+    queue.packetCount = 0;
+    queue.instanceCount = 0;
+
+    if (jobs != nullptr && jobs->threadCount() > 1 && nodeCount > PACKET_GRAIN) {
+        generatePacketsParallel(queue, hierarchy, defaultShader, mainVisibility, shadowVisibility,
+                                shadowCascadeCount, lodSelection, *jobs);
+    } else {
+        for (unsigned int i = 0; i < nodeCount; i++) {
+            unsigned int cascadeMask;
+            unsigned int passMask = packetPassMask(hierarchy, i, mainVisibility, shadowVisibility,
+                                                   shadowCascadeCount, cascadeMask);
+            if (passMask == 0)
+                continue;
+            DrawPacket &packet = queue.packets[queue.packetCount++];
+            fillPacket(packet, hierarchy, i, passMask, cascadeMask, defaultShader, lodSelection);
+            queue.instanceCount += packet.instanceCount;
+        }
+    }
+
+    queue.shadowPassCount = shadowCascadeCount;
+    for (unsigned int cascade = 0; cascade < shadowCascadeCount; cascade++) {
+        for (bool dynamic : {false, true}) {
+            PassPackets pass = collectPass(queue, [cascade, dynamic](const DrawPacket &packet) {
+                return (packet.passMask & SHADOW_PASS) && (packet.cascadeMask & (1u << cascade))
+                    && packet.dynamicCaster == dynamic;
+            });
+            (dynamic ? queue.dynamicShadowPasses : queue.shadowPasses)[cascade] = pass;
+        }
+    }
+    queue.mainPass = collectPass(queue, [](const DrawPacket &packet) { return (packet.passMask & MAIN_PASS) != 0; });
+
+    // The shadow passes use one program and no textures, so only the VAO matters
+    auto finishShadowPasses = [&queue]() {
+        for (unsigned int cascade = 0; cascade < queue.shadowPassCount; cascade++) {
+            for (PassPackets *pass : {&queue.shadowPasses[cascade], &queue.dynamicShadowPasses[cascade]}) {
+                std::sort(pass->packets, pass->packets + pass->count, [](const DrawPacket *a, const DrawPacket *b) {
+                    return a->vertexArrayObjectID < b->vertexArrayObjectID;
+                });
+                buildBatches(*pass, true);
+            }
+        }
+    };
+    auto finishMainPass = [&queue]() {
+        std::sort(queue.mainPass.packets, queue.mainPass.packets + queue.mainPass.count,
+                  [](const DrawPacket *a, const DrawPacket *b) {
+                      // Grouped by shader object, of which there is one per program
+                      if (a->shader != b->shader) return std::less<Gloom::Shader *>()(a->shader, b->shader);
+                      if (a->vertexArrayObjectID != b->vertexArrayObjectID) return a->vertexArrayObjectID < b->vertexArrayObjectID;
+                      return a->textureArray < b->textureArray;
+                  });
+        buildBatches(queue.mainPass, false);
+    };
+    // The passes only read the packets and write their own arrays, so they can be sorted side by side
+    if (jobs != nullptr) {
+        JobCounter counter;
+        jobs->submit(counter, finishShadowPasses);
+        finishMainPass();
+        jobs->wait(counter);
+    } else {
+        finishShadowPasses();
+        finishMainPass();
+    }
+    unsigned int firstCommand = 0;
+    for (unsigned int cascade = 0; cascade < queue.shadowPassCount; cascade++) {
+        queue.shadowPasses[cascade].firstCommand = firstCommand;
+        firstCommand += queue.shadowPasses[cascade].count;
+        queue.dynamicShadowPasses[cascade].firstCommand = firstCommand;
+        firstCommand += queue.dynamicShadowPasses[cascade].count;
+    }
+    queue.mainPass.firstCommand = firstCommand;
+}
+
+// What a packet contributes to a shadow pass's depth, without padding
+struct ShadowCasterKey {
+    int vertexArrayObjectID;
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    int baseVertex;
+    unsigned int firstInstance;
+    unsigned int instanceCount;
+    unsigned int instanceVersion;  // Instances can be rewritten in place
+    glm::mat4 modelMatrix;
+    glm::vec3 positionScale;
+    glm::vec3 positionOffset;
+};
+
+std::uint64_t shadowPassSignature(const PassPackets &pass)
+{
+    std::uint64_t signature = pass.count;
+    for (unsigned int i = 0; i < pass.count; i++) {
+        const DrawPacket *packet = pass.packets[i];
+        ShadowCasterKey key;
+        key.vertexArrayObjectID = packet->vertexArrayObjectID;
+        key.firstIndex = packet->shadowFirstIndex;
+        key.indexCount = packet->shadowIndexCount;
+        key.baseVertex = packet->baseVertex;
+        key.firstInstance = packet->instanced ? packet->firstInstance : 0;
+        key.instanceCount = packet->instanceCount;
+        key.instanceVersion = packet->instanced ? sharedInstancePool().version() : 0;
+        key.modelMatrix = packet->modelMatrix;
+        key.positionScale = packet->positionScale;
+        key.positionOffset = packet->positionOffset;
+        // Summed, as the order of packets sharing a VAO isn't stable from frame to frame
+        signature += hashBytes(&key, sizeof(key));
+    }
+    return signature;
+}
+
+void RenderStateCache::begin()
+{
+    stats = RenderStats();
+    currentProgram = 0;
+    currentVertexArray = -1;
+    currentTexture = 0;
+}
+
+void RenderStateCache::useProgram(unsigned int program)
+{
+    if (program != currentProgram) {
+        glUseProgram(program);
+        currentProgram = program;
+        stats.programChanges++;
+    }
+}
+
+void RenderStateCache::bindVertexArray(int vertexArrayObjectID)
+{
+    if (vertexArrayObjectID != currentVertexArray) {
+        glBindVertexArray(vertexArrayObjectID);
+        currentVertexArray = vertexArrayObjectID;
+        stats.vertexArrayChanges++;
+    }
+}
+
+void RenderStateCache::bindTextureArray(unsigned int texture)
+{
+    if (texture != currentTexture) {
+        glBindTextureUnit(0, texture);
+        currentTexture = texture;
+        stats.textureChanges++;
+    }
+}
+
+void RenderStateCache::drawElements(unsigned int indexCount, unsigned int indexType)
+{
+    glDrawElements(GL_TRIANGLES, indexCount, indexType, nullptr);
+    stats.drawCalls++;
+    stats.drawCommands++;
+    stats.instances++;
+}
+
+void RenderStateCache::multiDrawIndirect(size_t byteOffset, unsigned int commandCount, unsigned int instanceCount,
+                                         unsigned int indexType)
+{
+    glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, reinterpret_cast<const void*>(byteOffset),
+                                GLsizei(commandCount), 0);
+    stats.drawCalls++;
+    stats.drawCommands += commandCount;
+    stats.instances += instanceCount;
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
+
+#include "shadowProjection.hpp"
+#include "utilities/linearArena.hpp"
+
+struct TransformHierarchy;
+class JobSystem;
+namespace Gloom { class Shader; }
+
+// Bit flags selecting which passes draw a node
+enum RenderPass : unsigned int {
+    SHADOW_PASS = 1 << 0,
+    MAIN_PASS   = 1 << 1,
+    ALL_PASSES  = SHADOW_PASS | MAIN_PASS
+};
+
+// Everything needed to draw one node, copied out of the scene graph so that
+// the passes don't have to touch SceneNodes at all.
+struct DrawPacket {
+    Gloom::Shader *shader;    // Shader used by the main pass
+    int vertexArrayObjectID;
+    unsigned int indexType;   // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, fixed per VAO
+    unsigned int indexCount;  // Of the level of detail drawn by the main pass
+    unsigned int firstIndex;  // Offset of that level within a shared index buffer
+    // The level drawn by the shadow pass, which is often coarser
+    unsigned int shadowIndexCount;
+    unsigned int shadowFirstIndex;
+    int baseVertex;           // Offset of the mesh within a shared vertex buffer
+    bool instanced;              // Drawn from the InstancePool rather than once
+    unsigned int instanceCount;  // 1 unless instanced
+    unsigned int firstInstance;  // Into the InstancePool, if instanced
+    unsigned int material;    // MaterialIndex in the TextureCache, 0 when the node is untextured
+    unsigned int textureArray;  // GL_TEXTURE_2D_ARRAY to bind for the material, 0 if none is needed
+    unsigned int passMask;    // RenderPass bits
+    unsigned int cascadeMask; // Bit c is set if the packet casts shadows into shadow cascade c
+    bool dynamicCaster;       // Drawn in the dynamic rather than the static shadow passes
+    glm::mat4 modelMatrix;
+    glm::mat3 normalMatrix;
+    // Dequantisation of the mesh's positions, see PositionQuantization
+    glm::vec3 positionScale;
+    glm::vec3 positionOffset;
+};
+
+// Layout of one command for glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int baseInstance;  // Index of the packet, read by the shaders as the object index
+};
+
+// A run of consecutive packets in a pass that share all GL state, so they
+// can be drawn with a single multi-draw call
+struct DrawBatch {
+    Gloom::Shader *shader;
+    int vertexArrayObjectID;
+    unsigned int indexType;
+    unsigned int textureArray;
+    unsigned int firstPacket;
+    unsigned int packetCount;
+    unsigned int instanceCount;
+};
+
+// A view of the packets drawn by one pass, in draw order
+struct PassPackets {
+    const DrawPacket **packets = nullptr;
+    unsigned int count = 0;
+
+    DrawBatch *batches = nullptr;
+    unsigned int batchCount = 0;
+
+    // Where this pass's commands start in the frame's indirect command buffer
+    unsigned int firstCommand = 0;
+};
+
+// Packets for the current frame. Everything is allocated from the arena,
+// which is reset at the start of each frame.
+struct RenderQueue {
+    LinearArena arena;
+    DrawPacket *packets = nullptr;
+    unsigned int packetCount = 0;
+    // Sum of the packets' instance counts
+    unsigned int instanceCount = 0;
+
+    // Two shadow passes per shadow cascade: the static casters, whose depth
+    // can be cached, and the dynamic ones drawn over it
+    PassPackets shadowPasses[MAX_SHADOW_CASCADES];
+    PassPackets dynamicShadowPasses[MAX_SHADOW_CASCADES];
+    unsigned int shadowPassCount = 0;
+    PassPackets mainPass;
+};
+
+// How buildRenderQueue() picks the level of detail of meshes that have several.
+// A level is good enough when its error, projected onto the screen from the
+// nearest point of the node's bounds, covers at most maxPixelError pixels.
+struct LodSelection {
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    // Pixels covered by one world unit seen from one unit away:
+    // viewport height / (2 * tan(vertical field of view / 2))
+    float pixelsPerUnit = 0.0f;
+    float maxPixelError = 1.0f;
+    // Shadow casters may be this many times coarser, as shadow map texels are
+    // larger than pixels and the shadows are filtered
+    float shadowErrorScale = 4.0f;
+    // A node only moves to a coarser level once that level's error is this
+    // fraction below the limit, so nodes near a switching distance don't
+    // flicker between two levels
+    float hysteresis = 0.25f;
+};
+
+// Walks the hierarchy once, emits a packet for every geometry or instanced node and sorts
+// the shadow passes by VAO and the main pass by program, VAO and texture array.
+// Nodes without a shader of their own use defaultShader. If a visibility array
+// is given, nodes whose slot in it is zero are left out of that pass. There is
+// a static and a dynamic shadow pass per shadow cascade, each cascade with a
+// visibility array of its own in shadowVisibility if that is given.
+// With a job system, packets are generated and the passes sorted in parallel.
+// Without a LodSelection every mesh is drawn at its finest level. The levels
+// chosen are kept in the SceneNodes for the next frame's hysteresis.
+void buildRenderQueue(RenderQueue &queue, const TransformHierarchy &hierarchy, Gloom::Shader *defaultShader,
+                      const unsigned char *mainVisibility = nullptr,
+                      const unsigned char *const *shadowVisibility = nullptr, unsigned int shadowCascadeCount = 1,
+                      JobSystem *jobs = nullptr, const LodSelection *lodSelection = nullptr);
+
+// Identifies what a shadow pass draws: the mesh, level of detail, transform
+// and instances of each packet, in any order. Passes with the same signature
+// render the same depth, as long as the light's projection is the same.
+std::uint64_t shadowPassSignature(const PassPackets &pass);
+
+// Counters for one pass of one frame
+struct RenderStats {
+    unsigned int drawCalls = 0;        // GL draw calls issued
+    unsigned int drawCommands = 0;     // Meshes drawn, counting each indirect command
+    unsigned int instances = 0;        // Mesh copies drawn, counting each instance
+    unsigned int programChanges = 0;
+    unsigned int vertexArrayChanges = 0;
+    unsigned int textureChanges = 0;
+};
+
+// Wraps the GL binds made while drawing a pass, skipping the redundant ones
+// and counting the rest.
+class RenderStateCache {
+public:
+    void begin();
+    void useProgram(unsigned int program);
+    void bindVertexArray(int vertexArrayObjectID);
+    // Binds a texture array of the TextureCache to texture unit 0
+    void bindTextureArray(unsigned int texture);
+    void drawElements(unsigned int indexCount, unsigned int indexType);
+    // Draws commandCount commands from the bound GL_DRAW_INDIRECT_BUFFER,
+    // starting at byteOffset. instanceCount is the total over those commands,
+    // only used for the stats.
+    void multiDrawIndirect(size_t byteOffset, unsigned int commandCount, unsigned int instanceCount,
+                           unsigned int indexType);
+
+    RenderStats stats;
+
+private:
+    unsigned int currentProgram = 0;
+    int currentVertexArray = -1;
+    unsigned int currentTexture = 0;
+};
@@ -1,23 +1,171 @@
 #include "sceneGraph.hpp"
 #include <iostream>
+#include <new>
+
+SceneNodePool &sceneNodePool()
+{
+	static SceneNodePool pool;
+	return pool;
+}
+
+SceneNode *SceneNodePool::create(TransformHierarchy *hierarchy)
+{
+	unsigned int index;
+	if (!freeSlots.empty())
+	{
+		index = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		index = generations.size();
+		if (index % CHUNK_SIZE == 0)
+		{
+			chunks.emplace_back(new Slot[CHUNK_SIZE]);
+		}
+		generations.push_back(0);
+	}
+	return new (slotNode(index)) SceneNode(hierarchy, index);
+}
+
+void SceneNodePool::free(SceneNode *node)
+{
+	unsigned int index = node->poolIndex;
+	node->~SceneNode();
+	generations[index]++;
+	freeSlots.push_back(index);
+}
+
+SceneNode *SceneNodePool::resolve(SceneNodeHandle handle) const
+{
+	if (handle.index >= generations.size() || generations[handle.index] != handle.generation)
+	{
+		return nullptr;
+	}
+	return slotNode(handle.index);
+}
+
+SceneNodeHandle SceneNodePool::handleOf(const SceneNode *node) const
+{
+	SceneNodeHandle handle;
+	handle.index = node->poolIndex;
+	handle.generation = generations[node->poolIndex];
+	return handle;
+}
 
 SceneNode *createSceneNode()
 {
-	return new SceneNode();
+	return createSceneNode(&defaultTransformHierarchy());
+}
+
+SceneNode *createSceneNode(TransformHierarchy *hierarchy)
+{
+	return sceneNodePool().create(hierarchy);
+}
+
+SceneNodeHandle sceneNodeHandle(const SceneNode *node)
+{
+	return sceneNodePool().handleOf(node);
+}
+
+SceneNode *resolveSceneNode(SceneNodeHandle handle)
+{
+	return sceneNodePool().resolve(handle);
 }
 
-// Add a child node to its parent's list of children
+// Add a child node to the end of its parent's list of children
 void addChild(SceneNode *parent, SceneNode *child)
 {
-	parent->children.push_back(child);
+	detachFromParent(child);
+	child->parent = parent;
+	child->previousSibling = parent->lastChild;
+	if (parent->lastChild != nullptr)
+	{
+		parent->lastChild->nextSibling = child;
+	}
+	else
+	{
+		parent->firstChild = child;
+	}
+	parent->lastChild = child;
+	setTransformParent(*parent->transforms, child->transformIndex, parent->transformIndex);
+}
+
+void detachFromParent(SceneNode *node)
+{
+	SceneNode *parent = node->parent;
+	if (parent == nullptr)
+	{
+		return;
+	}
+	if (node->previousSibling != nullptr)
+	{
+		node->previousSibling->nextSibling = node->nextSibling;
+	}
+	else
+	{
+		parent->firstChild = node->nextSibling;
+	}
+	if (node->nextSibling != nullptr)
+	{
+		node->nextSibling->previousSibling = node->previousSibling;
+	}
+	else
+	{
+		parent->lastChild = node->previousSibling;
+	}
+	node->parent = node->previousSibling = node->nextSibling = nullptr;
+
+	setTransformParent(*node->transforms, node->transformIndex, -1);
+	// The parent's subtree bounds no longer include the node
+	markTransformDirty(*parent->transforms, parent->transformIndex);
+}
+
+void destroySceneSubtree(SceneNode *node, void (*releaseResources)(SceneNode*))
+{
+	detachFromParent(node);
+	// Children are freed before their parents, so walk the subtree post-order
+	SceneNode *current = node;
+	while (current->firstChild != nullptr)
+	{
+		current = current->firstChild;
+	}
+	while (current != nullptr)
+	{
+		SceneNode *next;
+		if (current == node)
+		{
+			next = nullptr;
+		}
+		else if (current->nextSibling != nullptr)
+		{
+			next = current->nextSibling;
+			while (next->firstChild != nullptr)
+			{
+				next = next->firstChild;
+			}
+		}
+		else
+		{
+			next = current->parent;
+		}
+
+		if (releaseResources != nullptr)
+		{
+			releaseResources(current);
+		}
+		releaseTransform(*current->transforms, current->transformIndex);
+		sceneNodePool().free(current);
+		current = next;
+	}
 }
 
 int totalChildren(SceneNode *parent)
 {
-	int count = parent->children.size();
-	for (SceneNode *child : parent->children)
+	int count = 0;
+	for (SceneNode *child = parent->firstChild; child != nullptr; child = child->nextSibling)
 	{
-		count += totalChildren(child);
+		count += 1 + totalChildren(child);
 	}
 	return count;
 }
@@ -25,6 +173,11 @@ int totalChildren(SceneNode *parent)
 // Pretty prints the current values of a SceneNode instance to stdout
 void printNode(SceneNode *node)
 {
+	int childCount = 0;
+	for (SceneNode *child = node->firstChild; child != nullptr; child = child->nextSibling)
+	{
+		childCount++;
+	}
 	printf(
 			"SceneNode {\n"
 			"    Child count: %i\n"
@@ -33,9 +186,9 @@ void printNode(SceneNode *node)
 			"    Reference point: (%f, %f, %f)\n"
 			"    VAO ID: %i\n"
 			"}\n",
-			int(node->children.size()),
-			node->rotation.x, node->rotation.y, node->rotation.z,
-			node->position.x, node->position.y, node->position.z,
-			node->referencePoint.x, node->referencePoint.y, node->referencePoint.z,
+			childCount,
+			node->rotation().x, node->rotation().y, node->rotation().z,
+			node->position().x, node->position().y, node->position().z,
+			node->referencePoint().x, node->referencePoint().y, node->referencePoint().z,
 			node->vertexArrayObjectID);
 }
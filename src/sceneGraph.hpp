@@ -12,58 +12,185 @@
 #include <ctime> 
 #include <chrono>
 #include <fstream>
+#include <memory>
+
+#include "transformHierarchy.hpp"
+#include "renderQueue.hpp"
+#include "utilities/geometryPool.hpp"
+#include "utilities/textureCache.hpp"
+#include "instanceData.hpp"
+
+namespace Gloom { class Shader; }
+
+// GPU resources a node releases when it is destroyed, see destroySceneNode().
+// Resources shared between nodes should be owned by exactly one of them.
+enum SceneNodeResource : unsigned int {
+    OWNS_GEOMETRY = 1 << 0,  // The node's range of the shared GeometryPool
+    OWNS_TEXTURE  = 1 << 1   // A reference to the node's material in the shared TextureCache
+};
 
 enum SceneNodeType {
-    GEOMETRY, POINT_LIGHT, SPOT_LIGHT, SKYBOX
+    GEOMETRY, POINT_LIGHT, SPOT_LIGHT, SKYBOX,
+    // Draws its mesh once per instance, each placed relative to the node; see setNodeInstances()
+    INSTANCED_GEOMETRY
 };
 
 
 struct SceneNode {
-    SceneNode() {
-        position = glm::vec3(0, 0, 0);
-        rotation = glm::vec3(0, 0, 0);
-        scale = glm::vec3(1, 1, 1);
-        referencePoint = glm::vec3(0, 0, 0);
+    SceneNode(TransformHierarchy *hierarchy, unsigned int poolSlot) {
+        parent = firstChild = lastChild = previousSibling = nextSibling = nullptr;
+        poolIndex = poolSlot;
+        ownedResources = 0;
+        transforms = hierarchy;
+        transformIndex = addTransform(*hierarchy, this);
         vertexArrayObjectID = -1;
         VAOIndexCount = 0;
         nodeType = GEOMETRY;
-        textureID = 0;
-        hasTexture = false;
+        material = NO_MATERIAL;
+        shader = nullptr;
+        renderPasses = ALL_PASSES;
+        dynamicShadowCaster = false;
+        mainPassLod = shadowPassLod = 0;
     }
 
-	// A list of all children that belong to this node.
-	// For instance, in case of the scene graph of a human body shown in the assignment text, the "Upper Torso" node would contain the "Left Arm", "Right Arm", "Head" and "Lower Torso" nodes in its list of children.
-	std::vector<SceneNode*> children;
+	// Intrusive links to the node's parent and children. Children are kept in the order they were added.
+	// For instance, in case of the scene graph of a human body shown in the assignment text, the "Upper Torso" node would have the "Left Arm", "Right Arm", "Head" and "Lower Torso" nodes as children.
+	SceneNode *parent;
+	SceneNode *firstChild;
+	SceneNode *lastChild;
+	SceneNode *previousSibling;
+	SceneNode *nextSibling;
+
+	// The node's slot in the SceneNodePool
+	unsigned int poolIndex;
+	// SceneNodeResource bits
+	unsigned int ownedResources;
 	
-	// The node's position and rotation relative to its parent
-	glm::vec3 position;
-	glm::vec3 rotation;
-	glm::vec3 scale;
+	// The node's transform lives in a TransformHierarchy; the node is a handle to its slot there.
+	// transformIndex changes when the hierarchy is reordered, so don't cache it across updates.
+	TransformHierarchy *transforms;
+	unsigned int transformIndex;
 
-	// Color of the light
-	glm::vec3 lightColor;
+	// The node's position, rotation, scale and reference point relative to its parent
+	const glm::vec3 &position() const { return transforms->positions[transformIndex]; }
+	const glm::vec3 &rotation() const { return transforms->rotations[transformIndex]; }
+	const glm::vec3 &scale() const { return transforms->scales[transformIndex]; }
+	const glm::vec3 &referencePoint() const { return transforms->referencePoints[transformIndex]; }
+	// Setting a new value marks the node's subtree for recomputation in the next update
+	void setPosition(const glm::vec3 &value) { setTransformField(transforms->positions, value); }
+	void setRotation(const glm::vec3 &value) { setTransformField(transforms->rotations, value); }
+	void setScale(const glm::vec3 &value) { setTransformField(transforms->scales, value); }
+	void setReferencePoint(const glm::vec3 &value) { setTransformField(transforms->referencePoints, value); }
 
-	// A transformation matrix representing the transformation of the node's location relative to its parent. This matrix is updated every frame.
-	glm::mat4 modelMatrix;
-	glm::mat4 MVP;
+	// Bounds of the node's own geometry in its local space, e.g. Mesh::bounds.
+	// Geometry nodes without bounds are never culled.
+	const AABB &localBounds() const { return transforms->localBounds[transformIndex]; }
+	void setLocalBounds(const AABB &bounds) {
+		transforms->localBounds[transformIndex] = bounds;
+		markTransformDirty(*transforms, transformIndex);
+	}
 
-	// The location of the node's reference point
-	glm::vec3 referencePoint;
+	// The node's transformation in world space, and including the camera. Updated every frame.
+	const glm::mat4 &modelMatrix() const { return transforms->worldMatrices[transformIndex]; }
+	const glm::mat4 &MVP() const { return transforms->MVPs[transformIndex]; }
+	// Inverse transpose of the upper 3x3 of modelMatrix(), for transforming normals
+	const glm::mat3 &normalMatrix() const { return transforms->normalMatrices[transformIndex]; }
+	// World-space bounds of the node's geometry, and of its whole subtree
+	const AABB &worldBounds() const { return transforms->worldBounds[transformIndex]; }
+	const AABB &subtreeBounds() const { return transforms->subtreeBounds[transformIndex]; }
+
+	// Color of the light
+	glm::vec3 lightColor;
 
 	// The ID of the VAO containing the "appearance" of this SceneNode.
 	int vertexArrayObjectID;
 	unsigned int VAOIndexCount;
+	// Where the mesh lives when the VAO is shared, e.g. the GeometryPool's. Zero otherwise,
+	// except that indexType must match the VAO's index buffer.
+	GeometryRange geometry;
+	// Per-instance data of an INSTANCED_GEOMETRY node, in the shared InstancePool
+	InstanceRange instances;
 
-    unsigned int textureID;
-    bool hasTexture;
+    // The node's texture in the shared TextureCache, NO_MATERIAL if untextured
+    MaterialIndex material;
+
+    // Shader used in the main pass; nullptr means the scene's default model shader
+    Gloom::Shader *shader;
+    // RenderPass bits selecting which passes draw this node
+    unsigned int renderPasses;
+    // Set for casters that move or change most frames. Their shadows are drawn
+    // every frame over the cached depth of the static casters, see ShadowCache.
+    bool dynamicShadowCaster;
+    // Levels of detail of geometry last drawn by each pass, see LodSelection
+    unsigned char mainPassLod;
+    unsigned char shadowPassLod;
 
 	// Node type is used to determine how to handle the contents of a node
 	SceneNodeType nodeType;
+
+private:
+	void setTransformField(std::vector<glm::vec3> &field, const glm::vec3 &value) {
+		if (field[transformIndex] != value) {
+			field[transformIndex] = value;
+			markTransformDirty(*transforms, transformIndex);
+		}
+	}
+};
+
+// Refers to a SceneNode without keeping it alive. Resolving a handle to a
+// node that has since been destroyed gives nullptr, even if its slot was reused.
+struct SceneNodeHandle {
+    unsigned int index = ~0u;
+    unsigned int generation = 0;
 };
 
+// Fixed-size chunks of SceneNodes. Freed slots are reused, so memory stays flat
+// when scenes are rebuilt, and nodes never move once created.
+class SceneNodePool {
+public:
+    SceneNode *create(TransformHierarchy *hierarchy);
+    // Frees this one node; the caller must already have detached it and its children
+    void free(SceneNode *node);
+
+    SceneNode *resolve(SceneNodeHandle handle) const;
+    SceneNodeHandle handleOf(const SceneNode *node) const;
+
+    unsigned int liveCount() const { return unsigned(generations.size() - freeSlots.size()); }
+
+private:
+    static const unsigned int CHUNK_SIZE = 256;
+    struct Slot {
+        alignas(SceneNode) unsigned char storage[sizeof(SceneNode)];
+    };
+    SceneNode *slotNode(unsigned int index) const {
+        return reinterpret_cast<SceneNode*>(chunks[index / CHUNK_SIZE][index % CHUNK_SIZE].storage);
+    }
+
+    std::vector<std::unique_ptr<Slot[]>> chunks;
+    // Bumped whenever a slot is freed, which invalidates its handles
+    std::vector<unsigned int> generations;
+    std::vector<unsigned int> freeSlots;
+};
+
+SceneNodePool &sceneNodePool();
+
 SceneNode* createSceneNode();
+SceneNode* createSceneNode(TransformHierarchy *hierarchy);
+// Adds child as the last child of parent, detaching it from any previous parent first
 void addChild(SceneNode* parent, SceneNode* child);
+void detachFromParent(SceneNode* node);
+
+// Detaches node and frees it and all its descendants. releaseResources, if
+// given, is called for every node just before it is freed. The hierarchy slots
+// are compacted by the next updateTransformHierarchy(), so don't walk the
+// hierarchy in between. See also destroySceneNode(), which frees GPU resources too.
+void destroySceneSubtree(SceneNode* node, void (*releaseResources)(SceneNode*) = nullptr);
+
+SceneNodeHandle sceneNodeHandle(const SceneNode* node);
+SceneNode* resolveSceneNode(SceneNodeHandle handle);
+
+
 void printNode(SceneNode* node);
 int totalChildren(SceneNode* parent);
 
-// For more details, see SceneGraph.cpp.
\ No newline at end of file
+// For more details, see SceneGraph.cpp.
\ No newline at end of file
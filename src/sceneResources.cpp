@@ -0,0 +1,24 @@
+#include "sceneResources.hpp"
+#include "sceneGraph.hpp"
+
+void releaseSceneNodeResources(SceneNode *node)
+{
+    if (node->instances.count > 0) {
+        sharedInstancePool().release(node->instances);
+        node->instances = InstanceRange();
+    }
+    if ((node->ownedResources & OWNS_GEOMETRY) && node->geometry.indexCount > 0) {
+        sharedGeometryPool().release(node->geometry);
+        node->geometry = GeometryRange();
+    }
+    if ((node->ownedResources & OWNS_TEXTURE) && node->material != NO_MATERIAL) {
+        sharedTextureCache().release(node->material);
+        node->material = NO_MATERIAL;
+    }
+    node->ownedResources = 0;
+}
+
+void destroySceneNode(SceneNode *node)
+{
+    destroySceneSubtree(node, releaseSceneNodeResources);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+struct SceneNode;
+
+// Releases the GPU resources held by one node: its instances, plus whatever
+// its ownedResources bits say it owns. Leaves the node itself alone.
+void releaseSceneNodeResources(SceneNode *node);
+
+// Destroys node and its whole subtree, releasing their GPU resources as well
+// as their pool and hierarchy slots. Use this to tear scenes down at runtime.
+void destroySceneNode(SceneNode *node);
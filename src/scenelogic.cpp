@@ -5,17 +5,28 @@
 #include <fmt/format.h>
 #include "scenelogic.h"
 #include "sceneGraph.hpp"
+#include "frameData.hpp"
+#include "instanceData.hpp"
+#include "culling.hpp"
+#include "shadowProjection.hpp"
+#include "shadowCache.hpp"
 #include "utilities/timeutils.h"
+#include "utilities/persistentBuffer.hpp"
 #include "utilities/shader.hpp"
-#include "utilities/modelLoader.hpp"
-#include "utilities/textureLoader.hpp"
 #include "utilities/shapes.h"
-#include "utilities/glutils.h"
+#include "utilities/geometryPool.hpp"
+#include "utilities/jobSystem.hpp"
+#include "utilities/assetStreamer.hpp"
+#include "utilities/textureCache.hpp"
+#include "utilities/textureLoader.hpp"
+#include "utilities/gpuTimer.hpp"
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 // New: Include the skybox header.
 #include "skybox.hpp"
+#include "atmosphere.hpp"
+#include "skyProbe.hpp"
 
 // Global scene pointers
 SceneNode *rootNode = nullptr;
@@ -34,17 +45,104 @@ const float cameraRadius = 200.0f;
 glm::vec3 sunDir;
 glm::vec3 moonDir;
 
-// Shadow mapping globals
-const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
+// Shadow mapping globals. The cascades are the layers of one depth texture
+// array, rendered one after another through the same framebuffer.
+static unsigned int shadowMapSize = 2048;
+static unsigned int shadowCascadeCount = 3;
 static unsigned int shadowFBO = 0;
 static unsigned int shadowMap = 0;
+static ShadowCascades shadowCascades;
+// Depth of the static casters alone, copied into the shadow map under the
+// dynamic ones. Only there when the shadow cache is enabled.
+static unsigned int staticShadowMap = 0;
+static ShadowCache shadowCache;
+static CascadeUpdate cascadeUpdates[MAX_SHADOW_CASCADES];
+// Cascades whose shadow map layer was drawn to this frame
+static bool shadowLayerChanged[MAX_SHADOW_CASCADES];
+
+// With SHADOW_QUALITY_EVSM: blurred moments of each cascade, refreshed from
+// the shadow map when its layer changes, and the blur's intermediate image
+static unsigned int shadowMoments = 0;
+static unsigned int shadowMomentsScratch = 0;
+// Reads the shadow map as plain depth, overriding its compare mode
+static unsigned int shadowDepthSampler = 0;
+static Gloom::Shader *evsmBlurShader = nullptr;
+static Gloom::Uniform<int> evsmCascadeUniform, evsmHorizontalUniform;
+// Texture unit the blur reads depth from
+static const int EVSM_DEPTH_UNIT = 3;
+// Exponents of the depth warp, defined for evsmBlur.comp and model.frag.
+// Larger ones give sharper contact shadows but need 32-bit floats, as e^80
+// is the largest moment stored.
+static const float EVSM_POSITIVE_EXPONENT = 40.0f;
+static const float EVSM_NEGATIVE_EXPONENT = 5.0f;
+// Fraction of each cascade's depth range faded into the next
+static const float CASCADE_BLEND_FRACTION = 0.1f;
 
 // Shaders
 static Gloom::Shader *modelShader = nullptr;
 static Gloom::Shader *shadowShader = nullptr;
+static Gloom::Uniform<int> shadowCascadeUniform;
+
+// Uniform handles, resolved once after linking.
+// Camera, light and per-object data come from the buffers below instead.
+struct ModelUniforms {
+    Gloom::Uniform<float> shininess;
+    Gloom::Uniform<int> diffuseTextures, shadowMap, shadowMoments, skyViewLut, skySpecular;
+};
+static ModelUniforms modelUniforms;
+
+static ModelUniforms resolveModelUniforms(Gloom::Shader &shader) {
+    ModelUniforms uniforms;
+    uniforms.shininess = shader.uniform<float>("shininess");
+    // Only there without bindless textures
+    uniforms.diffuseTextures = shader.uniform<int>("diffuseTextures");
+    // Only one of the two is there, depending on the shadow quality
+    uniforms.shadowMap = shader.uniform<int>("shadowMap");
+    uniforms.shadowMoments = shader.uniform<int>("shadowMoments");
+    uniforms.skyViewLut = shader.uniform<int>("skyViewLut");
+    uniforms.skySpecular = shader.uniform<int>("skySpecular");
+    return uniforms;
+}
+
+// Per-frame constants (UBO), per-object matrices (SSBO) and the indirect draw
+// commands of both passes, all written through persistently mapped ring
+// buffers. Filled in updateFrame().
+static FrameConstants frameConstants;
+static PersistentRingBuffer frameConstantsBuffer;
+static PersistentRingBuffer objectDataBuffer;
+static PersistentRingBuffer drawCommandBuffer;
 
 // Skybox pointer (procedural, animated)
 static Gloom::Skybox* skybox = nullptr;
+// Scattering lookup tables for the sky and the haze over the scene
+static Atmosphere atmosphere;
+// The sky as seen by the scene, for its ambient light and reflections
+static SkyProbe skyProbe;
+
+// Draw packets for the current frame, shared by the shadow and main passes
+static RenderQueue renderQueue;
+static RenderStateCache renderState;
+static RenderStats shadowStats;  // Of all cascades together
+static RenderStats mainStats;
+// GPU time of each cascade's shadow pass
+static GpuTimer shadowPassTimer;
+// Camera and light frustum culling of the scene hierarchy, redone every frame
+static CullResult cameraCulling;
+static CullResult shadowCasterCulling[MAX_SHADOW_CASCADES];
+static double lastStatsPrintTime = 0.0;
+
+// The sundial streams in after the first frames. Until its mesh and texture are
+// resident it is drawn with the placeholders, which belong to the scene.
+static SceneNode *sundialNode = nullptr;
+static SceneNode *sundialCopiesNode = nullptr;
+static std::shared_ptr<StreamedMesh> sundialMeshStream;
+static std::shared_ptr<StreamedTexture> sundialTextureStream;
+static GeometryRange placeholderGeometry;
+static AABB placeholderBounds;
+static MaterialIndex placeholderMaterial = NO_MATERIAL;
+// Render thread time per frame spent copying streamed assets to the GPU
+static const double ASSET_UPLOAD_BUDGET_MS = 2.0;
+static const unsigned int ASSET_DECODE_THREADS = 2;
 
 CommandLineOptions options;
 
@@ -76,74 +174,264 @@ static void mouseCallback(GLFWwindow* window, double x, double y) {
     lastMouseY = winHeight/2;
 }
 
-// --- Shadow Map Initialization ---
-static void initShadowMap() {
-    glGenTextures(1, &shadowMap);
-    glBindTexture(GL_TEXTURE_2D, shadowMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-                 SHADOW_WIDTH, SHADOW_HEIGHT, 0,
-                 GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+// Lookups through a sampler2DArrayShadow compare against the reference depth,
+// and with linear filtering the GPU blends the results of the four nearest
+// texels, which is 2x2 PCF for the price of one tap.
+static unsigned int createShadowMapArray() {
+    unsigned int texture;
+    glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture);
+    glTextureStorage3D(texture, 1, GL_DEPTH_COMPONENT24, shadowMapSize, shadowMapSize, shadowCascadeCount);
+    glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTextureParameteri(texture, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
     float borderColor[] = {1.0f,1.0f,1.0f,1.0f};
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+    glTextureParameterfv(texture, GL_TEXTURE_BORDER_COLOR, borderColor);
+    return texture;
+}
 
-    glGenFramebuffers(1, &shadowFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowMap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+// Moments are kept as 32-bit floats, as the positive exponent's square needs the range
+static unsigned int createMomentsArray(unsigned int layers) {
+    unsigned int texture;
+    glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture);
+    glTextureStorage3D(texture, 1, GL_RGBA32F, shadowMapSize, shadowMapSize, layers);
+    glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    // The moments of the far plane, so that outside the map is lit as with the depth map.
+    // See warpDepth() in evsmBlur.comp.
+    float positive = std::exp(EVSM_POSITIVE_EXPONENT), negative = -std::exp(-EVSM_NEGATIVE_EXPONENT);
+    float borderColor[] = {positive, positive * positive, negative, negative * negative};
+    glTextureParameterfv(texture, GL_TEXTURE_BORDER_COLOR, borderColor);
+    return texture;
+}
+
+static void initShadowMoments() {
+    shadowMoments = createMomentsArray(shadowCascadeCount);
+    shadowMomentsScratch = createMomentsArray(1);
+    glCreateSamplers(1, &shadowDepthSampler);
+    glSamplerParameteri(shadowDepthSampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glSamplerParameteri(shadowDepthSampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glSamplerParameteri(shadowDepthSampler, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+    evsmBlurShader = new Gloom::Shader();
+    evsmBlurShader->define("EVSM_POSITIVE_EXPONENT", EVSM_POSITIVE_EXPONENT);
+    evsmBlurShader->define("EVSM_NEGATIVE_EXPONENT", EVSM_NEGATIVE_EXPONENT);
+    evsmBlurShader->attach("../res/shaders/evsmBlur.comp");
+    evsmBlurShader->link();
+    evsmCascadeUniform = evsmBlurShader->uniform<int>("cascade");
+    evsmHorizontalUniform = evsmBlurShader->uniform<int>("horizontal");
+    evsmBlurShader->uniform<int>("depthMap").set(EVSM_DEPTH_UNIT);
+}
+
+// --- Shadow Map Initialization ---
+// One layer per cascade, each shadowMapSize texels square.
+static void initShadowMap() {
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    shadowMapSize = glm::clamp(unsigned(options.shadowMapSize), 64u, unsigned(maxSize));
+    shadowCascadeCount = glm::clamp(unsigned(options.shadowCascades), 1u, MAX_SHADOW_CASCADES);
+
+    shadowMap = createShadowMapArray();
+    shadowCache.init(options.shadowCacheAngle);
+    if(shadowCache.enabled())
+        staticShadowMap = createShadowMapArray();
+
+    // The layer attached is switched per cascade in renderShadowPasses()
+    glCreateFramebuffers(1, &shadowFBO);
+    glNamedFramebufferTextureLayer(shadowFBO, GL_DEPTH_ATTACHMENT, shadowMap, 0, 0);
+    glNamedFramebufferDrawBuffer(shadowFBO, GL_NONE);
+    glNamedFramebufferReadBuffer(shadowFBO, GL_NONE);
+    if(glCheckNamedFramebufferStatus(shadowFBO, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         std::cerr << "Shadow framebuffer not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if(options.shadowQuality == SHADOW_QUALITY_EVSM)
+        initShadowMoments();
+
+    // One region per cascade, and one for the EVSM blur of all cascades
+    shadowPassTimer.init(shadowCascadeCount + 1);
+    static const char *qualityNames[] = {"1-tap PCF", "rotated Poisson PCF", "EVSM"};
+    std::cout << fmt::format("Shadows: {} cascades of {}x{} texels with {}, {}.", shadowCascadeCount, shadowMapSize,
+                             shadowMapSize, qualityNames[options.shadowQuality], shadowCache.enabled()
+                                 ? fmt::format("static casters cached until the sun moves {} degrees",
+                                               options.shadowCacheAngle)
+                                 : std::string("redrawn every frame")) << std::endl;
 }
 
-// --- updateNodeTransformations ---
-void updateNodeTransformations(SceneNode *node, glm::mat4 parentModel, glm::mat4 parentVP) {
-    glm::mat4 transformationMatrix =
-        glm::translate(glm::mat4(1.0f), node->position) *
-        glm::translate(glm::mat4(1.0f), node->referencePoint) *
-        glm::rotate(glm::mat4(1.0f), node->rotation.y, glm::vec3(0,1,0)) *
-        glm::rotate(glm::mat4(1.0f), node->rotation.x, glm::vec3(1,0,0)) *
-        glm::rotate(glm::mat4(1.0f), node->rotation.z, glm::vec3(0,0,1)) *
-        glm::scale(glm::mat4(1.0f), node->scale) *
-        glm::translate(glm::mat4(1.0f), -node->referencePoint);
-    node->modelMatrix = parentModel * transformationMatrix;
-    node->MVP = parentVP * transformationMatrix;
-    // Process light nodes if needed.
-    switch(node->nodeType) {
-        case GEOMETRY: break;
-        case POINT_LIGHT:
-            if(lightIndex < numLights) {
-                glm::vec4 pos = node->modelMatrix * glm::vec4(0,0,0,1);
-                lightSources[lightIndex].position = glm::vec3(pos);
-                lightSources[lightIndex++].color = node->lightColor;
-            }
-            break;
-        case SPOT_LIGHT: break;
-        default:
-            break;
+// --- collectLightSources ---
+// Reads light positions from the world matrices computed by updateTransformHierarchy().
+static void collectLightSources(const TransformHierarchy &hierarchy) {
+    lightIndex = 0;
+    for(unsigned int i = 0; i < hierarchy.nodes.size(); i++) {
+        SceneNode *node = hierarchy.nodes[i];
+        switch(node->nodeType) {
+            case GEOMETRY: break;
+            case POINT_LIGHT:
+                if(lightIndex < numLights) {
+                    glm::vec4 pos = hierarchy.worldMatrices[i] * glm::vec4(0,0,0,1);
+                    lightSources[lightIndex].position = glm::vec3(pos);
+                    lightSources[lightIndex++].color = node->lightColor;
+                }
+                break;
+            case SPOT_LIGHT: break;
+            default:
+                break;
+        }
+    }
+}
+
+// --- addSundialCopies ---
+// Scatters copies of the sundial over a disc around the main one, each tilted
+// and tinted according to the latitude its row stands for. They are drawn as
+// instances of a single node, so the count barely affects the CPU side.
+static void addSundialCopies(const SceneNode *sundialNode, const AABB &sundialBounds, int count) {
+    glm::vec3 size = sundialBounds.max - sundialBounds.min;
+    float extent = glm::max(size.x, glm::max(size.y, size.z));
+
+    // Sunflower spiral: even spacing without a visible grid
+    const float innerRadius = 30.0f;
+    const float outerRadius = 145.0f;
+    float area = glm::pi<float>() * (outerRadius * outerRadius - innerRadius * innerRadius);
+    float spacing = std::sqrt(area / float(count));
+    float copyScale = 0.7f * spacing / glm::max(extent, 1e-6f);
+    const float goldenAngle = glm::pi<float>() * (3.0f - std::sqrt(5.0f));
+
+    std::vector<glm::mat4> transforms(count);
+    std::vector<glm::vec4> tints(count);
+    for(int i = 0; i < count; i++) {
+        float t = (float(i) + 0.5f) / float(count);
+        float radius = std::sqrt(innerRadius * innerRadius + t * (outerRadius * outerRadius - innerRadius * innerRadius));
+        float theta = float(i) * goldenAngle;
+        glm::vec3 position(radius * std::cos(theta), 0.0f, radius * std::sin(theta));
+        // North is -z; latitude runs from -60 to 60 degrees across the disc
+        float latitude = glm::radians(-60.0f) * position.z / outerRadius;
+        glm::mat4 transform = glm::translate(glm::mat4(1.0f), position);
+        transform = glm::rotate(transform, latitude, glm::vec3(1, 0, 0));
+        transform = glm::rotate(transform, glm::radians(-90.0f), glm::vec3(1, 0, 0));
+        transforms[i] = glm::scale(transform, glm::vec3(copyScale));
+        float north = glm::clamp(0.5f + latitude / glm::radians(120.0f), 0.0f, 1.0f);
+        tints[i] = glm::vec4(glm::mix(glm::vec3(1.0f, 0.85f, 0.7f), glm::vec3(0.7f, 0.85f, 1.0f), north), 1.0f);
+    }
+
+    sundialCopiesNode = createSceneNode();
+    // Shares the mesh and texture owned by the sundial node
+    sundialCopiesNode->nodeType = INSTANCED_GEOMETRY;
+    sundialCopiesNode->vertexArrayObjectID = sundialNode->vertexArrayObjectID;
+    sundialCopiesNode->VAOIndexCount = sundialNode->VAOIndexCount;
+    sundialCopiesNode->geometry = sundialNode->geometry;
+    sundialCopiesNode->material = sundialNode->material;
+    setNodeInstances(sundialCopiesNode, sundialBounds, transforms, tints);
+    addChild(rootNode, sundialCopiesNode);
+}
+
+// --- Placeholders ---
+// A flat plinth where the sundial will stand, and a plain grey texture
+static void createPlaceholders(GeometryPool &geometryPool) {
+    Mesh plinth = cube(glm::vec3(60.0f, 60.0f, 8.0f));
+    placeholderGeometry = geometryPool.upload(plinth);
+    placeholderBounds = plinth.bounds;
+    DecodedTexture grey;
+    grey.width = grey.height = 1;
+    grey.channels = 4;
+    grey.mipCount = 1;
+    grey.srgb = true;
+    grey.pixels = std::shared_ptr<unsigned char>(new unsigned char[4]{160, 160, 160, 255},
+                                                 std::default_delete<unsigned char[]>());
+    placeholderMaterial = sharedTextureCache().add(grey);
+}
+
+// --- applyStreamedAssets ---
+// Swaps the sundial's placeholders for the streamed mesh and texture once they
+// are resident. The texture is only named by the mesh's material, so it is
+// requested as soon as the mesh has been decoded.
+static void applyStreamedAssets() {
+    if(sundialMeshStream) {
+        AssetState state = sundialMeshStream->state();
+        if(state != ASSET_DECODING && state != ASSET_FAILED && !sundialTextureStream
+           && !sundialMeshStream->diffuseTexName.empty())
+            sundialTextureStream = sharedAssetStreamer().requestTexture("../res/models/" + sundialMeshStream->diffuseTexName);
+        if(state == ASSET_RESIDENT) {
+            sundialNode->geometry = sundialMeshStream->geometry;
+            sundialNode->ownedResources |= OWNS_GEOMETRY;
+            sundialNode->vertexArrayObjectID = sharedGeometryPool().vertexArray(sundialNode->geometry);
+            sundialNode->VAOIndexCount = sundialNode->geometry.lods[0].indexCount;
+            sundialNode->setLocalBounds(sundialMeshStream->bounds);
+            if(sundialMeshStream->diffuseTexName.empty())
+                sundialNode->material = NO_MATERIAL;
+            if(options.sundialCopies > 0)
+                addSundialCopies(sundialNode, sundialMeshStream->bounds, options.sundialCopies);
+            sundialMeshStream.reset();
+        } else if(state == ASSET_FAILED) {
+            sundialMeshStream.reset();
+        }
+    }
+    if(sundialTextureStream && sundialTextureStream->resident()) {
+        sundialNode->material = sundialTextureStream->material;
+        sundialNode->ownedResources |= OWNS_TEXTURE;
+        if(sundialCopiesNode)
+            sundialCopiesNode->material = sundialNode->material;
+        sundialTextureStream.reset();
+    } else if(sundialTextureStream && sundialTextureStream->state() == ASSET_FAILED) {
+        sundialTextureStream.reset();
     }
-    for(auto child : node->children)
-        updateNodeTransformations(child, node->modelMatrix, node->MVP);
 }
 
 // --- initScene ---
 void initScene(GLFWwindow *window, CommandLineOptions sceneOptions) {
     options = sceneOptions;
+    initJobSystem(options.threadCount);
+    setTextureAnisotropy(float(options.anisotropy));
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
     glfwSetCursorPosCallback(window, mouseCallback);
 
+    // Textures are shared, and read by material index from arrays or through bindless handles
+    TextureCache &textureCache = sharedTextureCache();
+    textureCache.init();
+
     // Load the new model shader.
     modelShader = new Gloom::Shader();
+    if(textureCache.bindless())
+        modelShader->define("BINDLESS_TEXTURES");
+    switch(options.shadowQuality) {
+        case SHADOW_QUALITY_PCF: modelShader->define("SHADOW_PCF"); break;
+        case SHADOW_QUALITY_POISSON:
+            modelShader->define("SHADOW_POISSON");
+            modelShader->define("SHADOW_TAPS", options.shadowTaps);
+            break;
+        case SHADOW_QUALITY_EVSM:
+            modelShader->define("SHADOW_EVSM");
+            modelShader->define("EVSM_POSITIVE_EXPONENT", EVSM_POSITIVE_EXPONENT);
+            modelShader->define("EVSM_NEGATIVE_EXPONENT", EVSM_NEGATIVE_EXPONENT);
+            break;
+    }
     modelShader->makeBasicShader("../res/shaders/model.vert", "../res/shaders/model.frag");
     modelShader->activate();
+    modelUniforms = resolveModelUniforms(*modelShader);
+    // Texture units never change, so the samplers only need to be set once.
+    modelUniforms.diffuseTextures.set(0);
+    modelUniforms.shadowMap.set(1);
+    modelUniforms.shadowMoments.set(2);
+    modelUniforms.skyViewLut.set(int(SKY_VIEW_LUT_UNIT));
+    modelUniforms.skySpecular.set(int(SKY_SPECULAR_UNIT));
 
     // Load the new shadow shader.
     shadowShader = new Gloom::Shader();
     shadowShader->makeBasicShader("../res/shaders/shadow.vert", "../res/shaders/shadow.frag");
+    shadowCascadeUniform = shadowShader->uniform<int>("cascade");
+
+    frameConstantsBuffer.init(GL_UNIFORM_BUFFER, sizeof(FrameConstants));
+    objectDataBuffer.init(GL_SHADER_STORAGE_BUFFER, 64 * sizeof(ObjectData));
+    drawCommandBuffer.init(GL_DRAW_INDIRECT_BUFFER, 128 * sizeof(DrawElementsIndirectCommand));
+
+    // All scene meshes share one vertex buffer, and one index buffer and VAO per index size.
+    GeometryPool &geometryPool = sharedGeometryPool();
+    geometryPool.init();
+    sharedInstancePool().init();
+    // Assets are decoded on threads of their own and uploaded a slice per frame
+    sharedAssetStreamer().init(geometryPool, textureCache, ASSET_DECODE_THREADS);
+    createPlaceholders(geometryPool);
 
     initShadowMap();
 
@@ -153,62 +441,133 @@ void initScene(GLFWwindow *window, CommandLineOptions sceneOptions) {
     // Create directional light node (sun used for lighting/shadowing).
     lightNode = createSceneNode();
     lightNode->nodeType = POINT_LIGHT;
-    lightNode->position = glm::vec3(0.0f, 100.0f, 50.0f); // Will be updated in updateFrame().
+    lightNode->setPosition(glm::vec3(0.0f, 100.0f, 50.0f)); // Will be updated in updateFrame().
     lightNode->lightColor = glm::vec3(1.0f);
-    rootNode->children.push_back(lightNode);
+    addChild(rootNode, lightNode);
 
     // (Do not add any visible sun geometry.)
 
-    // Load the sundial model as before.
-    std::string diffuseTexName;
-    Mesh sundialMesh = loadOBJModel("../res/models/sundial.obj", "../res/models/", diffuseTexName);
-    unsigned int sundialVAO = generateBuffer(sundialMesh);
-    SceneNode *sundialNode = createSceneNode();
-    sundialNode->vertexArrayObjectID = sundialVAO;
-    sundialNode->VAOIndexCount = sundialMesh.indices.size();
-    sundialNode->position = glm::vec3(0.0f);
-    sundialNode->scale = glm::vec3(0.5f);
-    sundialNode->rotation.x = glm::radians(-90.0f);
-    if(!diffuseTexName.empty()){
-        std::string texturePath = "../res/models/" + diffuseTexName;
-        unsigned int tex = loadTexture(texturePath);
-        sundialNode->textureID = tex;
-        sundialNode->hasTexture = true;
-    }
-    rootNode->children.push_back(sundialNode);
-
-    // Initialize procedural skybox.
+    // Stream the sundial model in. Cooked files from glowbox_cook are used when up to date.
+    sundialMeshStream = sharedAssetStreamer().requestMesh("../res/models/sundial.obj", "../res/models/");
+    sundialNode = createSceneNode();
+    sundialNode->geometry = placeholderGeometry;
+    sundialNode->vertexArrayObjectID = geometryPool.vertexArray(placeholderGeometry);
+    sundialNode->VAOIndexCount = placeholderGeometry.lods[0].indexCount;
+    sundialNode->setLocalBounds(placeholderBounds);
+    sundialNode->material = placeholderMaterial;
+    sundialNode->setPosition(glm::vec3(0.0f));
+    sundialNode->setScale(glm::vec3(0.5f));
+    sundialNode->setRotation(glm::vec3(glm::radians(-90.0f), 0.0f, 0.0f));
+    addChild(rootNode, sundialNode);
+
+    // Initialize procedural skybox, drawn from the atmosphere's lookup tables.
+    atmosphere.init();
     {
         skybox = new Gloom::Skybox();
         skybox->init("../res/shaders/skybox.vert", "../res/shaders/skybox.frag");
     }
+    skyProbe.init();
 
     totalElapsedTime = sceneElapsedTime = getTimeDeltaSeconds();
-    std::cout << fmt::format("Initialized scene with {} SceneNodes.", totalChildren(rootNode)) << std::endl;
+    std::cout << fmt::format("Initialized scene with {} SceneNodes, updated on {} threads.",
+                             totalChildren(rootNode), jobSystem().threadCount()) << std::endl;
+}
+
+// --- renderShadowPass ---
+// Issues one multi-draw per batch of packets sharing a VAO. With every mesh in
+// the geometry pool, that is one call per index size for the whole pass.
+static void drawPassBatches(const PassPackets &pass, bool bindMaterials) {
+    size_t commandBase = drawCommandBuffer.currentOffset()
+                       + pass.firstCommand * sizeof(DrawElementsIndirectCommand);
+    for(unsigned int i = 0; i < pass.batchCount; i++) {
+        const DrawBatch &batch = pass.batches[i];
+        if(bindMaterials) {
+            renderState.useProgram(batch.shader->get());
+            // Nothing to bind with bindless textures, and one bind per texture array otherwise
+            if(batch.textureArray != 0)
+                renderState.bindTextureArray(batch.textureArray);
+        }
+        renderState.bindVertexArray(batch.vertexArrayObjectID);
+        renderState.multiDrawIndirect(commandBase + batch.firstPacket * sizeof(DrawElementsIndirectCommand),
+                                      batch.packetCount, batch.instanceCount, batch.indexType);
+    }
+}
+
+// Points the shadow framebuffer at one layer of a shadow map array
+static void attachShadowLayer(unsigned int texture, unsigned int cascade) {
+    glNamedFramebufferTextureLayer(shadowFBO, GL_DEPTH_ATTACHMENT, texture, 0, GLint(cascade));
+}
+
+// Renders each cascade into its layer of the shadow map, timing each on the GPU.
+// With the cache, the static casters are only drawn when their cached depth
+// is stale, and the dynamic ones over a copy of it.
+static void renderShadowPasses() {
+    renderState.begin();
+    for(unsigned int cascade = 0; cascade < renderQueue.shadowPassCount; cascade++) {
+        const PassPackets &dynamicPass = renderQueue.dynamicShadowPasses[cascade];
+        const CascadeUpdate &update = cascadeUpdates[cascade];
+        shadowLayerChanged[cascade] = !shadowCache.enabled() || update.copyStatic || dynamicPass.count > 0;
+        shadowPassTimer.begin(cascade);
+        shadowCascadeUniform.set(int(cascade));
+        if(!shadowCache.enabled()) {
+            attachShadowLayer(shadowMap, cascade);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            drawPassBatches(renderQueue.shadowPasses[cascade], false);
+        } else {
+            if(update.redrawStatic) {
+                attachShadowLayer(staticShadowMap, cascade);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                drawPassBatches(renderQueue.shadowPasses[cascade], false);
+            }
+            if(update.copyStatic)
+                glCopyImageSubData(staticShadowMap, GL_TEXTURE_2D_ARRAY, 0, 0, 0, GLint(cascade),
+                                   shadowMap, GL_TEXTURE_2D_ARRAY, 0, 0, 0, GLint(cascade),
+                                   shadowMapSize, shadowMapSize, 1);
+            if(dynamicPass.count > 0)
+                attachShadowLayer(shadowMap, cascade);
+        }
+        drawPassBatches(dynamicPass, false);
+        shadowPassTimer.end();
+    }
+    shadowStats = renderState.stats;
 }
 
-// --- renderShadowScene ---
-static void renderShadowScene(SceneNode *node, glm::mat4 parentModel) {
-    // Skip non-model geometry if needed.
-    glm::mat4 model = parentModel *
-        glm::translate(glm::mat4(1.0f), node->position) *
-        glm::translate(glm::mat4(1.0f), node->referencePoint) *
-        glm::rotate(glm::mat4(1.0f), node->rotation.y, glm::vec3(0,1,0)) *
-        glm::rotate(glm::mat4(1.0f), node->rotation.x, glm::vec3(1,0,0)) *
-        glm::rotate(glm::mat4(1.0f), node->rotation.z, glm::vec3(0,0,1)) *
-        glm::scale(glm::mat4(1.0f), node->scale) *
-        glm::translate(glm::mat4(1.0f), -node->referencePoint);
-    glUniformMatrix4fv(glGetUniformLocation(shadowShader->get(), "modelMatrix"), 1, GL_FALSE, glm::value_ptr(model));
-    if(node->nodeType == GEOMETRY && node->vertexArrayObjectID != -1) {
-        glBindVertexArray(node->vertexArrayObjectID);
-        glDrawElements(GL_TRIANGLES, node->VAOIndexCount, GL_UNSIGNED_INT, nullptr);
+// Refreshes the EVSM moments of the cascades whose depth changed, with a
+// horizontal and a vertical blur pass each
+static void blurShadowMoments() {
+    if(options.shadowQuality != SHADOW_QUALITY_EVSM)
+        return;
+    shadowPassTimer.begin(shadowCascadeCount);
+    evsmBlurShader->activate();
+    glBindTextureUnit(EVSM_DEPTH_UNIT, shadowMap);
+    glBindSampler(EVSM_DEPTH_UNIT, shadowDepthSampler);
+    GLuint groups = (shadowMapSize + 7) / 8;
+    for(unsigned int cascade = 0; cascade < shadowCascadeCount; cascade++) {
+        if(!shadowLayerChanged[cascade])
+            continue;
+        evsmCascadeUniform.set(int(cascade));
+        evsmHorizontalUniform.set(1);
+        glBindImageTexture(1, shadowMomentsScratch, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        glDispatchCompute(groups, groups, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        evsmHorizontalUniform.set(0);
+        glBindImageTexture(0, shadowMomentsScratch, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA32F);
+        glBindImageTexture(1, shadowMoments, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        glDispatchCompute(groups, groups, 1);
+        // The scratch image is written again by the next cascade's first pass
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
     }
-    for(auto child : node->children)
-        renderShadowScene(child, model);
+    glBindSampler(EVSM_DEPTH_UNIT, 0);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    shadowPassTimer.end();
 }
 
 // --- updateFrame ---
 void updateFrame(GLFWwindow *window) {
+    // Upload what the decode threads have finished, within the frame's budget
+    sharedAssetStreamer().update(ASSET_UPLOAD_BUDGET_MS);
+    applyStreamedAssets();
+
     double timeDelta = getTimeDeltaSeconds();
     totalElapsedTime += timeDelta;
     sceneElapsedTime += timeDelta;
@@ -220,7 +579,7 @@ void updateFrame(GLFWwindow *window) {
     float orbitRadius = 150.0f;
     float zOffset = 50.0f;
     glm::vec3 sunPos(orbitRadius * cos(angle), orbitRadius * sin(angle), zOffset);
-    lightNode->position = sunPos;
+    lightNode->setPosition(sunPos);
 
     // Compute sun direction (pointing from the sun toward the origin).
     sunDir = glm::normalize(sunPos);
@@ -230,16 +589,15 @@ void updateFrame(GLFWwindow *window) {
     // Compute dayFactor from the sun’s elevation (dot with world-up).
     float dayFactor = glm::clamp(glm::dot(sunDir, glm::vec3(0,1,0)), 0.0f, 1.0f);
 
-
-    // Update model shader lighting uniforms.
-    modelShader->activate();
-    glUniform3fv(glGetUniformLocation(modelShader->get(), "sunDir"), 1, glm::value_ptr(sunDir));
+    // Lighting constants.
+    frameConstants.sunDir = glm::vec4(sunDir, 0.0f);
     // Set sunColor (you can adjust intensity as needed).
-    glUniform3f(glGetUniformLocation(modelShader->get(), "sunColor"), 1.0f, 0.95f, 0.9f);
-    glUniform3fv(glGetUniformLocation(modelShader->get(), "moonDir"), 1, glm::value_ptr(moonDir));
-    glUniform3f(glGetUniformLocation(modelShader->get(), "moonColor"), 0.6f, 0.65f, 0.8f);
-    // Base ambient light.
-    glUniform3f(glGetUniformLocation(modelShader->get(), "baseAmbient"), 0.2f, 0.2f, 0.25f);
+    frameConstants.sunColor = glm::vec4(1.0f, 0.95f, 0.9f, 1.0f);
+    frameConstants.moonDir = glm::vec4(moonDir, 0.0f);
+    frameConstants.moonColor = glm::vec4(0.6f, 0.65f, 0.8f, 1.0f);
+    // Faint ambient light for what the sky probe leaves out, which is all there is on a moonless night.
+    frameConstants.baseAmbient = glm::vec4(0.03f, 0.03f, 0.04f, 1.0f);
+    frameConstants.dayFactor = glm::vec4(dayFactor, 0.0f, 0.0f, 0.0f);
 
     // Update camera.
     int winWidth, winHeight;
@@ -250,79 +608,194 @@ void updateFrame(GLFWwindow *window) {
     cameraPos.y = center.y + cameraRadius * sin(glm::radians(cameraPitch));
     cameraPos.z = center.z + cameraRadius * cos(glm::radians(cameraPitch)) * cos(glm::radians(cameraYaw));
     glm::mat4 view = glm::lookAt(cameraPos, center, glm::vec3(0, 1, 0));
-    glm::mat4 projection = glm::perspective(glm::radians(80.0f), float(winWidth)/float(winHeight), 0.1f, 350.f);
+    float fieldOfView = glm::radians(80.0f);
+    float aspectRatio = float(winWidth)/float(winHeight);
+    float nearPlane = 0.1f, farPlane = 350.0f;
+    glm::mat4 projection = glm::perspective(fieldOfView, aspectRatio, nearPlane, farPlane);
     glm::mat4 VP = projection * view;
-    glm::mat4 identity = glm::mat4(1.0f);
-    lightIndex = 0;
-    updateNodeTransformations(rootNode, identity, VP);
-    glUniform3fv(glGetUniformLocation(modelShader->get(), "cameraPos"), 1, glm::value_ptr(cameraPos));
+    // Remakes the sky for the new sun and camera height, if they moved far enough,
+    // and then the sky probe a face at a time
+    if(atmosphere.update(sunDir, cameraPos))
+        skyProbe.invalidate();
+    frameConstants.atmosphere = glm::vec4(ATMOSPHERE_KM_PER_UNIT, atmosphere.viewHeight(), ATMOSPHERE_EXPOSURE, 0.0f);
+    // The scene update, culling and packet generation are spread over the job system's threads
+    JobSystem &jobs = jobSystem();
+    updateTransformHierarchy(*rootNode->transforms, VP, &jobs);
+    collectLightSources(*rootNode->transforms);
+
+    // Fit a shadow cascade to each slice of the visible part of the scene.
+    // Without usable bounds, fall back to a fixed area around the origin.
+    AABB sceneBounds = rootNode->subtreeBounds();
+    if(sceneBounds.isEmpty() || sceneBounds.isUnbounded()) {
+        sceneBounds.min = glm::vec3(-150.0f);
+        sceneBounds.max = glm::vec3(150.0f);
+    }
+    // With the shadow cache, the shadows follow the sun in steps so that they can be reused in between
+    glm::vec3 shadowLightDirection = shadowCache.lightDirection(lightNode->position());
+    shadowCascades = fitShadowCascades(shadowLightDirection, sceneBounds, view, fieldOfView, aspectRatio,
+                                       nearPlane, farPlane, shadowCascadeCount, shadowMapSize);
+
+    // Casters are culled against each cascade's volume rather than the camera's,
+    // as objects outside the view can still cast shadows into it.
+    cullHierarchy(*rootNode->transforms, frustumFromMatrix(VP), cameraCulling, &jobs);
+    const unsigned char *shadowVisibility[MAX_SHADOW_CASCADES];
+    for(unsigned int cascade = 0; cascade < shadowCascades.count; cascade++) {
+        cullHierarchy(*rootNode->transforms, frustumFromMatrix(shadowCascades.cascades[cascade].lightSpaceMatrix),
+                      shadowCasterCulling[cascade], &jobs);
+        shadowVisibility[cascade] = shadowCasterCulling[cascade].visible.data();
+    }
+    // Distant meshes are drawn at a coarser level of detail, and shadow casters coarser still
+    LodSelection lodSelection;
+    lodSelection.cameraPosition = cameraPos;
+    lodSelection.pixelsPerUnit = float(winHeight) / (2.0f * std::tan(0.5f * fieldOfView));
+    buildRenderQueue(renderQueue, *rootNode->transforms, modelShader, cameraCulling.visible.data(),
+                     shadowVisibility, shadowCascades.count, &jobs, &lodSelection);
+    for(unsigned int cascade = 0; cascade < shadowCascades.count; cascade++) {
+        std::uint64_t signature = shadowCache.enabled() ? shadowPassSignature(renderQueue.shadowPasses[cascade]) : 0;
+        cascadeUpdates[cascade] = shadowCache.update(cascade, shadowCascades.cascades[cascade].lightSpaceMatrix,
+                                                     signature, renderQueue.dynamicShadowPasses[cascade].count > 0);
+    }
+
+    frameConstants.view = view;
+    frameConstants.projection = projection;
+    frameConstants.viewProjection = VP;
+    for(unsigned int cascade = 0; cascade < shadowCascades.count; cascade++) {
+        frameConstants.lightSpaceMatrices[cascade] = shadowCascades.cascades[cascade].lightSpaceMatrix;
+        frameConstants.cascadeSplits[cascade] = shadowCascades.splitDistances[cascade];
+        frameConstants.cascadeTexelSizes[cascade] = shadowCascades.cascades[cascade].texelSize;
+    }
+    frameConstants.shadowParams = glm::vec4(float(shadowCascades.count), CASCADE_BLEND_FRACTION,
+                                            1.0f / float(shadowMapSize), 0.0f);
+    frameConstants.cameraPos = glm::vec4(cameraPos, 1.0f);
+
+    // Upload everything the passes need in one go.
+    *static_cast<FrameConstants*>(frameConstantsBuffer.beginWrite(sizeof(FrameConstants))) = frameConstants;
+    writeObjectData(renderQueue, objectDataBuffer);
+    writeIndirectCommands(renderQueue, drawCommandBuffer);
 
-    // Set shadow parameters.
     // (Also set any material properties like shininess.)
-    glUniform1f(glGetUniformLocation(modelShader->get(), "shininess"), 32.0f);
+    modelUniforms.shininess.set(32.0f);
 }
 
-// --- renderNode --- 
-static void renderNode(SceneNode *node) {
-    if(node->nodeType == GEOMETRY && node->vertexArrayObjectID != -1) {
-        glUniform1i(glGetUniformLocation(modelShader->get(), "useTexture"),
-                    (node->hasTexture && node->textureID != 0) ? 1 : 0);
-        if(node->hasTexture && node->textureID != 0) {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, node->textureID);
-            glUniform1i(glGetUniformLocation(modelShader->get(), "diffuseTexture"), 0);
-        }
-        glUniformMatrix4fv(glGetUniformLocation(modelShader->get(), "modelMatrix"),
-                           1, GL_FALSE, glm::value_ptr(node->modelMatrix));
-        // Compute and set the normal matrix.
-        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(node->modelMatrix)));
-        glUniformMatrix3fv(glGetUniformLocation(modelShader->get(), "normalMatrix"),
-                           1, GL_FALSE, glm::value_ptr(normalMatrix));
-        // Also set the model's MVP if used.
-        glBindVertexArray(node->vertexArrayObjectID);
-        glDrawElements(GL_TRIANGLES, node->VAOIndexCount, GL_UNSIGNED_INT, nullptr);
+// --- renderMainPass ---
+static void renderMainPass() {
+    renderState.begin();
+    // The per-object matrices and flags are fetched by index from the object buffer.
+    drawPassBatches(renderQueue.mainPass, true);
+    mainStats = renderState.stats;
+}
+
+// Triangles drawn by a pass, counting every instance
+static unsigned long long passTriangles(const PassPackets &pass, bool shadow) {
+    unsigned long long triangles = 0;
+    for(unsigned int i = 0; i < pass.count; i++) {
+        const DrawPacket *packet = pass.packets[i];
+        unsigned int indexCount = shadow ? packet->shadowIndexCount : packet->indexCount;
+        triangles += (unsigned long long)(indexCount / 3) * packet->instanceCount;
     }
-    for(auto child : node->children)
-        renderNode(child);
+    return triangles;
+}
+
+// --- printRenderStats ---
+static void printRenderStats() {
+    if(!options.enableStats || totalElapsedTime - lastStatsPrintTime < 5.0)
+        return;
+    lastStatsPrintTime = totalElapsedTime;
+    std::cout << fmt::format("Frame: {} packets, {} instances ({} bytes of arena). "
+                             "Shadow passes: {} draw calls for {} meshes ({} instances), {} VAO binds. "
+                             "Main pass: {} draw calls for {} meshes ({} instances), {} program, {} VAO and {} texture changes.",
+                             renderQueue.packetCount, renderQueue.instanceCount, renderQueue.arena.bytesUsed(),
+                             shadowStats.drawCalls, shadowStats.drawCommands, shadowStats.instances,
+                             shadowStats.vertexArrayChanges,
+                             mainStats.drawCalls, mainStats.drawCommands, mainStats.instances, mainStats.programChanges,
+                             mainStats.vertexArrayChanges, mainStats.textureChanges) << std::endl;
+    const TextureCache &textures = sharedTextureCache();
+    std::cout << fmt::format("Textures: {} in {} arrays, {} loads shared, {}.", textures.textureCount(),
+                             textures.arrayCount(), textures.sharedLoads,
+                             textures.bindless() ? "bindless" : "bound per array") << std::endl;
+    std::cout << fmt::format("Culling: {} boxes tested, {} nodes culled, {} drawn in the main pass.",
+                             cameraCulling.tested, cameraCulling.culled, renderQueue.mainPass.count) << std::endl;
+    unsigned long long shadowTriangles = 0;
+    for(unsigned int cascade = 0; cascade < renderQueue.shadowPassCount; cascade++) {
+        const PassPackets &staticPass = renderQueue.shadowPasses[cascade];
+        const PassPackets &dynamicPass = renderQueue.dynamicShadowPasses[cascade];
+        unsigned long long triangles = passTriangles(staticPass, true) + passTriangles(dynamicPass, true);
+        shadowTriangles += triangles;
+        std::cout << fmt::format("Shadow cascade {}: up to {:.1f} units away, {:.3f} units per texel. "
+                                 "{} boxes tested, {} nodes culled, {} static and {} dynamic casters, "
+                                 "{} triangles, {:.3f} ms on the GPU.",
+                                 cascade, shadowCascades.splitDistances[cascade],
+                                 shadowCascades.cascades[cascade].texelSize,
+                                 shadowCasterCulling[cascade].tested, shadowCasterCulling[cascade].culled,
+                                 staticPass.count, dynamicPass.count, triangles,
+                                 shadowPassTimer.milliseconds(cascade)) << std::endl;
+    }
+    if(shadowCache.enabled()) {
+        std::cout << fmt::format("Shadow cache: static casters redrawn {} times and reused {} times since the last report.",
+                                 shadowCache.redraws, shadowCache.reuses) << std::endl;
+        shadowCache.resetCounters();
+    }
+    if(options.shadowQuality == SHADOW_QUALITY_EVSM)
+        std::cout << fmt::format("EVSM blur: {:.3f} ms on the GPU.",
+                                 shadowPassTimer.milliseconds(shadowCascadeCount)) << std::endl;
+    std::cout << fmt::format("Atmosphere: sky-view LUT remade {} times since the last report.",
+                             atmosphere.skyViewUpdates) << std::endl;
+    atmosphere.skyViewUpdates = 0;
+    std::cout << fmt::format("Sky probe: {} faces rendered since the last report.", skyProbe.faceUpdates) << std::endl;
+    skyProbe.faceUpdates = 0;
+    std::cout << fmt::format("Levels of detail: {} triangles in the main pass, {} in the shadow passes.",
+                             passTriangles(renderQueue.mainPass, false), shadowTriangles) << std::endl;
+    const AssetStreamer &streamer = sharedAssetStreamer();
+    if(!streamer.idle())
+        std::cout << fmt::format("Streaming: {} assets pending, {:.1f} KB uploaded last frame in {:.2f} ms.",
+                                 streamer.pendingCount(), streamer.lastFrameBytes / 1024.0,
+                                 streamer.lastFrameMilliseconds) << std::endl;
 }
 
 void renderFrame(GLFWwindow *window) {
     int winWidth, winHeight;
     glfwGetWindowSize(window, &winWidth, &winHeight);
-    glm::vec3 center(0.0f);
-    glm::vec3 cameraPos;
-    cameraPos.x = center.x + cameraRadius * cos(glm::radians(cameraPitch)) * sin(glm::radians(cameraYaw));
-    cameraPos.y = center.y + cameraRadius * sin(glm::radians(cameraPitch));
-    cameraPos.z = center.z + cameraRadius * cos(glm::radians(cameraPitch)) * cos(glm::radians(cameraYaw));
-    glm::mat4 view = glm::lookAt(cameraPos, center, glm::vec3(0, 1, 0));
-    glm::mat4 projection = glm::perspective(glm::radians(80.0f), float(winWidth) / float(winHeight), 0.1f, 350.f);
-    
-    // --- Shadow Pass ---
-    glm::mat4 lightProjection = glm::ortho(-150.0f, 150.0f, -150.0f, 150.0f, 1.0f, 400.0f);
-    glm::mat4 lightView = glm::lookAt(lightNode->position, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
-    glm::mat4 lightSpaceMatrix = lightProjection * lightView;
-    glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
+
+    // The camera, light and object data for this frame were written in updateFrame().
+    frameConstantsBuffer.bind(FRAME_CONSTANTS_BINDING);
+    objectDataBuffer.bind(OBJECT_DATA_BINDING);
+    sharedInstancePool().bind(INSTANCE_DATA_BINDING);
+    sharedTextureCache().bindMaterials(MATERIAL_DATA_BINDING);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandBuffer.get());
+
+    // --- Shadow Passes ---
+    glViewport(0, 0, shadowMapSize, shadowMapSize);
     glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO);
-    glClear(GL_DEPTH_BUFFER_BIT);
     shadowShader->activate();
-    glUniformMatrix4fv(glGetUniformLocation(shadowShader->get(), "lightSpaceMatrix"), 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
-    renderShadowScene(rootNode, glm::mat4(1.0f));
+    renderShadowPasses();
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    blurShadowMoments();
+
+    // --- Sky Probe ---
+    // Read by the main pass for the haze, and by the skybox and the sky probe
+    atmosphere.bind();
+    skyProbe.update(*skybox, sunDir);
 
     // --- Main Render Pass ---
     glViewport(0, 0, winWidth, winHeight);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     modelShader->activate();
-    glUniformMatrix4fv(glGetUniformLocation(modelShader->get(), "lightSpaceMatrix"), 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, shadowMap);
-    glUniform1i(glGetUniformLocation(modelShader->get(), "shadowMap"), 1);
-    renderNode(rootNode);
+    glBindTextureUnit(1, shadowMap);
+    if(shadowMoments != 0)
+        glBindTextureUnit(2, shadowMoments);
+    skyProbe.bind();
+    renderMainPass();
 
     // --- Procedural Skybox Render Pass ---
     // The skybox is rendered last with depth function modifications.
-    // In addition, we pass the current dayFactor and light directions.
-    float dayFactor = glm::clamp(glm::dot(sunDir, glm::vec3(0, 1, 0)), 0.0f, 1.0f);
-    skybox->render(view, projection, dayFactor, sunDir, moonDir);
+    // The camera, dayFactor and light directions come from the frame constants.
+    skybox->render();
+
+    // Nothing else reads this frame's sections of the ring buffers.
+    frameConstantsBuffer.endFrame();
+    objectDataBuffer.endFrame();
+    drawCommandBuffer.endFrame();
+    shadowPassTimer.endFrame();
 
+    printRenderStats();
 }
@@ -0,0 +1,51 @@
+#include "shadowCache.hpp"
+#include <cmath>
+
+void ShadowCache::init(float thresholdDegrees)
+{
+    cosThreshold = thresholdDegrees > 0.0f ? std::cos(glm::radians(thresholdDegrees)) : 1.0f;
+    invalidate();
+    resetCounters();
+}
+
+glm::vec3 ShadowCache::lightDirection(const glm::vec3 &directionToSun)
+{
+    glm::vec3 sun = glm::normalize(directionToSun);
+    if (!enabled() || !hasDirection || glm::dot(sun, direction) < cosThreshold) {
+        direction = sun;
+        hasDirection = true;
+    }
+    return direction;
+}
+
+CascadeUpdate ShadowCache::update(unsigned int cascade, const glm::mat4 &lightSpaceMatrix,
+                                  std::uint64_t staticSignature, bool hasDynamicCasters)
+{
+    CascadeUpdate result;
+    if (!enabled()) {
+        redraws++;
+        return result;
+    }
+    CachedCascade &cached = cascades[cascade];
+    result.redrawStatic = !cached.valid || cached.signature != staticSignature
+                       || cached.lightSpaceMatrix != lightSpaceMatrix;
+    // The shadow map layer only needs the static depth again if it changed, or
+    // if dynamic casters were or are about to be drawn over it
+    result.copyStatic = result.redrawStatic || hasDynamicCasters || cached.holdsDynamic;
+    cached.valid = true;
+    cached.signature = staticSignature;
+    cached.lightSpaceMatrix = lightSpaceMatrix;
+    cached.holdsDynamic = hasDynamicCasters;
+    if (result.redrawStatic)
+        redraws++;
+    else
+        reuses++;
+    return result;
+}
+
+void ShadowCache::invalidate()
+{
+    hasDirection = false;
+    for (CachedCascade &cached : cascades)
+        cached = CachedCascade();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
+
+#include "shadowProjection.hpp"
+
+// What a shadow cascade needs this frame when its static casters are cached
+struct CascadeUpdate {
+    // Draw the static casters into the cache layer
+    bool redrawStatic = true;
+    // Copy the cache layer into the shadow map, which has other depth in it
+    bool copyStatic = false;
+};
+
+// Decides when the cached depth of the static shadow casters is stale. The
+// cache is a second depth texture array with a layer per cascade, which is
+// copied into the shadow map before the dynamic casters are drawn over it.
+//
+// The sun moves slowly, so the shadows follow it in steps: the direction the
+// cascades are fitted to only catches up once the sun has moved more than the
+// threshold angle away from it. Between steps, a cascade keeps its projection
+// for as long as the camera doesn't move it, and its static depth is only
+// redrawn when the static casters in it change, as told by shadowPassSignature().
+class ShadowCache {
+public:
+    // A threshold of 0 disables caching. The direction then follows the sun,
+    // and everything is drawn straight into the shadow map every frame.
+    void init(float thresholdDegrees);
+    bool enabled() const { return cosThreshold < 1.0f; }
+
+    // The direction to the light to fit this frame's cascades to
+    glm::vec3 lightDirection(const glm::vec3 &directionToSun);
+    CascadeUpdate update(unsigned int cascade, const glm::mat4 &lightSpaceMatrix, std::uint64_t staticSignature,
+                         bool hasDynamicCasters);
+    // Forces every cascade to be redrawn, e.g. after the shadow map was recreated
+    void invalidate();
+
+    // Since the last resetCounters(), for the stats output
+    unsigned int redraws = 0;
+    unsigned int reuses = 0;
+    void resetCounters() { redraws = reuses = 0; }
+
+private:
+    struct CachedCascade {
+        bool valid = false;
+        glm::mat4 lightSpaceMatrix;
+        std::uint64_t signature = 0;
+        // The shadow map layer has more than the static depth in it
+        bool holdsDynamic = false;
+    };
+
+    float cosThreshold = 1.0f;
+    bool hasDirection = false;
+    glm::vec3 direction = glm::vec3(0.0f, 1.0f, 0.0f);
+    CachedCascade cascades[MAX_SHADOW_CASCADES];
+};
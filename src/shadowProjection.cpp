@@ -0,0 +1,105 @@
+#include "shadowProjection.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+
+static glm::vec3 boxCorner(const AABB &box, int corner)
+{
+    return glm::vec3((corner & 1) ? box.max.x : box.min.x,
+                     (corner & 2) ? box.max.y : box.min.y,
+                     (corner & 4) ? box.max.z : box.min.z);
+}
+
+// The light's view, looking along the light with the light at the origin.
+// Only the light's orientation matters; the position is chosen by the projection.
+static glm::mat4 lightView(const glm::vec3 &directionToLight)
+{
+    glm::vec3 forward = -glm::normalize(directionToLight);
+    glm::vec3 up = std::fabs(forward.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+    return glm::lookAt(glm::vec3(0.0f), forward, up);
+}
+
+// Covers the sphere with a square of whole texels and the depth of sceneBounds
+static ShadowProjection fitToSphere(const glm::mat4 &view, const glm::vec3 &worldCenter, float radius,
+                                    const AABB &sceneBounds, unsigned int shadowMapSize)
+{
+    ShadowProjection result;
+    result.view = view;
+    // Rounding the radius up keeps small changes in the region from resizing the texels
+    radius = std::ceil(radius * 4.0f) / 4.0f;
+    radius = std::fmax(radius, 0.25f);
+    result.texelSize = 2.0f * radius / float(shadowMapSize);
+
+    glm::vec3 center = glm::vec3(view * glm::vec4(worldCenter, 1.0f));
+    center.x = std::floor(center.x / result.texelSize) * result.texelSize;
+    center.y = std::floor(center.y / result.texelSize) * result.texelSize;
+
+    // The camera looks down -z, so depth is -z
+    float nearestZ = -FLT_MAX, farthestZ = FLT_MAX;
+    for (int corner = 0; corner < 8; corner++) {
+        float z = (view * glm::vec4(boxCorner(sceneBounds, corner), 1.0f)).z;
+        nearestZ = std::fmax(nearestZ, z);
+        farthestZ = std::fmin(farthestZ, z);
+    }
+    float margin = 1.0f;
+    result.projection = glm::ortho(center.x - radius, center.x + radius,
+                                   center.y - radius, center.y + radius,
+                                   -nearestZ - margin, -farthestZ + margin);
+    result.lightSpaceMatrix = result.projection * result.view;
+    return result;
+}
+
+ShadowCascades fitShadowCascades(const glm::vec3 &directionToLight, const AABB &sceneBounds,
+                                 const glm::mat4 &cameraView, float fieldOfView, float aspectRatio,
+                                 float cameraNear, float cameraFar, unsigned int cascadeCount,
+                                 unsigned int shadowMapSize, float splitLambda)
+{
+    ShadowCascades result;
+    result.count = glm::clamp(cascadeCount, 1u, MAX_SHADOW_CASCADES);
+
+    // Only split the depths where there is something to shadow
+    float nearest = FLT_MAX, farthest = -FLT_MAX;
+    for (int corner = 0; corner < 8; corner++) {
+        float depth = -(cameraView * glm::vec4(boxCorner(sceneBounds, corner), 1.0f)).z;
+        nearest = std::fmin(nearest, depth);
+        farthest = std::fmax(farthest, depth);
+    }
+    nearest = glm::clamp(nearest, cameraNear, cameraFar);
+    farthest = glm::clamp(farthest, cameraNear, cameraFar);
+    if (farthest - nearest < 1e-3f) {
+        nearest = cameraNear;
+        farthest = cameraFar;
+    }
+
+    // A slice's corners are this many times its depth away from the view axis
+    float halfHeight = std::tan(0.5f * fieldOfView);
+    float cornerSlope = halfHeight * std::sqrt(1.0f + aspectRatio * aspectRatio);
+    float k2 = cornerSlope * cornerSlope;
+    glm::mat4 cameraToWorld = glm::inverse(cameraView);
+    glm::mat4 view = lightView(directionToLight);
+
+    float sliceNear = nearest;
+    for (unsigned int i = 0; i < result.count; i++) {
+        float fraction = float(i + 1) / float(result.count);
+        float logarithmic = nearest * std::pow(farthest / nearest, fraction);
+        float uniform = nearest + (farthest - nearest) * fraction;
+        float sliceFar = i + 1 == result.count ? farthest : glm::mix(uniform, logarithmic, splitLambda);
+        result.splitDistances[i] = sliceFar;
+
+        // Smallest sphere around the slice. Its centre is on the view axis: at the
+        // centre of the far face for wide slices, further in for deep ones.
+        float sum = sliceFar + sliceNear, difference = sliceFar - sliceNear;
+        float centerDepth, radius;
+        if (k2 >= difference / sum) {
+            centerDepth = sliceFar;
+            radius = sliceFar * cornerSlope;
+        } else {
+            centerDepth = 0.5f * sum * (1.0f + k2);
+            radius = 0.5f * std::sqrt(difference * difference + 2.0f * (sliceFar * sliceFar + sliceNear * sliceNear) * k2
+                                      + sum * sum * k2 * k2);
+        }
+        glm::vec3 center = glm::vec3(cameraToWorld * glm::vec4(0.0f, 0.0f, -centerDepth, 1.0f));
+        result.cascades[i] = fitToSphere(view, center, radius, sceneBounds, shadowMapSize);
+        sliceNear = sliceFar;
+    }
+    return result;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "utilities/bounds.hpp"
+
+// Cascades a shadow map can be split into; FrameConstants has room for this many
+const unsigned int MAX_SHADOW_CASCADES = 4;
+
+// The view and orthographic projection used to render a directional light's shadow map
+struct ShadowProjection {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 lightSpaceMatrix;  // projection * view
+    float texelSize;             // World-space size of one shadow map texel
+};
+
+// The camera frustum split by view depth into slices, each with a shadow map of its own
+struct ShadowCascades {
+    unsigned int count = 0;
+    ShadowProjection cascades[MAX_SHADOW_CASCADES];
+    // View depth at which each cascade ends; the first starts at the camera
+    float splitDistances[MAX_SHADOW_CASCADES];
+};
+
+// Splits the part of the camera's depth range that sceneBounds covers into
+// cascadeCount slices and fits a shadow map to each. The splits blend a
+// logarithmic and a uniform distribution by splitLambda, 1 being fully
+// logarithmic, so nearby slices are short and get finer texels.
+//
+// Each slice is covered by its bounding sphere, which only depends on the
+// split distances and the camera's field of view, so turning the camera
+// changes neither its size nor its texel size, and neither does rotating the
+// light. The centre is snapped to whole texels so that shadow edges don't
+// shimmer while the sun moves, and the depth range covers all of sceneBounds
+// so that casters between the light and the slice are kept.
+ShadowCascades fitShadowCascades(const glm::vec3 &directionToLight, const AABB &sceneBounds,
+                                 const glm::mat4 &cameraView, float fieldOfView, float aspectRatio,
+                                 float cameraNear, float cameraFar, unsigned int cascadeCount,
+                                 unsigned int shadowMapSize, float splitLambda = 0.75f);
@@ -0,0 +1,140 @@
+#include "skyProbe.hpp"
+#include "frameData.hpp"
+#include "skybox.hpp"
+#include "utilities/shader.hpp"
+#include <glm/glm.hpp>
+#include <cmath>
+#include <initializer_list>
+
+// Faces of the probe, and the levels of its reflections: 32 down to 2 texels
+static const int PROBE_SIZE = 32;
+static const int SPECULAR_LEVELS = 5;
+// Only read by the compute shaders
+static const int PROBE_RADIANCE_UNIT = 8;
+// The probe is rendered again once the sun turns by more than this, in any direction
+static const float PROBE_SUN_THRESHOLD_COS = std::cos(glm::radians(0.5f));
+
+// Maps (x, y, 1) in normalized device coordinates across each face to the
+// direction through it, in the face order and orientation of the GL spec.
+// Keep in sync with cubeDirection() in skyProbe.comp.
+static const glm::mat3 FACE_BASES[6] = {
+    glm::mat3(glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(1, 0, 0)),
+    glm::mat3(glm::vec3(0, 0, 1), glm::vec3(0, -1, 0), glm::vec3(-1, 0, 0)),
+    glm::mat3(glm::vec3(1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0)),
+    glm::mat3(glm::vec3(1, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, -1, 0)),
+    glm::mat3(glm::vec3(1, 0, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1)),
+    glm::mat3(glm::vec3(-1, 0, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, -1)),
+};
+
+static GLuint createCubemap(int levels)
+{
+    GLuint texture;
+    glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &texture);
+    glTextureStorage2D(texture, levels, GL_RGBA16F, PROBE_SIZE, PROBE_SIZE);
+    glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+static Gloom::Shader *createFilterShader(const char *pass)
+{
+    Gloom::Shader *shader = new Gloom::Shader();
+    shader->define(pass);
+    shader->attach("../res/shaders/skyProbe.comp");
+    shader->link();
+    shader->uniform<int>("radiance").set(PROBE_RADIANCE_UNIT);
+    return shader;
+}
+
+void SkyProbe::init()
+{
+    // Mips of the radiance let the prefilter read wide lobes with few samples
+    int radianceLevels = 1;
+    while ((PROBE_SIZE >> radianceLevels) > 0)
+        radianceLevels++;
+    radiance = createCubemap(radianceLevels);
+    specular = createCubemap(SPECULAR_LEVELS);
+    // Seamless filtering, so that rough reflections don't show the cube's edges
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    glCreateBuffers(1, &irradianceBuffer);
+    glm::vec4 black[9] = {};
+    glNamedBufferStorage(irradianceBuffer, sizeof(black), black, 0);
+    glCreateFramebuffers(1, &framebuffer);
+
+    projectionShader = createFilterShader("SH_PROJECTION");
+    prefilterShader = createFilterShader("SPECULAR_PREFILTER");
+    roughnessUniform = prefilterShader->uniform<float>("roughness");
+    nextFace = 0;
+    staleFaces = CUBE_FACES;
+    probeSunDirection = glm::vec3(0.0f);
+    complete = false;
+}
+
+void SkyProbe::destroy()
+{
+    for (Gloom::Shader **shader : {&projectionShader, &prefilterShader}) {
+        if (*shader != nullptr) {
+            (*shader)->destroy();
+            delete *shader;
+            *shader = nullptr;
+        }
+    }
+    GLuint textures[] = {radiance, specular};
+    glDeleteTextures(2, textures);
+    glDeleteBuffers(1, &irradianceBuffer);
+    glDeleteFramebuffers(1, &framebuffer);
+    radiance = specular = irradianceBuffer = framebuffer = 0;
+}
+
+void SkyProbe::update(Gloom::Skybox &skybox, const glm::vec3 &directionToSun)
+{
+    glm::vec3 sun = glm::normalize(directionToSun);
+    if (glm::dot(sun, probeSunDirection) < PROBE_SUN_THRESHOLD_COS) {
+        probeSunDirection = sun;
+        invalidate();
+    }
+    if (staleFaces == 0)
+        return;
+
+    // Until every face has been drawn once, the others would still be black
+    unsigned int faces = CUBE_FACES;
+    if (complete)
+        faces = 1;
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, PROBE_SIZE, PROBE_SIZE);
+    for (unsigned int i = 0; i < faces; i++) {
+        glNamedFramebufferTextureLayer(framebuffer, GL_COLOR_ATTACHMENT0, radiance, 0, GLint(nextFace));
+        skybox.renderProbeFace(FACE_BASES[nextFace]);
+        nextFace = (nextFace + 1) % CUBE_FACES;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    staleFaces = faces < staleFaces ? staleFaces - faces : 0;
+    faceUpdates += faces;
+    complete = true;
+    glGenerateTextureMipmap(radiance);
+    glBindTextureUnit(PROBE_RADIANCE_UNIT, radiance);
+
+    projectionShader->activate();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKY_IRRADIANCE_BINDING, irradianceBuffer);
+    glDispatchCompute(1, 1, 1);
+
+    prefilterShader->activate();
+    for (int level = 0; level < SPECULAR_LEVELS; level++) {
+        int size = PROBE_SIZE >> level;
+        roughnessUniform.set(float(level) / float(SPECULAR_LEVELS - 1));
+        glBindImageTexture(0, specular, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+        glDispatchCompute(GLuint(size + 7) / 8, GLuint(size + 7) / 8, CUBE_FACES);
+    }
+    glUseProgram(0);
+    // model.frag reads both results
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void SkyProbe::bind() const
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKY_IRRADIANCE_BINDING, irradianceBuffer);
+    glBindTextureUnit(SKY_SPECULAR_UNIT, specular);
+}
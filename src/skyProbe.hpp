@@ -0,0 +1,57 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "utilities/shader.hpp"
+
+namespace Gloom { class Skybox; }
+
+// Texture unit of the prefiltered reflections for model.frag. The diffuse
+// irradiance goes to the storage buffer at SKY_IRRADIANCE_BINDING.
+const unsigned int SKY_SPECULAR_UNIT = 7;
+
+// Image-based ambient light from the procedural sky. The skybox is rendered
+// into a small cubemap, one face per frame while the sky is changing, so the
+// cost is spread out as the sun moves. After each face, skyProbe.comp
+// projects the cubemap to spherical harmonics for diffuse light, and
+// prefilters it into a mip chain of increasingly rough reflections.
+//
+// model.frag then lights with a few fetches rather than evaluating the sky
+// per pixel.
+class SkyProbe {
+public:
+    void init();
+    void destroy();
+
+    // Marks every face out of date, e.g. after the atmosphere's sky-view LUT was remade
+    void invalidate() { staleFaces = CUBE_FACES; }
+    // Marks every face out of date if the sun has turned past a threshold
+    // from the direction the probe was rendered for, as the sky-view LUT is relative
+    // to the sun and isn't remade when only its azimuth changes. Then renders
+    // the next out-of-date face, or all of them until the probe has been
+    // complete once, and filters the result. Leaves the framebuffer and
+    // viewport to the caller. Needs the frame constants and the atmosphere's
+    // lookup tables bound.
+    void update(Gloom::Skybox &skybox, const glm::vec3 &directionToSun);
+    void bind() const;
+
+    // Faces rendered, for the stats output
+    unsigned int faceUpdates = 0;
+
+private:
+    static const unsigned int CUBE_FACES = 6;
+
+    GLuint radiance = 0;          // The sky as rendered, with mips for filtering
+    GLuint specular = 0;          // Prefiltered reflections, rougher with each level
+    GLuint irradianceBuffer = 0;  // Nine RGB spherical harmonic coefficients
+    GLuint framebuffer = 0;
+    Gloom::Shader *projectionShader = nullptr;
+    Gloom::Shader *prefilterShader = nullptr;
+    Gloom::Uniform<float> roughnessUniform;
+
+    unsigned int nextFace = 0;
+    unsigned int staleFaces = CUBE_FACES;
+    // The sun the faces being rendered are for; zero until the first update
+    glm::vec3 probeSunDirection = glm::vec3(0.0f);
+    bool complete = false;
+};
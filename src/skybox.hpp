@@ -4,11 +4,10 @@
 #include <string>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include "utilities/shader.hpp"
 
 namespace Gloom {
 
-    class Shader; // Forward declaration
-
     class Skybox {
     public:
         Skybox();
@@ -19,15 +18,25 @@ namespace Gloom {
         void init(const std::string& shaderVertPath,
                   const std::string& shaderFragPath);
 
-        // Renders the skybox.
-        // dayFactor is between 0 (night) and 1 (full day);
-        // sunDir and moonDir are the normalized light directions.
-        void render(const glm::mat4& view, const glm::mat4& projection,
-                    float dayFactor, const glm::vec3& sunDir, const glm::vec3& moonDir);
+        // Renders the skybox as one triangle covering the screen.
+        // The camera, dayFactor and the normalized sun and moon directions
+        // are read from the FrameConstants uniform block, which must be bound,
+        // and the sky from the lookup tables bound by Atmosphere::bind().
+        void render();
+
+        // Renders the sky without the sun's disc into the bound framebuffer,
+        // for a face of a cubemap. faceBasis maps (x, y, 1) across the face
+        // in normalized device coordinates to the direction through it.
+        void renderProbeFace(const glm::mat3& faceBasis);
 
     private:
-        unsigned int VAO, VBO;
+        void draw(Shader* program);
+
+        unsigned int VAO;
         Shader* shader;
+        // The same shaders compiled with SKY_PROBE
+        Shader* probeShader;
+        Uniform<glm::mat3> faceBasisUniform;
     };
 
 }
@@ -0,0 +1,413 @@
+#include "transformHierarchy.hpp"
+#include "sceneGraph.hpp"
+#include "utilities/jobSystem.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+TransformHierarchy &defaultTransformHierarchy()
+{
+	static TransformHierarchy hierarchy;
+	return hierarchy;
+}
+
+unsigned int addTransform(TransformHierarchy &hierarchy, SceneNode *node)
+{
+	unsigned int index = hierarchy.nodes.size();
+	hierarchy.positions.push_back(glm::vec3(0, 0, 0));
+	hierarchy.rotations.push_back(glm::vec3(0, 0, 0));
+	hierarchy.scales.push_back(glm::vec3(1, 1, 1));
+	hierarchy.referencePoints.push_back(glm::vec3(0, 0, 0));
+	hierarchy.localBounds.push_back(AABB());
+	hierarchy.parents.push_back(-1);
+	hierarchy.subtreeEnds.push_back(index + 1);
+	hierarchy.dirty.push_back(1);
+	hierarchy.dirtyIndices.push_back(index);
+	hierarchy.worldMatrices.push_back(glm::mat4(1.0f));
+	hierarchy.MVPs.push_back(glm::mat4(1.0f));
+	hierarchy.normalMatrices.push_back(glm::mat3(1.0f));
+	hierarchy.worldBounds.push_back(AABB());
+	hierarchy.subtreeBounds.push_back(AABB());
+	hierarchy.nodes.push_back(node);
+	return index;
+}
+
+void setTransformParent(TransformHierarchy &hierarchy, unsigned int child, int parent)
+{
+	hierarchy.parents[child] = parent;
+	markTransformDirty(hierarchy, child);
+	hierarchy.needsSort = true;
+}
+
+void releaseTransform(TransformHierarchy &hierarchy, unsigned int index)
+{
+	hierarchy.parents[index] = FREE_TRANSFORM;
+	hierarchy.nodes[index] = nullptr;
+	hierarchy.needsSort = true;
+}
+
+void markTransformDirty(TransformHierarchy &hierarchy, unsigned int index)
+{
+	if (!hierarchy.dirty[index])
+	{
+		hierarchy.dirty[index] = 1;
+		hierarchy.dirtyIndices.push_back(index);
+	}
+}
+
+void clearTransformHierarchy(TransformHierarchy &hierarchy)
+{
+	hierarchy.positions.clear();
+	hierarchy.rotations.clear();
+	hierarchy.scales.clear();
+	hierarchy.referencePoints.clear();
+	hierarchy.localBounds.clear();
+	hierarchy.parents.clear();
+	hierarchy.subtreeEnds.clear();
+	hierarchy.dirty.clear();
+	hierarchy.dirtyIndices.clear();
+	hierarchy.worldMatrices.clear();
+	hierarchy.MVPs.clear();
+	hierarchy.normalMatrices.clear();
+	hierarchy.worldBounds.clear();
+	hierarchy.subtreeBounds.clear();
+	hierarchy.nodes.clear();
+	hierarchy.needsSort = false;
+}
+
+template <class T>
+static void permute(std::vector<T> &data, const std::vector<unsigned int> &order)
+{
+	std::vector<T> sorted;
+	sorted.reserve(data.size());
+	for (unsigned int oldIndex : order)
+	{
+		sorted.push_back(data[oldIndex]);
+	}
+	data.swap(sorted);
+}
+
+void sortTransformHierarchy(TransformHierarchy &hierarchy)
+{
+	unsigned int oldCount = hierarchy.nodes.size();
+
+	// Depth-first pre-order walk starting from every root, in their current order.
+	// Released slots are neither roots nor reachable from one, so they drop out.
+	std::vector<unsigned int> order;
+	order.reserve(oldCount);
+	for (unsigned int i = 0; i < oldCount; i++)
+	{
+		if (hierarchy.parents[i] != -1)
+		{
+			continue;
+		}
+		SceneNode *root = hierarchy.nodes[i];
+		SceneNode *node = root;
+		while (node != nullptr)
+		{
+			order.push_back(node->transformIndex);
+			if (node->firstChild != nullptr)
+			{
+				node = node->firstChild;
+				continue;
+			}
+			// Climb until there is a sibling to move on to
+			while (node != root && node->nextSibling == nullptr)
+			{
+				node = node->parent;
+			}
+			node = node == root ? nullptr : node->nextSibling;
+		}
+	}
+	unsigned int count = order.size();
+
+	std::vector<int> newIndexOf(oldCount, -1);
+	for (unsigned int newIndex = 0; newIndex < count; newIndex++)
+	{
+		newIndexOf[order[newIndex]] = int(newIndex);
+	}
+
+	permute(hierarchy.positions, order);
+	permute(hierarchy.rotations, order);
+	permute(hierarchy.scales, order);
+	permute(hierarchy.referencePoints, order);
+	permute(hierarchy.localBounds, order);
+	permute(hierarchy.parents, order);
+	permute(hierarchy.dirty, order);
+	permute(hierarchy.worldMatrices, order);
+	permute(hierarchy.MVPs, order);
+	permute(hierarchy.normalMatrices, order);
+	permute(hierarchy.worldBounds, order);
+	permute(hierarchy.subtreeBounds, order);
+	permute(hierarchy.nodes, order);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (hierarchy.parents[i] != -1)
+		{
+			hierarchy.parents[i] = newIndexOf[hierarchy.parents[i]];
+		}
+		hierarchy.nodes[i]->transformIndex = i;
+	}
+	hierarchy.subtreeEnds.resize(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		hierarchy.subtreeEnds[i] = i + 1;
+	}
+	// Released slots are no longer dirty; the rest move with their nodes
+	std::vector<unsigned int> dirtyIndices;
+	dirtyIndices.reserve(hierarchy.dirtyIndices.size());
+	for (unsigned int index : hierarchy.dirtyIndices)
+	{
+		if (newIndexOf[index] != -1)
+		{
+			dirtyIndices.push_back(newIndexOf[index]);
+		}
+	}
+	hierarchy.dirtyIndices.swap(dirtyIndices);
+
+	// Children come after their parent, so walking backwards finishes every
+	// subtree before its parent's range is extended to cover it
+	for (unsigned int i = count; i-- > 0;)
+	{
+		int parent = hierarchy.parents[i];
+		if (parent != -1 && hierarchy.subtreeEnds[parent] < hierarchy.subtreeEnds[i])
+		{
+			hierarchy.subtreeEnds[parent] = hierarchy.subtreeEnds[i];
+		}
+	}
+	hierarchy.needsSort = false;
+}
+
+glm::mat4 composeLocalTransform(const glm::vec3 &position, const glm::vec3 &rotation,
+                                const glm::vec3 &scale, const glm::vec3 &referencePoint)
+{
+	float cx = std::cos(rotation.x), sx = std::sin(rotation.x);
+	float cy = std::cos(rotation.y), sy = std::sin(rotation.y);
+	float cz = std::cos(rotation.z), sz = std::sin(rotation.z);
+
+	// Columns of Ry * Rx * Rz, each scaled by the matching scale factor
+	glm::vec3 xAxis = glm::vec3(cy * cz + sy * sx * sz, cx * sz, -sy * cz + cy * sx * sz) * scale.x;
+	glm::vec3 yAxis = glm::vec3(-cy * sz + sy * sx * cz, cx * cz, sy * sz + cy * sx * cz) * scale.y;
+	glm::vec3 zAxis = glm::vec3(sy * cx, -sx, cy * cx) * scale.z;
+
+	// Rotating and scaling around the reference point shifts the origin
+	glm::vec3 translation = position + referencePoint
+		- (xAxis * referencePoint.x + yAxis * referencePoint.y + zAxis * referencePoint.z);
+
+	return glm::mat4(glm::vec4(xAxis, 0.0f),
+	                 glm::vec4(yAxis, 0.0f),
+	                 glm::vec4(zAxis, 0.0f),
+	                 glm::vec4(translation, 1.0f));
+}
+
+// Recomputes the world matrices of every node in [begin, end), which holds one
+// or more whole sibling subtrees. Their parents must lie outside the range and
+// already be up to date; their subtree bounds are left for the caller to merge.
+static void updateTransformRange(TransformHierarchy &hierarchy, unsigned int begin, unsigned int end)
+{
+	for (unsigned int i = begin; i < end; i++)
+	{
+		glm::mat4 local = composeLocalTransform(hierarchy.positions[i], hierarchy.rotations[i],
+		                                        hierarchy.scales[i], hierarchy.referencePoints[i]);
+		int parent = hierarchy.parents[i];
+		// Parents come first, so their world matrix is already up to date
+		if (parent == -1)
+		{
+			hierarchy.worldMatrices[i] = local;
+		}
+		else
+		{
+			hierarchy.worldMatrices[i] = hierarchy.worldMatrices[parent] * local;
+		}
+		hierarchy.normalMatrices[i] = glm::transpose(glm::inverse(glm::mat3(hierarchy.worldMatrices[i])));
+		hierarchy.MVPs[i] = hierarchy.viewProjection * hierarchy.worldMatrices[i];
+
+		const AABB &bounds = hierarchy.localBounds[i];
+		if (bounds.isEmpty() && hierarchy.nodes[i]->vertexArrayObjectID != -1)
+		{
+			// Geometry of unknown size must never be culled
+			hierarchy.worldBounds[i] = AABB::unbounded();
+		}
+		else
+		{
+			hierarchy.worldBounds[i] = transformAABB(hierarchy.worldMatrices[i], bounds);
+		}
+		hierarchy.subtreeBounds[i] = hierarchy.worldBounds[i];
+		hierarchy.dirty[i] = 0;
+	}
+
+	// Walking backwards finishes every subtree before it is merged into its parent
+	for (unsigned int i = end; i-- > begin + 1;)
+	{
+		int parent = hierarchy.parents[i];
+		if (parent >= int(begin))
+		{
+			hierarchy.subtreeBounds[parent].grow(hierarchy.subtreeBounds[i]);
+		}
+	}
+}
+
+// Recomputes the subtree bounds of `parent` from its own bounds and those of its
+// direct children, which sit at the starts of the consecutive child ranges
+static void mergeChildBounds(TransformHierarchy &hierarchy, unsigned int parent)
+{
+	AABB bounds = hierarchy.worldBounds[parent];
+	for (unsigned int child = parent + 1; child < hierarchy.subtreeEnds[parent]; child = hierarchy.subtreeEnds[child])
+	{
+		bounds.grow(hierarchy.subtreeBounds[child]);
+	}
+	hierarchy.subtreeBounds[parent] = bounds;
+}
+
+static void updateAncestorBounds(TransformHierarchy &hierarchy, unsigned int index)
+{
+	for (int parent = hierarchy.parents[index]; parent != -1; parent = hierarchy.parents[parent])
+	{
+		mergeChildBounds(hierarchy, parent);
+	}
+}
+
+// Subtrees smaller than this are updated by a single job
+static const unsigned int PARALLEL_UPDATE_GRAIN = 2048;
+
+static void updateSubtreeParallel(TransformHierarchy &hierarchy, unsigned int root, JobSystem &jobs);
+
+// Hands the given disjoint subtrees to the job system: each large one is split
+// further, and runs of small ones are grouped into jobs of about
+// PARALLEL_UPDATE_GRAIN nodes. Every job writes a disjoint range of slots.
+static void submitSiblingSubtrees(TransformHierarchy &hierarchy, const std::vector<unsigned int> &roots,
+                                  JobSystem &jobs, JobCounter &counter)
+{
+	TransformHierarchy *target = &hierarchy;
+	size_t batchStart = 0;
+	unsigned int batchSize = 0;
+	auto flushBatch = [&](size_t batchEnd)
+	{
+		if (batchStart < batchEnd)
+		{
+			std::vector<unsigned int> batch(roots.begin() + batchStart, roots.begin() + batchEnd);
+			jobs.submit(counter, [target, batch]()
+			{
+				for (unsigned int root : batch)
+				{
+					updateTransformRange(*target, root, target->subtreeEnds[root]);
+				}
+			});
+		}
+		batchStart = batchEnd;
+		batchSize = 0;
+	};
+	for (size_t i = 0; i < roots.size(); i++)
+	{
+		unsigned int root = roots[i];
+		unsigned int size = hierarchy.subtreeEnds[root] - root;
+		if (size > PARALLEL_UPDATE_GRAIN)
+		{
+			flushBatch(i);
+			JobSystem *system = &jobs;
+			jobs.submit(counter, [target, root, system]() { updateSubtreeParallel(*target, root, *system); });
+			batchStart = i + 1;
+			continue;
+		}
+		batchSize += size;
+		if (batchSize >= PARALLEL_UPDATE_GRAIN)
+		{
+			flushBatch(i + 1);
+		}
+	}
+	flushBatch(roots.size());
+}
+
+static void updateSubtreeParallel(TransformHierarchy &hierarchy, unsigned int root, JobSystem &jobs)
+{
+	unsigned int end = hierarchy.subtreeEnds[root];
+	if (end - root <= PARALLEL_UPDATE_GRAIN)
+	{
+		updateTransformRange(hierarchy, root, end);
+		return;
+	}
+	// The root first, then its children's subtrees, which don't depend on each other
+	updateTransformRange(hierarchy, root, root + 1);
+	std::vector<unsigned int> children;
+	for (unsigned int child = root + 1; child < end; child = hierarchy.subtreeEnds[child])
+	{
+		children.push_back(child);
+	}
+	JobCounter counter;
+	submitSiblingSubtrees(hierarchy, children, jobs, counter);
+	jobs.wait(counter);
+	mergeChildBounds(hierarchy, root);
+}
+
+void updateTransformHierarchy(TransformHierarchy &hierarchy, const glm::mat4 &VP, JobSystem *jobs)
+{
+	if (hierarchy.needsSort)
+	{
+		sortTransformHierarchy(hierarchy);
+	}
+
+	hierarchy.updatedCount = 0;
+	bool cameraChanged = VP != hierarchy.viewProjection;
+	hierarchy.viewProjection = VP;
+
+	unsigned int count = hierarchy.nodes.size();
+	if (!hierarchy.dirtyIndices.empty())
+	{
+		// A dirty node invalidates its whole subtree, which is the contiguous
+		// range up to subtreeEnds[i]. Visiting the dirty slots in order lets us
+		// skip any that were already covered by an ancestor's range.
+		std::sort(hierarchy.dirtyIndices.begin(), hierarchy.dirtyIndices.end());
+		std::vector<unsigned int> &roots = hierarchy.dirtyRoots;
+		roots.clear();
+		unsigned int updatedUpTo = 0;
+		for (unsigned int i : hierarchy.dirtyIndices)
+		{
+			if (i >= updatedUpTo)
+			{
+				roots.push_back(i);
+				updatedUpTo = hierarchy.subtreeEnds[i];
+				hierarchy.updatedCount += updatedUpTo - i;
+			}
+		}
+		hierarchy.dirtyIndices.clear();
+
+		if (jobs == nullptr || jobs->threadCount() == 1 || hierarchy.updatedCount <= PARALLEL_UPDATE_GRAIN)
+		{
+			for (unsigned int root : roots)
+			{
+				updateTransformRange(hierarchy, root, hierarchy.subtreeEnds[root]);
+			}
+		}
+		else
+		{
+			JobCounter counter;
+			submitSiblingSubtrees(hierarchy, roots, *jobs, counter);
+			jobs->wait(counter);
+		}
+		// Dirty subtrees can share ancestors, so these are merged on this thread
+		for (unsigned int root : roots)
+		{
+			updateAncestorBounds(hierarchy, root);
+		}
+	}
+
+	if (cameraChanged)
+	{
+		auto refreshMVPs = [&hierarchy, &VP](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int i = begin; i < end; i++)
+			{
+				hierarchy.MVPs[i] = VP * hierarchy.worldMatrices[i];
+			}
+		};
+		if (jobs != nullptr)
+		{
+			jobs->parallelFor(count, 4 * PARALLEL_UPDATE_GRAIN, refreshMVPs);
+		}
+		else
+		{
+			refreshMVPs(0, count);
+		}
+	}
+}
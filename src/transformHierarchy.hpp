@@ -0,0 +1,93 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <vector>
+
+#include "utilities/bounds.hpp"
+
+struct SceneNode;
+class JobSystem;
+
+// Contiguous storage for the transforms of every SceneNode in a scene.
+// Each node owns one slot (SceneNode::transformIndex) in every array below.
+// The slots are kept in depth-first pre-order, so a parent always comes before
+// its children and every subtree occupies one contiguous range. This lets
+// updateTransformHierarchy() update the whole scene in a single linear pass.
+//
+// Only subtrees whose local transform changed since the last update are
+// recomputed. If just the camera moved, only the MVPs are refreshed.
+//
+// Bounds are kept alongside the matrices: each slot's local box is transformed
+// into world space, and subtreeBounds covers a node and all its descendants so
+// culling can reject whole subtrees with one test.
+struct TransformHierarchy {
+	// Local transformation, relative to the parent
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> rotations;
+	std::vector<glm::vec3> scales;
+	std::vector<glm::vec3> referencePoints;
+	// Bounds of the node's own geometry in its local space; empty if it draws nothing
+	std::vector<AABB> localBounds;
+
+	// Index of the parent slot, -1 for roots, or FREE_TRANSFORM for released slots
+	std::vector<int> parents;
+	// One past the last slot of each node's subtree
+	std::vector<unsigned int> subtreeEnds;
+
+	// Non-zero when the local transform changed since the last update.
+	// dirtyIndices lists the same slots so an update never scans clean nodes.
+	std::vector<unsigned char> dirty;
+	std::vector<unsigned int> dirtyIndices;
+	// Scratch list of the dirty subtrees an update visits, kept to avoid reallocating
+	std::vector<unsigned int> dirtyRoots;
+
+	// Results of the last update
+	std::vector<glm::mat4> worldMatrices;
+	std::vector<glm::mat4> MVPs;
+	std::vector<glm::mat3> normalMatrices;
+	std::vector<AABB> worldBounds;
+	std::vector<AABB> subtreeBounds;
+
+	// The view-projection matrix the MVPs were last computed with
+	glm::mat4 viewProjection = glm::mat4(1.0f);
+
+	// Number of world matrices recomputed by the last update, for profiling
+	unsigned int updatedCount = 0;
+
+	// The node owning each slot, used to re-point handles when the slots are reordered.
+	// nullptr for released slots until the next sort removes them.
+	std::vector<SceneNode*> nodes;
+
+	// Set whenever the structure changes; the next update restores pre-order first
+	bool needsSort = false;
+};
+
+const int FREE_TRANSFORM = -2;
+
+// The hierarchy used by createSceneNode() when none is given explicitly
+TransformHierarchy &defaultTransformHierarchy();
+
+unsigned int addTransform(TransformHierarchy &hierarchy, SceneNode *node);
+// parent is -1 to make the slot a root
+void setTransformParent(TransformHierarchy &hierarchy, unsigned int child, int parent);
+// Gives up a node's slot. The slot is removed, and the others compacted, by the next sort.
+void releaseTransform(TransformHierarchy &hierarchy, unsigned int index);
+void markTransformDirty(TransformHierarchy &hierarchy, unsigned int index);
+void clearTransformHierarchy(TransformHierarchy &hierarchy);
+
+// Reorders all slots into depth-first pre-order, following the SceneNode child
+// links, and drops released slots
+void sortTransformHierarchy(TransformHierarchy &hierarchy);
+
+// Brings the world, normal and MVP matrices and the world bounds of every node
+// up to date in one pass over the arrays. With a job system, large updates are
+// split into independent subtrees that run in parallel; without one, or with
+// a single thread, everything happens on the calling thread.
+void updateTransformHierarchy(TransformHierarchy &hierarchy, const glm::mat4 &VP, JobSystem *jobs = nullptr);
+
+// Equivalent to T(position) * T(referencePoint) * Ry * Rx * Rz * S * T(-referencePoint),
+// written out directly instead of multiplying seven matrices together
+glm::mat4 composeLocalTransform(const glm::vec3 &position, const glm::vec3 &rotation,
+                                const glm::vec3 &scale, const glm::vec3 &referencePoint);
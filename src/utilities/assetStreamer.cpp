@@ -0,0 +1,297 @@
+#include "assetStreamer.hpp"
+#include "modelLoader.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+AssetStreamer &sharedAssetStreamer()
+{
+    static AssetStreamer streamer;
+    return streamer;
+}
+
+// Largest piece staged at once, so the time budget is checked often enough
+static const size_t STAGING_CHUNK_BYTES = 1 << 20;
+static const size_t STAGING_ALIGNMENT = 16;
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void AssetStreamer::init(GeometryPool &geometryPool, TextureCache &textureCache, unsigned int decodeThreads,
+                         size_t stagingBytes)
+{
+    pool = &geometryPool;
+    textures = &textureCache;
+    // With no workers a JobSystem runs jobs on the submitting thread, which would be the render thread
+    decodeJobs.reset(new JobSystem(std::max(1u, decodeThreads)));
+    stagingBytesPerFrame = stagingBytes;
+    staging.init(GL_PIXEL_UNPACK_BUFFER, stagingBytesPerFrame);
+}
+
+void AssetStreamer::destroy()
+{
+    if (decodeJobs)
+        decodeJobs->wait(decodeCounter);
+    decodeJobs.reset();
+    for (const Request &request : uploads) {
+        if (request.mesh && request.mesh->state() == ASSET_UPLOADING)
+            pool->release(request.mesh->geometry);
+        if (request.texture)
+            dropTexture(*request.texture);
+    }
+    for (const Request &request : decoding) {
+        if (request.texture)
+            dropTexture(*request.texture);
+    }
+    decoding.clear();
+    uploads.clear();
+    staging.destroy();
+}
+
+std::shared_ptr<StreamedMesh> AssetStreamer::requestMesh(const std::string &filename, const std::string &baseDir)
+{
+    std::shared_ptr<StreamedMesh> mesh = std::make_shared<StreamedMesh>();
+    mesh->filename = filename;
+    mesh->baseDir = baseDir;
+    mesh->requested = std::chrono::steady_clock::now();
+    decoding.push_back(Request{mesh, nullptr});
+
+    JobSystem *jobs = decodeJobs.get();
+    jobs->submit(decodeCounter, [mesh, jobs]() {
+        auto start = std::chrono::steady_clock::now();
+        Mesh decoded = loadOBJModel(mesh->filename, mesh->baseDir, mesh->diffuseTexName, jobs);
+        if (decoded.vertices.empty() && !decoded.cooked) {
+            mesh->status.store(ASSET_FAILED, std::memory_order_release);
+            return;
+        }
+        mesh->bounds = decoded.bounds;
+        mesh->boundingSphere = decoded.boundingSphere;
+        mesh->cooked = decoded.cooked != nullptr;
+        packMesh(decoded, mesh->packed);
+        mesh->decodeMilliseconds = millisecondsSince(start);
+        mesh->status.store(ASSET_DECODED, std::memory_order_release);
+    });
+    return mesh;
+}
+
+std::shared_ptr<StreamedTexture> AssetStreamer::requestTexture(const std::string &filename)
+{
+    bool added;
+    MaterialIndex material = textures->acquire(filename, added);
+    if (!added) {
+        // Still on its way for an earlier request, which this one joins
+        for (const Request &request : decoding) {
+            if (request.texture && request.texture->material == material) {
+                request.texture->requesters++;
+                return request.texture;
+            }
+        }
+        for (const Request &request : uploads) {
+            if (request.texture && request.texture->material == material) {
+                request.texture->requesters++;
+                return request.texture;
+            }
+        }
+    }
+
+    std::shared_ptr<StreamedTexture> texture = std::make_shared<StreamedTexture>();
+    texture->filename = filename;
+    texture->material = material;
+    texture->requested = std::chrono::steady_clock::now();
+    if (!added) {
+        // Loaded already, or known not to load
+        bool failed = textures->state(material) == TEXTURE_FAILED;
+        if (failed)
+            textures->release(material);
+        texture->status.store(failed ? ASSET_FAILED : ASSET_RESIDENT, std::memory_order_release);
+        return texture;
+    }
+    decoding.push_back(Request{nullptr, texture});
+
+    decodeJobs->submit(decodeCounter, [texture]() {
+        auto start = std::chrono::steady_clock::now();
+        bool decoded = decodeTexture(texture->filename, texture->image);
+        texture->decodeMilliseconds = millisecondsSince(start);
+        texture->status.store(decoded ? ASSET_DECODED : ASSET_FAILED, std::memory_order_release);
+    });
+    return texture;
+}
+
+void AssetStreamer::dropTexture(StreamedTexture &texture)
+{
+    textures->markFailed(texture.material);
+    for (unsigned int i = 0; i < texture.requesters; i++)
+        textures->release(texture.material);
+    texture.material = NO_MATERIAL;
+}
+
+bool AssetStreamer::outOfTime() const
+{
+    return std::chrono::steady_clock::now() >= frameDeadline;
+}
+
+size_t AssetStreamer::stagingSpace()
+{
+    if (frameStaging == nullptr)
+        frameStaging = static_cast<unsigned char*>(staging.beginWrite(stagingBytesPerFrame));
+    size_t space = stagingBytesPerFrame - std::min(frameStagingUsed, stagingBytesPerFrame);
+    return std::min(space, STAGING_CHUNK_BYTES);
+}
+
+// Copies the data into this frame's staging section and returns its offset in the staging buffer
+GLintptr AssetStreamer::stage(const void *data, size_t size)
+{
+    GLintptr offset = GLintptr(staging.currentOffset() + frameStagingUsed);
+    std::memcpy(frameStaging + frameStagingUsed, data, size);
+    frameStagingUsed = (frameStagingUsed + size + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+    lastFrameBytes += size;
+    return offset;
+}
+
+// Stages as much of the mesh as fits; returns whether all of it has been copied
+bool AssetStreamer::uploadMesh(StreamedMesh &mesh)
+{
+    const PackedMesh &packed = mesh.packed;
+    if (mesh.state() == ASSET_DECODED) {
+        mesh.geometry = pool->reserve(packed);
+        mesh.status.store(ASSET_UPLOADING, std::memory_order_release);
+    }
+
+    while (mesh.uploadedVertices < packed.vertexCount) {
+        unsigned int count = std::min(packed.vertexCount - mesh.uploadedVertices,
+                                      unsigned(stagingSpace() / sizeof(PackedVertex)));
+        if (count == 0 || outOfTime())
+            return false;
+        GLintptr offset = stage(packed.vertices() + mesh.uploadedVertices, count * sizeof(PackedVertex));
+        pool->copyVertices(mesh.geometry, staging.get(), offset, mesh.uploadedVertices, count);
+        mesh.uploadedVertices += count;
+    }
+    size_t size = indexSize(packed.indexType);
+    while (mesh.uploadedIndices < packed.indexCount) {
+        unsigned int count = std::min(packed.indexCount - mesh.uploadedIndices, unsigned(stagingSpace() / size));
+        if (count == 0 || outOfTime())
+            return false;
+        GLintptr offset = stage(packed.indices() + mesh.uploadedIndices * size, count * size);
+        pool->copyIndices(mesh.geometry, staging.get(), offset, mesh.uploadedIndices, count);
+        mesh.uploadedIndices += count;
+    }
+    return true;
+}
+
+// Stages as many rows of the texture as fit; returns whether all of it has been copied
+bool AssetStreamer::uploadTexture(StreamedTexture &texture)
+{
+    // The texture it is a copy of was queued first, so it is resident by now
+    if (texture.shared)
+        return true;
+    const DecodedTexture &image = texture.image;
+    if (texture.state() == ASSET_DECODED) {
+        textures->allocateLayer(texture.material, image);
+        texture.status.store(ASSET_UPLOADING, std::memory_order_release);
+    }
+
+    while (texture.uploadedLevel < image.mipCount) {
+        unsigned int level = texture.uploadedLevel;
+        unsigned int height = image.mipHeight(level);
+        unsigned int rowsPerBlock = image.rowsPerBlock();
+        size_t blockRowSize = image.blockRowSize(level);
+        unsigned int blockRows = std::min((height - texture.uploadedRows + rowsPerBlock - 1) / rowsPerBlock,
+                                          unsigned(stagingSpace() / blockRowSize));
+        if (blockRows == 0 || outOfTime())
+            return false;
+        unsigned int rows = std::min(blockRows * rowsPerBlock, height - texture.uploadedRows);
+        GLintptr offset = stage(image.mip(level) + texture.uploadedRows / rowsPerBlock * blockRowSize,
+                                blockRows * blockRowSize);
+        // With a pixel unpack buffer bound, the pointer is an offset into it. The
+        // array is looked up every time as it may have grown since the last slice.
+        uploadTextureRows(textures->arrayTexture(texture.material), image, level, texture.uploadedRows, rows,
+                          reinterpret_cast<const void*>(offset), int(textures->layer(texture.material)));
+        texture.uploadedRows += rows;
+        if (texture.uploadedRows == height) {
+            texture.uploadedLevel++;
+            texture.uploadedRows = 0;
+        }
+    }
+    return true;
+}
+
+void AssetStreamer::update(double budgetMilliseconds)
+{
+    auto start = std::chrono::steady_clock::now();
+    frameDeadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double, std::milli>(budgetMilliseconds));
+    lastFrameBytes = 0;
+
+    // Queue finished decodes for upload, keeping the request order
+    size_t stillDecoding = 0;
+    for (Request &request : decoding) {
+        AssetState state = request.asset().state();
+        if (state == ASSET_DECODED) {
+            // Copies of a texture already known are found here, in request order, so
+            // the texture they share is always further ahead in the upload queue
+            if (request.texture)
+                request.texture->shared = textures->shareContent(request.texture->material,
+                                                                 request.texture->image.contentHash);
+            uploads.push_back(request);
+        } else if (state == ASSET_FAILED) {
+            std::cerr << "Failed to stream " << request.asset().filename << std::endl;
+            if (request.texture)
+                dropTexture(*request.texture);
+        } else {
+            decoding[stillDecoding++] = request;
+        }
+    }
+    decoding.resize(stillDecoding);
+    if (uploads.empty()) {
+        lastFrameMilliseconds = 0.0;
+        return;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.get());
+    // Staged rows are tightly packed, whatever their width
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    while (!uploads.empty() && !outOfTime()) {
+        Request request = uploads.front();
+        StreamedAsset &asset = request.asset();
+        size_t bytesBefore = lastFrameBytes;
+        auto uploadStart = std::chrono::steady_clock::now();
+        bool done = request.mesh ? uploadMesh(*request.mesh) : uploadTexture(*request.texture);
+        asset.uploadMilliseconds += millisecondsSince(uploadStart);
+        asset.uploadedBytes += lastFrameBytes - bytesBefore;
+        if (lastFrameBytes > bytesBefore)
+            asset.uploadFrames++;
+        if (!done)
+            break;
+
+        uploads.pop_front();
+        std::string description;
+        if (request.texture)
+            description = request.texture->shared ? "a copy of a texture already loaded; "
+                                                  : describeTexture(request.texture->image) + "; ";
+        // The CPU copies can go now; cooked files stay mapped only as long as someone uses them
+        if (request.mesh) {
+            request.mesh->packed = PackedMesh();
+        } else {
+            textures->markResident(request.texture->material);
+            request.texture->image = DecodedTexture();
+        }
+        asset.status.store(ASSET_RESIDENT, std::memory_order_release);
+        std::cout << fmt::format("Streamed {}: {}decoded in {:.1f} ms, {:.1f} MB uploaded in {:.2f} ms over {} "
+                                 "frames, resident {:.1f} ms after the request.", asset.filename, description,
+                                 asset.decodeMilliseconds, asset.uploadedBytes / double(1 << 20),
+                                 asset.uploadMilliseconds, asset.uploadFrames, millisecondsSince(asset.requested))
+                  << std::endl;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    // The copies reading this frame's section have all been issued
+    if (frameStaging != nullptr)
+        staging.endFrame();
+    frameStaging = nullptr;
+    frameStagingUsed = 0;
+    lastFrameMilliseconds = millisecondsSince(start);
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bounds.hpp"
+#include "geometryPool.hpp"
+#include "jobSystem.hpp"
+#include "persistentBuffer.hpp"
+#include "textureCache.hpp"
+#include "textureLoader.hpp"
+
+// Where a streamed asset is. States only ever move forwards.
+enum AssetState {
+    ASSET_DECODING,  // Waiting for or running on a decode thread
+    ASSET_DECODED,   // In memory, waiting for its turn to upload
+    ASSET_UPLOADING, // Partly copied to the GPU
+    ASSET_RESIDENT,  // Ready to draw with
+    ASSET_FAILED     // Couldn't be read; there is nothing to upload
+};
+
+// What both kinds of request share. A decode thread fills in the asset and
+// then publishes it through the state, so everything the decoder writes may
+// be read once state() is ASSET_DECODED or later.
+struct StreamedAsset {
+    std::string filename;
+
+    AssetState state() const { return AssetState(status.load(std::memory_order_acquire)); }
+    bool resident() const { return state() == ASSET_RESIDENT; }
+
+    std::atomic<int> status{ASSET_DECODING};
+    std::chrono::steady_clock::time_point requested;
+    double decodeMilliseconds = 0.0;
+    // Render thread time spent staging and issuing the copies
+    double uploadMilliseconds = 0.0;
+    size_t uploadedBytes = 0;
+    unsigned int uploadFrames = 0;
+};
+
+struct StreamedMesh : StreamedAsset {
+    std::string baseDir;
+
+    // Filled in by the decoder
+    AABB bounds;
+    BoundingSphere boundingSphere;
+    std::string diffuseTexName;
+    bool cooked = false;
+    PackedMesh packed;
+
+    // The mesh's range of the pool, filled while uploading. Once the mesh is
+    // resident the requester owns it and releases it like any other range.
+    GeometryRange geometry;
+    unsigned int uploadedVertices = 0;
+    unsigned int uploadedIndices = 0;
+};
+
+struct StreamedTexture : StreamedAsset {
+    // Filled in by the decoder
+    DecodedTexture image;
+
+    // The texture's entry in the TextureCache, holding a reference for each
+    // requester. Once the texture is resident each requester releases its
+    // reference like any other; if it fails, the streamer releases them.
+    MaterialIndex material = NO_MATERIAL;
+    unsigned int requesters = 1;
+    // The image turned out to be loaded already under another name, so there is nothing to upload
+    bool shared = false;
+    unsigned int uploadedLevel = 0;
+    unsigned int uploadedRows = 0;
+};
+
+// Loads meshes and textures without stalling the render thread. Files are read
+// and decoded by a pool of decode threads of its own, so they never hold up the
+// per-frame jobs, and the results are copied to the GPU a slice at a time from
+// update(): through a persistently mapped staging buffer, with the GL reading
+// it as a pixel unpack buffer for textures and as a copy source for meshes.
+// Callers keep drawing placeholders until their handle says ASSET_RESIDENT.
+// Textures go through a TextureCache, so requests for a file that is loaded
+// or on its way already share it rather than reading it again.
+class AssetStreamer {
+public:
+    // Each frame's uploads are staged in one section of the staging ring buffer,
+    // so stagingBytesPerFrame also limits how much can be uploaded per frame
+    void init(GeometryPool &pool, TextureCache &textures, unsigned int decodeThreads,
+              size_t stagingBytesPerFrame = 8 << 20);
+    // Waits for running decodes and drops unfinished uploads
+    void destroy();
+
+    std::shared_ptr<StreamedMesh> requestMesh(const std::string &filename, const std::string &baseDir);
+    std::shared_ptr<StreamedTexture> requestTexture(const std::string &filename);
+
+    // Uploads decoded assets, oldest request first, until budgetMilliseconds
+    // have been spent or this frame's staging space is used up. Whatever is
+    // left carries on next frame. Call once a frame on the GL thread.
+    void update(double budgetMilliseconds);
+
+    // Whether every request so far has become resident or failed
+    bool idle() const { return decoding.empty() && uploads.empty(); }
+    size_t pendingCount() const { return decoding.size() + uploads.size(); }
+
+    // Bytes staged and time spent by the last update()
+    size_t lastFrameBytes = 0;
+    double lastFrameMilliseconds = 0.0;
+
+private:
+    // Exactly one of the two is set
+    struct Request {
+        std::shared_ptr<StreamedMesh> mesh;
+        std::shared_ptr<StreamedTexture> texture;
+        StreamedAsset &asset() const { return mesh ? static_cast<StreamedAsset&>(*mesh) : *texture; }
+    };
+
+    bool uploadMesh(StreamedMesh &mesh);
+    bool uploadTexture(StreamedTexture &texture);
+    size_t stagingSpace();
+    GLintptr stage(const void *data, size_t size);
+    bool outOfTime() const;
+    // Gives up on a texture that couldn't be read, dropping its requesters' references
+    void dropTexture(StreamedTexture &texture);
+
+    GeometryPool *pool = nullptr;
+    TextureCache *textures = nullptr;
+    std::unique_ptr<JobSystem> decodeJobs;
+    JobCounter decodeCounter;
+
+    PersistentRingBuffer staging;
+    size_t stagingBytesPerFrame = 0;
+    // This frame's section of the staging buffer, claimed on first use
+    unsigned char *frameStaging = nullptr;
+    size_t frameStagingUsed = 0;
+    std::chrono::steady_clock::time_point frameDeadline;
+
+    // In request order
+    std::vector<Request> decoding;
+    std::deque<Request> uploads;
+};
+
+// The streamer used for scene assets. Call init() once a GL context exists.
+AssetStreamer &sharedAssetStreamer();
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+// Axis-aligned bounding box. A default constructed box is empty: min > max,
+// so growing it by any point gives that point.
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool isEmpty() const { return min.x > max.x; }
+    // Covers everything; used for geometry of unknown size so it is never culled
+    bool isUnbounded() const { return min.x == -FLT_MAX; }
+
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 extent() const { return (max - min) * 0.5f; }
+
+    void grow(const glm::vec3 &point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+    void grow(const AABB &other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    static AABB unbounded() {
+        AABB box;
+        box.min = glm::vec3(-FLT_MAX);
+        box.max = glm::vec3(FLT_MAX);
+        return box;
+    }
+
+    static AABB fromPoints(const std::vector<glm::vec3> &points) {
+        AABB box;
+        for (const glm::vec3 &point : points)
+            box.grow(point);
+        return box;
+    }
+};
+
+// The box around `box` after transforming it by `matrix` (Arvo's method)
+inline AABB transformAABB(const glm::mat4 &matrix, const AABB &box) {
+    if (box.isEmpty() || box.isUnbounded())
+        return box;
+    glm::vec3 center = glm::vec3(matrix * glm::vec4(box.center(), 1.0f));
+    glm::vec3 extent = box.extent();
+    glm::vec3 newExtent;
+    for (int row = 0; row < 3; row++) {
+        newExtent[row] = std::fabs(matrix[0][row]) * extent.x
+                       + std::fabs(matrix[1][row]) * extent.y
+                       + std::fabs(matrix[2][row]) * extent.z;
+    }
+    AABB result;
+    result.min = center - newExtent;
+    result.max = center + newExtent;
+    return result;
+}
+
+struct BoundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = -1.0f;  // Negative when empty
+
+    // Centered on the points' bounding box, so not minimal, but never more
+    // than sqrt(3) times too large
+    static BoundingSphere fromPoints(const std::vector<glm::vec3> &points) {
+        BoundingSphere sphere;
+        if (points.empty())
+            return sphere;
+        sphere.center = AABB::fromPoints(points).center();
+        float radiusSquared = 0.0f;
+        for (const glm::vec3 &point : points) {
+            glm::vec3 offset = point - sphere.center;
+            radiusSquared = std::fmax(radiusSquared, glm::dot(offset, offset));
+        }
+        sphere.radius = std::sqrt(radiusSquared);
+        return sphere;
+    }
+};
+
+// The six planes of a view frustum, as (normal, distance) with normals
+// pointing inwards. Not normalised; only the sign of a distance is used.
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+// Extracts the frustum planes of a view-projection matrix (Gribb & Hartmann)
+inline Frustum frustumFromMatrix(const glm::mat4 &viewProjection) {
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; i++)
+        row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+    Frustum frustum;
+    frustum.planes[0] = row[3] + row[0];  // Left
+    frustum.planes[1] = row[3] - row[0];  // Right
+    frustum.planes[2] = row[3] + row[1];  // Bottom
+    frustum.planes[3] = row[3] - row[1];  // Top
+    frustum.planes[4] = row[3] + row[2];  // Near
+    frustum.planes[5] = row[3] - row[2];  // Far
+    return frustum;
+}
+
+enum FrustumTest {
+    OUTSIDE_FRUSTUM, INTERSECTS_FRUSTUM, INSIDE_FRUSTUM
+};
+
+inline FrustumTest testAABB(const Frustum &frustum, const AABB &box) {
+    if (box.isUnbounded())
+        return INTERSECTS_FRUSTUM;
+    glm::vec3 center = box.center();
+    glm::vec3 extent = box.extent();
+    FrustumTest result = INSIDE_FRUSTUM;
+    for (const glm::vec4 &plane : frustum.planes) {
+        glm::vec3 normal(plane);
+        float distance = glm::dot(normal, center) + plane.w;
+        float radius = glm::dot(glm::abs(normal), extent);
+        if (distance + radius < 0.0f)
+            return OUTSIDE_FRUSTUM;
+        if (distance - radius < 0.0f)
+            result = INTERSECTS_FRUSTUM;
+    }
+    return result;
+}
@@ -0,0 +1,302 @@
+#include "cookedAssets.hpp"
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static const char MESH_MAGIC[4] = {'G', 'B', 'M', 'S'};
+static const char TEXTURE_MAGIC[4] = {'G', 'B', 'T', 'X'};
+
+static bool statFile(const std::string &path, std::uint64_t &size, std::int64_t &modifiedTime)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+    size = std::uint64_t(info.st_size);
+    modifiedTime = std::int64_t(info.st_mtime);
+    return true;
+}
+
+bool describeCookedSource(const std::string &sourcePath, CookedSource &source)
+{
+    source = CookedSource();
+    if (sourcePath.size() >= sizeof(source.path)) {
+        std::cerr << "Source path too long to record in a cooked file: " << sourcePath << std::endl;
+        return false;
+    }
+    std::strncpy(source.path, sourcePath.c_str(), sizeof(source.path) - 1);
+    if (!statFile(sourcePath, source.size, source.modifiedTime))
+        return false;
+    MappedFile file;
+    if (source.size > 0 && !file.open(sourcePath))
+        return false;
+    source.contentHash = hashBytes(file.data(), file.size());
+    return true;
+}
+
+static bool isSourceFresh(const CookedSource &recorded)
+{
+    std::string path(recorded.path, strnlen(recorded.path, sizeof(recorded.path)));
+    std::uint64_t size;
+    std::int64_t modifiedTime;
+    if (!statFile(path, size, modifiedTime))
+        return true;
+    if (size != recorded.size)
+        return false;
+    if (modifiedTime == recorded.modifiedTime)
+        return true;
+    CookedSource current;
+    return describeCookedSource(path, current) && current.contentHash == recorded.contentHash;
+}
+
+// Checks the parts shared by all cooked files. `headerSize` is the size of the
+// full header of the expected type.
+static bool validateHeader(const MappedFile &file, const char (&magic)[4], size_t headerSize)
+{
+    if (file.size() < headerSize)
+        return false;
+    const CookedHeader *header = reinterpret_cast<const CookedHeader*>(file.data());
+    if (std::memcmp(header->magic, magic, sizeof(magic)) != 0 || header->version != COOKED_FORMAT_VERSION
+        || header->sourceCount > MAX_COOKED_SOURCES)
+        return false;
+    for (unsigned int i = 0; i < header->sourceCount; i++) {
+        if (!isSourceFresh(header->sources[i]))
+            return false;
+    }
+    return true;
+}
+
+static bool inFile(const MappedFile &file, std::uint64_t offset, std::uint64_t size)
+{
+    return offset <= file.size() && size <= file.size() - offset;
+}
+
+bool isCookedFileFresh(const std::string &cookedPath)
+{
+    MappedFile file;
+    if (!file.open(cookedPath) || file.size() < sizeof(CookedHeader))
+        return false;
+    const CookedHeader *header = reinterpret_cast<const CookedHeader*>(file.data());
+    if (std::memcmp(header->magic, MESH_MAGIC, 4) == 0)
+        return validateHeader(file, MESH_MAGIC, sizeof(CookedMeshHeader));
+    return validateHeader(file, TEXTURE_MAGIC, sizeof(CookedTextureHeader));
+}
+
+PositionQuantization CookedMesh::quantization() const
+{
+    PositionQuantization result;
+    result.scale = glm::vec3(header->positionScale[0], header->positionScale[1], header->positionScale[2]);
+    result.offset = glm::vec3(header->positionOffset[0], header->positionOffset[1], header->positionOffset[2]);
+    return result;
+}
+
+AABB CookedMesh::bounds() const
+{
+    AABB result;
+    result.min = glm::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]);
+    result.max = glm::vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]);
+    return result;
+}
+
+BoundingSphere CookedMesh::boundingSphere() const
+{
+    BoundingSphere result;
+    result.center = glm::vec3(header->sphereCenter[0], header->sphereCenter[1], header->sphereCenter[2]);
+    result.radius = header->sphereRadius;
+    return result;
+}
+
+static bool validLods(const CookedMeshHeader &header)
+{
+    if (header.lodCount == 0 || header.lodCount > MAX_MESH_LODS)
+        return false;
+    for (unsigned int level = 0; level < header.lodCount; level++) {
+        const CookedLod &lod = header.lods[level];
+        if (lod.firstIndex > header.indexCount || lod.indexCount > header.indexCount - lod.firstIndex)
+            return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const CookedMesh> openCookedMesh(const std::string &cookedPath)
+{
+    std::shared_ptr<CookedMesh> mesh = std::make_shared<CookedMesh>();
+    if (!mesh->file.open(cookedPath))
+        return nullptr;
+    if (!validateHeader(mesh->file, MESH_MAGIC, sizeof(CookedMeshHeader))) {
+        std::cout << "Ignoring stale cooked mesh " << cookedPath << "; run glowbox_cook to rebuild it." << std::endl;
+        return nullptr;
+    }
+    const CookedMeshHeader *header = reinterpret_cast<const CookedMeshHeader*>(mesh->file.data());
+    if (!inFile(mesh->file, header->vertexOffset, std::uint64_t(header->vertexCount) * sizeof(PackedVertex))
+        || !inFile(mesh->file, header->indexOffset, std::uint64_t(header->indexCount) * indexSize(header->indexType))
+        || header->indexType != indexTypeFor(header->vertexCount) || !validLods(*header)) {
+        std::cerr << "Malformed cooked mesh: " << cookedPath << std::endl;
+        return nullptr;
+    }
+    mesh->header = header;
+    mesh->vertices = reinterpret_cast<const PackedVertex*>(mesh->file.data() + header->vertexOffset);
+    mesh->indices = mesh->file.data() + header->indexOffset;
+    return mesh;
+}
+
+std::shared_ptr<const CookedTexture> openCookedTexture(const std::string &cookedPath)
+{
+    std::shared_ptr<CookedTexture> texture = std::make_shared<CookedTexture>();
+    if (!texture->file.open(cookedPath))
+        return nullptr;
+    if (!validateHeader(texture->file, TEXTURE_MAGIC, sizeof(CookedTextureHeader))) {
+        std::cout << "Ignoring stale cooked texture " << cookedPath << "; run glowbox_cook to rebuild it." << std::endl;
+        return nullptr;
+    }
+    const CookedTextureHeader *header = reinterpret_cast<const CookedTextureHeader*>(texture->file.data());
+    TextureEncoding encoding = TextureEncoding(header->encoding);
+    bool valid = header->mipCount > 0 && header->mipCount <= MAX_COOKED_MIPS && header->encoding <= TEXTURE_BC4;
+    for (unsigned int level = 0; valid && level < header->mipCount; level++) {
+        const CookedMip &mip = header->mips[level];
+        valid = inFile(texture->file, mip.offset, mip.size)
+             && mip.size == encodedImageSize(encoding, mip.width, mip.height, header->channels);
+    }
+    if (!valid) {
+        std::cerr << "Malformed cooked texture: " << cookedPath << std::endl;
+        return nullptr;
+    }
+    texture->header = header;
+    return texture;
+}
+
+static std::uint64_t alignPayload(std::uint64_t offset)
+{
+    return (offset + COOKED_PAYLOAD_ALIGNMENT - 1) & ~std::uint64_t(COOKED_PAYLOAD_ALIGNMENT - 1);
+}
+
+static bool fillCommonHeader(CookedHeader &header, const char (&magic)[4], const std::vector<std::string> &sources)
+{
+    if (sources.size() > MAX_COOKED_SOURCES) {
+        std::cerr << "Too many sources for one cooked file" << std::endl;
+        return false;
+    }
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = COOKED_FORMAT_VERSION;
+    header.sourceCount = std::uint32_t(sources.size());
+    for (size_t i = 0; i < sources.size(); i++) {
+        if (!describeCookedSource(sources[i], header.sources[i])) {
+            std::cerr << "Could not read cooked asset source: " << sources[i] << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Writes the file next to its destination and renames it into place, so a
+// failed or interrupted cook never leaves a truncated file behind
+static bool writeFileAtomically(const std::string &path, const std::vector<unsigned char> &contents)
+{
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+        stream.write(reinterpret_cast<const char*>(contents.data()), std::streamsize(contents.size()));
+        if (!stream) {
+            std::cerr << "Could not write " << temporaryPath << std::endl;
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+    }
+    std::remove(path.c_str());
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "Could not move " << temporaryPath << " to " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool writeCookedMesh(const std::string &cookedPath, const Mesh &mesh, const std::string &diffuseTexture,
+                     const std::vector<std::string> &sources)
+{
+    CookedMeshHeader header;
+    std::memset(&header, 0, sizeof(header));
+    if (!fillCommonHeader(header.common, MESH_MAGIC, sources))
+        return false;
+    if (diffuseTexture.size() >= sizeof(header.diffuseTexture)) {
+        std::cerr << "Texture name too long to cook: " << diffuseTexture << std::endl;
+        return false;
+    }
+    std::strncpy(header.diffuseTexture, diffuseTexture.c_str(), sizeof(header.diffuseTexture) - 1);
+
+    PositionQuantization quantization = positionQuantizationFor(mesh);
+    AABB bounds = mesh.bounds.isEmpty() ? AABB::fromPoints(mesh.vertices) : mesh.bounds;
+    BoundingSphere sphere = mesh.boundingSphere.radius < 0.0f ? BoundingSphere::fromPoints(mesh.vertices)
+                                                              : mesh.boundingSphere;
+    header.vertexCount = std::uint32_t(mesh.vertices.size());
+    header.indexCount = std::uint32_t(mesh.indices.size());
+    header.indexType = indexTypeFor(mesh.vertices.size());
+    for (int axis = 0; axis < 3; axis++) {
+        header.positionScale[axis] = quantization.scale[axis];
+        header.positionOffset[axis] = quantization.offset[axis];
+        header.boundsMin[axis] = bounds.min[axis];
+        header.boundsMax[axis] = bounds.max[axis];
+        header.sphereCenter[axis] = sphere.center[axis];
+    }
+    header.sphereRadius = sphere.radius;
+    if (mesh.lods.empty()) {
+        header.lodCount = 1;
+        header.lods[0].indexCount = header.indexCount;
+    } else {
+        header.lodCount = std::uint32_t(std::min(mesh.lods.size(), size_t(MAX_MESH_LODS)));
+        for (unsigned int level = 0; level < header.lodCount; level++) {
+            header.lods[level].firstIndex = mesh.lods[level].firstIndex;
+            header.lods[level].indexCount = mesh.lods[level].indexCount;
+            header.lods[level].error = mesh.lods[level].error;
+        }
+    }
+    header.vertexOffset = alignPayload(sizeof(header));
+    header.indexOffset = alignPayload(header.vertexOffset + std::uint64_t(header.vertexCount) * sizeof(PackedVertex));
+
+    std::vector<unsigned char> contents(header.indexOffset + header.indexCount * indexSize(header.indexType), 0);
+    std::memcpy(contents.data(), &header, sizeof(header));
+    packVertices(mesh, POSITION_SNORM16, quantization, reinterpret_cast<PackedVertex*>(&contents[header.vertexOffset]));
+    packIndices(mesh.indices, header.indexType, &contents[header.indexOffset]);
+    return writeFileAtomically(cookedPath, contents);
+}
+
+bool writeCookedTexture(const std::string &cookedPath, unsigned int width, unsigned int height, unsigned int channels,
+                        TextureEncoding encoding, bool srgb, const std::vector<std::vector<unsigned char>> &mips,
+                        const std::vector<std::string> &sources)
+{
+    CookedTextureHeader header;
+    std::memset(&header, 0, sizeof(header));
+    if (!fillCommonHeader(header.common, TEXTURE_MAGIC, sources))
+        return false;
+    if (mips.empty() || mips.size() > MAX_COOKED_MIPS) {
+        std::cerr << "Can't cook a texture with " << mips.size() << " mip levels" << std::endl;
+        return false;
+    }
+    header.width = width;
+    header.height = height;
+    header.channels = channels;
+    header.mipCount = std::uint32_t(mips.size());
+    header.encoding = encoding;
+    header.srgb = srgb ? 1 : 0;
+
+    std::uint64_t offset = alignPayload(sizeof(header));
+    for (unsigned int level = 0; level < header.mipCount; level++) {
+        CookedMip &mip = header.mips[level];
+        mip.width = std::max(width >> level, 1u);
+        mip.height = std::max(height >> level, 1u);
+        mip.offset = offset;
+        mip.size = mips[level].size();
+        if (mip.size != encodedImageSize(encoding, mip.width, mip.height, channels)) {
+            std::cerr << "Mip level " << level << " of " << cookedPath << " has the wrong size" << std::endl;
+            return false;
+        }
+        offset = alignPayload(offset + mip.size);
+    }
+
+    std::vector<unsigned char> contents(offset, 0);
+    std::memcpy(contents.data(), &header, sizeof(header));
+    for (unsigned int level = 0; level < header.mipCount; level++)
+        std::memcpy(&contents[header.mips[level].offset], mips[level].data(), mips[level].size());
+    return writeFileAtomically(cookedPath, contents);
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "hash.hpp"
+#include "mappedFile.hpp"
+#include "mesh.h"
+#include "textureCompression.hpp"
+#include "vertexFormat.hpp"
+
+// Cooked assets are written by glowbox_cook next to their source, e.g.
+// sundial.obj.gbmesh, and memory mapped at runtime so the payload can go
+// straight from the mapping to the GPU. All fields are little endian.
+
+// Bump whenever the layout of cooked files or of PackedVertex changes, so
+// older files are treated as stale and rebuilt
+const std::uint32_t COOKED_FORMAT_VERSION = 3;
+const char COOKED_MESH_EXTENSION[] = ".gbmesh";
+const char COOKED_TEXTURE_EXTENSION[] = ".gbtex";
+
+const unsigned int MAX_COOKED_SOURCES = 4;
+const unsigned int MAX_COOKED_MIPS = 16;
+// Payloads start at multiples of this, so they can be read in place
+const unsigned int COOKED_PAYLOAD_ALIGNMENT = 16;
+
+// A file a cooked asset was built from. Size and modification time are a
+// cheap first check; when they differ (after a fresh checkout, say) the
+// content hash decides whether the cooked file is stale.
+struct CookedSource {
+    char path[256];  // As given to the cooker, relative to its working directory
+    std::uint64_t size;
+    std::int64_t modifiedTime;
+    std::uint64_t contentHash;
+};
+
+struct CookedHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t sourceCount;
+    std::uint32_t padding;
+    CookedSource sources[MAX_COOKED_SOURCES];
+};
+
+// A level of detail, as a range of the mesh's indices; see MeshLod
+struct CookedLod {
+    std::uint32_t firstIndex;
+    std::uint32_t indexCount;
+    float error;
+};
+
+struct CookedMeshHeader {
+    CookedHeader common;  // magic "GBMS"
+    std::uint32_t vertexCount;
+    std::uint32_t indexCount;
+    std::uint32_t indexType;  // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, see indexTypeFor()
+    std::uint32_t padding;
+    float positionScale[3];   // PositionQuantization of the POSITION_SNORM16 vertices
+    float positionOffset[3];
+    float boundsMin[3];
+    float boundsMax[3];
+    float sphereCenter[3];
+    float sphereRadius;
+    std::uint64_t vertexOffset;  // PackedVertex[vertexCount]
+    std::uint64_t indexOffset;   // indexCount indices of indexType
+    std::uint32_t lodCount;      // At least 1
+    CookedLod lods[MAX_MESH_LODS];
+    char diffuseTexture[256];    // From the MTL file, empty if none
+};
+
+struct CookedMip {
+    std::uint64_t offset;
+    std::uint64_t size;
+    std::uint32_t width;
+    std::uint32_t height;
+};
+
+struct CookedTextureHeader {
+    CookedHeader common;  // magic "GBTX"
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t channels;  // 1, 3 or 4 channels in the source image
+    std::uint32_t mipCount;
+    std::uint32_t encoding;  // TextureEncoding of every level; raw rows are tightly packed
+    std::uint32_t srgb;      // Whether the colour channels are sRGB encoded rather than linear
+    CookedMip mips[MAX_COOKED_MIPS];
+};
+
+// A cooked mesh mapped into memory; the pointers point into the mapping
+struct CookedMesh {
+    MappedFile file;
+    const CookedMeshHeader *header = nullptr;
+    const PackedVertex *vertices = nullptr;
+    const void *indices = nullptr;
+
+    PositionQuantization quantization() const;
+    AABB bounds() const;
+    BoundingSphere boundingSphere() const;
+};
+
+struct CookedTexture {
+    MappedFile file;
+    const CookedTextureHeader *header = nullptr;
+
+    const unsigned char *mip(unsigned int level) const { return file.data() + header->mips[level].offset; }
+};
+
+// Fills in the size, time and content hash of a source file. Returns false if it can't be read.
+bool describeCookedSource(const std::string &sourcePath, CookedSource &source);
+
+// Whether the cooked file exists, has the current version and matches all its
+// sources. Sources that are missing altogether are trusted, so cooked files
+// can be shipped without them.
+bool isCookedFileFresh(const std::string &cookedPath);
+
+// Map a cooked file, or return nullptr if it is missing, malformed or stale
+std::shared_ptr<const CookedMesh> openCookedMesh(const std::string &cookedPath);
+std::shared_ptr<const CookedTexture> openCookedTexture(const std::string &cookedPath);
+
+// Write cooked files, recording `sources` for the staleness check. The mesh is
+// packed with POSITION_SNORM16 against its bounds. Texture mips are given from
+// level 0 down, each encoded with `encoding`. Both return false on I/O errors.
+bool writeCookedMesh(const std::string &cookedPath, const Mesh &mesh, const std::string &diffuseTexture,
+                     const std::vector<std::string> &sources);
+bool writeCookedTexture(const std::string &cookedPath, unsigned int width, unsigned int height, unsigned int channels,
+                        TextureEncoding encoding, bool srgb, const std::vector<std::vector<unsigned char>> &mips,
+                        const std::vector<std::string> &sources);
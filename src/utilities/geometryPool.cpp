@@ -0,0 +1,248 @@
+#include "geometryPool.hpp"
+#include "cookedAssets.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+GeometryPool &sharedGeometryPool()
+{
+    static GeometryPool pool;
+    return pool;
+}
+
+// Mappable for writing, so uploads can encode straight into the buffer
+static GLuint createStorage(GLsizeiptr size, const void *data)
+{
+    GLuint buffer;
+    glCreateBuffers(1, &buffer);
+    glNamedBufferStorage(buffer, size, data, GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT);
+    return buffer;
+}
+
+// Meshes needing 32-bit indices are rare, so their buffer starts small
+static const unsigned int INITIAL_WIDE_INDEX_CAPACITY = 1 << 12;
+
+void GeometryPool::init(unsigned int initialVertexCapacity, unsigned int initialIndexCapacity)
+{
+    vertexAllocator = RangeAllocator(initialVertexCapacity);
+    vertexBuffer = createStorage(GLsizeiptr(initialVertexCapacity) * sizeof(PackedVertex), nullptr);
+
+    std::vector<unsigned int> identity(MAX_DRAW_OBJECTS);
+    for (unsigned int i = 0; i < MAX_DRAW_OBJECTS; i++)
+        identity[i] = i;
+    objectIndexBuffer = createStorage(GLsizeiptr(identity.size() * sizeof(unsigned int)), identity.data());
+
+    initIndices(shortIndices, GL_UNSIGNED_SHORT, initialIndexCapacity);
+    initIndices(wideIndices, GL_UNSIGNED_INT, INITIAL_WIDE_INDEX_CAPACITY);
+}
+
+void GeometryPool::initIndices(IndexStorage &storage, GLenum type, unsigned int capacity)
+{
+    storage.type = type;
+    storage.allocator = RangeAllocator(capacity);
+    storage.buffer = createStorage(GLsizeiptr(capacity * indexSize(type)), nullptr);
+
+    glCreateVertexArrays(1, &storage.vao);
+    glVertexArrayVertexBuffer(storage.vao, 0, vertexBuffer, 0, sizeof(PackedVertex));
+    glVertexArrayElementBuffer(storage.vao, storage.buffer);
+    setPackedVertexFormat(storage.vao, 0, POSITION_SNORM16);
+    attachObjectIndices(storage.vao);
+}
+
+void GeometryPool::attachObjectIndices(GLuint otherVAO) const
+{
+    glVertexArrayVertexBuffer(otherVAO, 1, objectIndexBuffer, 0, sizeof(unsigned int));
+    glVertexArrayBindingDivisor(otherVAO, 1, 1);
+    glEnableVertexArrayAttrib(otherVAO, OBJECT_INDEX_ATTRIBUTE);
+    glVertexArrayAttribIFormat(otherVAO, OBJECT_INDEX_ATTRIBUTE, 1, GL_UNSIGNED_INT, 0);
+    glVertexArrayAttribBinding(otherVAO, OBJECT_INDEX_ATTRIBUTE, 1);
+}
+
+void GeometryPool::destroy()
+{
+    for (IndexStorage *storage : {&shortIndices, &wideIndices}) {
+        glDeleteVertexArrays(1, &storage->vao);
+        glDeleteBuffers(1, &storage->buffer);
+        storage->vao = storage->buffer = 0;
+    }
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &objectIndexBuffer);
+    vertexBuffer = objectIndexBuffer = 0;
+}
+
+// Replaces a buffer with a larger one, keeping its contents
+static GLuint growBuffer(GLuint buffer, GLsizeiptr oldSize, GLsizeiptr newSize)
+{
+    GLuint larger = createStorage(newSize, nullptr);
+    glCopyNamedBufferSubData(buffer, larger, 0, 0, oldSize);
+    glDeleteBuffers(1, &buffer);
+    return larger;
+}
+
+void GeometryPool::growVertices(unsigned int minimumCapacity)
+{
+    unsigned int oldCapacity = vertexAllocator.size();
+    unsigned int newCapacity = std::max(2 * oldCapacity, minimumCapacity);
+    vertexBuffer = growBuffer(vertexBuffer, GLsizeiptr(oldCapacity) * sizeof(PackedVertex),
+                              GLsizeiptr(newCapacity) * sizeof(PackedVertex));
+    glVertexArrayVertexBuffer(shortIndices.vao, 0, vertexBuffer, 0, sizeof(PackedVertex));
+    glVertexArrayVertexBuffer(wideIndices.vao, 0, vertexBuffer, 0, sizeof(PackedVertex));
+    vertexAllocator.grow(newCapacity);
+}
+
+void GeometryPool::growIndices(IndexStorage &storage, unsigned int minimumCapacity)
+{
+    unsigned int oldCapacity = storage.allocator.size();
+    unsigned int newCapacity = std::max(2 * oldCapacity, minimumCapacity);
+    size_t size = indexSize(storage.type);
+    storage.buffer = growBuffer(storage.buffer, GLsizeiptr(oldCapacity * size), GLsizeiptr(newCapacity * size));
+    glVertexArrayElementBuffer(storage.vao, storage.buffer);
+    storage.allocator.grow(newCapacity);
+}
+
+GeometryRange GeometryPool::allocate(unsigned int vertexCount, unsigned int indexCount, GLenum indexType)
+{
+    GeometryRange range;
+    range.vertexCount = vertexCount;
+    range.indexCount = indexCount;
+    range.indexType = indexType;
+    IndexStorage &indices = indicesOfType(indexType);
+
+    while (!vertexAllocator.allocate(range.vertexCount, range.baseVertex))
+        growVertices(vertexAllocator.size() + range.vertexCount);
+    while (!indices.allocator.allocate(range.indexCount, range.firstIndex))
+        growIndices(indices, indices.allocator.size() + range.indexCount);
+    return range;
+}
+
+const PackedVertex *PackedMesh::vertices() const
+{
+    return cooked ? cooked->vertices : vertexStorage.data();
+}
+
+const unsigned char *PackedMesh::indices() const
+{
+    return static_cast<const unsigned char*>(cooked ? cooked->indices : indexStorage.data());
+}
+
+void packMesh(const Mesh &mesh, PackedMesh &packed)
+{
+    if (mesh.cooked) {
+        const CookedMeshHeader &header = *mesh.cooked->header;
+        packed.vertexCount = header.vertexCount;
+        packed.indexCount = header.indexCount;
+        packed.indexType = header.indexType;
+        packed.quantization = mesh.cooked->quantization();
+        packed.lodCount = header.lodCount;
+        for (unsigned int level = 0; level < header.lodCount; level++) {
+            const CookedLod &lod = header.lods[level];
+            packed.lods[level] = MeshLod{lod.firstIndex, lod.indexCount, lod.error};
+        }
+        packed.cooked = mesh.cooked;
+        return;
+    }
+
+    packed.vertexCount = unsigned(mesh.vertices.size());
+    packed.indexCount = unsigned(mesh.indices.size());
+    packed.indexType = indexTypeFor(mesh.vertices.size());
+    packed.quantization = positionQuantizationFor(mesh);
+    if (mesh.lods.empty()) {
+        packed.lods[0] = MeshLod{0, packed.indexCount, 0.0f};
+        packed.lodCount = 1;
+    } else {
+        packed.lodCount = std::min(unsigned(mesh.lods.size()), MAX_MESH_LODS);
+        std::copy(mesh.lods.begin(), mesh.lods.begin() + packed.lodCount, packed.lods);
+    }
+    packed.vertexStorage.resize(packed.vertexCount);
+    packVertices(mesh, POSITION_SNORM16, packed.quantization, packed.vertexStorage.data());
+    packed.indexStorage.resize(packed.indexCount * indexSize(packed.indexType));
+    packIndices(mesh.indices, packed.indexType, packed.indexStorage.data());
+}
+
+GeometryRange GeometryPool::upload(const Mesh &mesh)
+{
+    if (mesh.cooked)
+        return upload(*mesh.cooked);
+
+    GeometryRange range = allocate(mesh.vertices.size(), mesh.indices.size(), indexTypeFor(mesh.vertices.size()));
+    range.quantization = positionQuantizationFor(mesh);
+    if (mesh.lods.empty()) {
+        range.lods[0] = MeshLod{0, range.indexCount, 0.0f};
+        range.lodCount = 1;
+    } else {
+        range.lodCount = std::min(unsigned(mesh.lods.size()), MAX_MESH_LODS);
+        std::copy(mesh.lods.begin(), mesh.lods.begin() + range.lodCount, range.lods);
+    }
+    IndexStorage &indices = indicesOfType(range.indexType);
+
+    // Encode straight into the mapped ranges rather than building a copy to upload.
+    // Invalidating the range lets the driver skip waiting on draws of other meshes.
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+    if (range.vertexCount > 0) {
+        void *vertices = glMapNamedBufferRange(vertexBuffer, GLintptr(range.baseVertex) * sizeof(PackedVertex),
+                                               GLsizeiptr(range.vertexCount) * sizeof(PackedVertex), access);
+        packVertices(mesh, POSITION_SNORM16, range.quantization, static_cast<PackedVertex*>(vertices));
+        glUnmapNamedBuffer(vertexBuffer);
+    }
+    // Indices stay relative to the mesh; draws add baseVertex
+    if (range.indexCount > 0) {
+        size_t size = indexSize(range.indexType);
+        void *indexData = glMapNamedBufferRange(indices.buffer, GLintptr(range.firstIndex * size),
+                                                GLsizeiptr(range.indexCount * size), access);
+        packIndices(mesh.indices, range.indexType, indexData);
+        glUnmapNamedBuffer(indices.buffer);
+    }
+    return range;
+}
+
+GeometryRange GeometryPool::upload(const CookedMesh &mesh)
+{
+    const CookedMeshHeader &header = *mesh.header;
+    GeometryRange range = allocate(header.vertexCount, header.indexCount, header.indexType);
+    range.quantization = mesh.quantization();
+    range.lodCount = header.lodCount;
+    for (unsigned int level = 0; level < header.lodCount; level++) {
+        const CookedLod &lod = header.lods[level];
+        range.lods[level] = MeshLod{lod.firstIndex, lod.indexCount, lod.error};
+    }
+    IndexStorage &indices = indicesOfType(range.indexType);
+
+    // Already packed, so the GL copies straight out of the file mapping
+    size_t size = indexSize(range.indexType);
+    glNamedBufferSubData(vertexBuffer, GLintptr(range.baseVertex) * sizeof(PackedVertex),
+                         GLsizeiptr(range.vertexCount) * sizeof(PackedVertex), mesh.vertices);
+    glNamedBufferSubData(indices.buffer, GLintptr(range.firstIndex * size), GLsizeiptr(range.indexCount * size),
+                         mesh.indices);
+    return range;
+}
+
+GeometryRange GeometryPool::reserve(const PackedMesh &mesh)
+{
+    GeometryRange range = allocate(mesh.vertexCount, mesh.indexCount, mesh.indexType);
+    range.quantization = mesh.quantization;
+    range.lodCount = mesh.lodCount;
+    std::copy(mesh.lods, mesh.lods + mesh.lodCount, range.lods);
+    return range;
+}
+
+void GeometryPool::copyVertices(const GeometryRange &range, GLuint source, GLintptr sourceOffset, unsigned int first,
+                                unsigned int count)
+{
+    glCopyNamedBufferSubData(source, vertexBuffer, sourceOffset,
+                             GLintptr(range.baseVertex + first) * sizeof(PackedVertex),
+                             GLsizeiptr(count) * sizeof(PackedVertex));
+}
+
+void GeometryPool::copyIndices(const GeometryRange &range, GLuint source, GLintptr sourceOffset, unsigned int first,
+                               unsigned int count)
+{
+    size_t size = indexSize(range.indexType);
+    glCopyNamedBufferSubData(source, indicesOfType(range.indexType).buffer, sourceOffset,
+                             GLintptr((range.firstIndex + first) * size), GLsizeiptr(count * size));
+}
+
+void GeometryPool::release(const GeometryRange &range)
+{
+    vertexAllocator.release(range.baseVertex, range.vertexCount);
+    indicesOfType(range.indexType).allocator.release(range.firstIndex, range.indexCount);
+}
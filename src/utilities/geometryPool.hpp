@@ -0,0 +1,121 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <vector>
+
+#include "mesh.h"
+#include "rangeAllocator.hpp"
+#include "vertexFormat.hpp"
+
+// Where a mesh lives inside the GeometryPool
+struct GeometryRange {
+    unsigned int baseVertex = 0;
+    unsigned int vertexCount = 0;
+    unsigned int firstIndex = 0;
+    unsigned int indexCount = 0;
+    // GL_UNSIGNED_SHORT for meshes under 65537 vertices, which is nearly all of them
+    GLenum indexType = GL_UNSIGNED_INT;
+    // Maps the mesh's quantised positions back to model space, see PackedVertex
+    PositionQuantization quantization;
+    // Levels of detail, finest first, with firstIndex relative to the range's.
+    // Meshes without any get a single level covering all their indices.
+    MeshLod lods[MAX_MESH_LODS];
+    unsigned int lodCount = 0;
+};
+
+// A mesh already encoded the way the pool stores it, so it can be copied in
+// piecewise. Packing is plain CPU work and can happen on any thread.
+struct PackedMesh {
+    unsigned int vertexCount = 0;
+    unsigned int indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    PositionQuantization quantization;
+    MeshLod lods[MAX_MESH_LODS];
+    unsigned int lodCount = 0;
+
+    // Either encoded into the vectors below or pointing into a cooked file
+    const PackedVertex *vertices() const;
+    const unsigned char *indices() const;
+
+    std::vector<PackedVertex> vertexStorage;
+    std::vector<unsigned char> indexStorage;
+    std::shared_ptr<const CookedMesh> cooked;
+};
+
+// Encodes the mesh, or just refers to its cooked file if it has one
+void packMesh(const Mesh &mesh, PackedMesh &packed);
+
+// Vertex attribute locations, shared with the shaders
+const GLuint POSITION_ATTRIBUTE = 0;
+const GLuint NORMAL_ATTRIBUTE = 1;
+const GLuint TEXCOORD_ATTRIBUTE = 2;
+// Per-instance object index, fed from a buffer holding 0, 1, 2, ... so that
+// the baseInstance of a draw command becomes the index into the object data.
+// Instanced draws read baseInstance + gl_InstanceID, so baseInstance plus the
+// instance count of any command must stay below MAX_DRAW_OBJECTS.
+const GLuint OBJECT_INDEX_ATTRIBUTE = 3;
+const unsigned int MAX_DRAW_OBJECTS = 1 << 20;
+
+// One vertex buffer of PackedVertex and two index buffers, one of 16-bit and
+// one of 32-bit indices, holding many meshes. Each index buffer has its own VAO
+// over the shared vertex buffer, so a pass needs at most two multi-draws.
+// Space is handed out by free-list allocators and the buffers grow (by copying
+// on the GPU) when they run out of room.
+class GeometryPool {
+public:
+    void init(unsigned int initialVertexCapacity = 1 << 16, unsigned int initialIndexCapacity = 1 << 18);
+    void destroy();
+
+    // Meshes loaded from a cooked file are copied straight from their mapping
+    GeometryRange upload(const Mesh &mesh);
+    GeometryRange upload(const CookedMesh &mesh);
+    void release(const GeometryRange &range);
+
+    // Allocates room for the mesh without filling it, for uploads spread over
+    // several frames. Fill it with copyVertices() and copyIndices().
+    GeometryRange reserve(const PackedMesh &mesh);
+    // Copies `count` packed vertices or indices from another buffer, starting
+    // at `sourceOffset` in bytes, to element `first` of the range. The copy
+    // happens on the GPU, so the source can be a staging buffer.
+    void copyVertices(const GeometryRange &range, GLuint source, GLintptr sourceOffset, unsigned int first,
+                      unsigned int count);
+    void copyIndices(const GeometryRange &range, GLuint source, GLintptr sourceOffset, unsigned int first,
+                     unsigned int count);
+
+    // The VAO to draw the range with, chosen by its index type
+    GLuint vertexArray(const GeometryRange &range) const {
+        return range.indexType == GL_UNSIGNED_SHORT ? shortIndices.vao : wideIndices.vao;
+    }
+
+    // Feeds OBJECT_INDEX_ATTRIBUTE of another VAO from the identity buffer,
+    // so meshes outside the pool can be drawn with the same shaders
+    void attachObjectIndices(GLuint otherVAO) const;
+
+private:
+    struct IndexStorage {
+        GLenum type = GL_UNSIGNED_INT;
+        GLuint buffer = 0;
+        GLuint vao = 0;
+        RangeAllocator allocator;
+    };
+
+    GeometryRange allocate(unsigned int vertexCount, unsigned int indexCount, GLenum indexType);
+    void initIndices(IndexStorage &storage, GLenum type, unsigned int capacity);
+    IndexStorage &indicesOfType(GLenum type) {
+        return type == GL_UNSIGNED_SHORT ? shortIndices : wideIndices;
+    }
+    void growVertices(unsigned int minimumCapacity);
+    void growIndices(IndexStorage &storage, unsigned int minimumCapacity);
+
+    GLuint vertexBuffer = 0;
+    GLuint objectIndexBuffer = 0;
+    RangeAllocator vertexAllocator;
+    IndexStorage shortIndices;
+    IndexStorage wideIndices;
+};
+
+// The pool used for scene geometry. Call init() once a GL context exists.
+GeometryPool &sharedGeometryPool();
@@ -1,5 +0,0 @@
-#pragma once
-
-#include "mesh.h"
-
-unsigned int generateBuffer(Mesh &mesh);
\ No newline at end of file
@@ -0,0 +1,56 @@
+#include "gpuTimer.hpp"
+
+void GpuTimer::init(unsigned int regionCount)
+{
+    results.assign(regionCount, 0.0);
+    queries.assign(FRAMES_IN_FLIGHT * regionCount, 0);
+    issued.assign(queries.size(), false);
+    glGenQueries(GLsizei(queries.size()), queries.data());
+    frame = 0;
+}
+
+void GpuTimer::destroy()
+{
+    if (!queries.empty())
+        glDeleteQueries(GLsizei(queries.size()), queries.data());
+    queries.clear();
+    issued.clear();
+    results.clear();
+}
+
+void GpuTimer::begin(unsigned int region)
+{
+    glBeginQuery(GL_TIME_ELAPSED, query(frame, region));
+    issued[frame * results.size() + region] = true;
+}
+
+void GpuTimer::end()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+}
+
+// Reads the frame's results that are ready. Ones that are still not ready
+// when the slot comes round again are dropped rather than waited for.
+void GpuTimer::collect(unsigned int slot)
+{
+    for (unsigned int region = 0; region < results.size(); region++) {
+        size_t index = slot * results.size() + region;
+        if (!issued[index])
+            continue;
+        issued[index] = false;
+        GLuint available = 0;
+        glGetQueryObjectuiv(queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[index], GL_QUERY_RESULT, &nanoseconds);
+        results[region] = double(nanoseconds) / 1.0e6;
+    }
+}
+
+void GpuTimer::endFrame()
+{
+    frame = (frame + 1) % FRAMES_IN_FLIGHT;
+    // The oldest frame's queries have had the longest to complete, and their slots are next
+    collect(frame);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <vector>
+
+// Measures how long the GPU spends on parts of a frame with GL_TIME_ELAPSED
+// queries. Each part is a numbered region. Results are read a few frames
+// after they were measured, once the GPU has them, so measuring never stalls
+// the CPU; the latest result of each region is kept.
+//
+// Time-elapsed queries can't nest, so only one region can be open at a time.
+// Only use it from the GL thread.
+class GpuTimer {
+public:
+    void init(unsigned int regionCount);
+    void destroy();
+
+    void begin(unsigned int region);
+    void end();
+    // Call once per frame, after the last region
+    void endFrame();
+
+    // The latest result, or 0 before the first one arrives
+    double milliseconds(unsigned int region) const { return results[region]; }
+    unsigned int regionCount() const { return unsigned(results.size()); }
+
+private:
+    // Frames a query may take to complete before its slot is reused
+    static const unsigned int FRAMES_IN_FLIGHT = 3;
+
+    GLuint &query(unsigned int frame, unsigned int region) { return queries[frame * results.size() + region]; }
+    void collect(unsigned int slot);
+
+    std::vector<GLuint> queries;
+    std::vector<bool> issued;  // Indexed like queries
+    std::vector<double> results;
+    unsigned int frame = 0;
+};
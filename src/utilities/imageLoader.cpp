@@ -1,41 +1,100 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
 #include "imageLoader.hpp"
+#include "jobSystem.hpp"
+#include "mappedFile.hpp"
+#include <cstring>
 #include <iostream>
 
-// Original source: https://raw.githubusercontent.com/lvandeve/lodepng/master/examples/example_decode.cpp
-PNGImage loadPNGFile(std::string fileName)
+bool readImageInfo(const unsigned char *data, size_t size, unsigned int &width, unsigned int &height,
+                   unsigned int &channels)
 {
-	std::vector<unsigned char> png;
-	std::vector<unsigned char> pixels; //the raw pixels
-	unsigned int width, height;
+    int w, h, c;
+    if (!stbi_info_from_memory(data, int(size), &w, &h, &c))
+        return false;
+    width = unsigned(w);
+    height = unsigned(h);
+    channels = unsigned(c);
+    return true;
+}
 
-	//load and decode
-	unsigned error = lodepng::load_file(png, fileName);
-	if(!error) error = lodepng::decode(pixels, width, height, png);
-
-	//if there's an error, display it
-	if(error) std::cout << "decoder error " << error << ": " << lodepng_error_text(error) << std::endl;
-
-	//the pixels are now in the vector "image", 4 bytes per pixel, ordered RGBARGBA..., use it as texture, draw it, ...
-
-	// Unfortunately, images usually have their origin at the top left.
-	// OpenGL instead defines the origin to be on the _bottom_ left instead, so
-	// here's the world's most inefficient way to flip the image vertically.
+void flipRows(unsigned char *pixels, size_t rowSize, unsigned int height)
+{
+    std::unique_ptr<unsigned char[]> temporary(new unsigned char[rowSize]);
+    for (unsigned int row = 0; row < height / 2; row++) {
+        unsigned char *top = pixels + row * rowSize;
+        unsigned char *bottom = pixels + (height - 1 - row) * rowSize;
+        std::memcpy(temporary.get(), top, rowSize);
+        std::memcpy(top, bottom, rowSize);
+        std::memcpy(bottom, temporary.get(), rowSize);
+    }
+}
 
-	// You're welcome :)
+bool decodeImage(const unsigned char *data, size_t size, Image &image, const ImageDecodeOptions &options)
+{
+    int width, height, fileChannels;
+    unsigned char *decoded = stbi_load_from_memory(data, int(size), &width, &height, &fileChannels,
+                                                   int(options.channels));
+    if (decoded == nullptr)
+        return false;
+    image.width = unsigned(width);
+    image.height = unsigned(height);
+    image.channels = options.channels != 0 ? options.channels : unsigned(fileChannels);
+    size_t rowSize = image.rowSize();
 
-	unsigned int widthBytes = 4 * width;
+    if (options.destination == nullptr) {
+        // Keep stb_image's buffer rather than copying it
+        image.storage = std::shared_ptr<unsigned char>(decoded, stbi_image_free);
+        image.pixels = decoded;
+        if (options.flipVertically)
+            flipRows(decoded, rowSize, image.height);
+        return true;
+    }
 
-	for(unsigned int row = 0; row < (height / 2); row++) {
-		for(unsigned int col = 0; col < widthBytes; col++) {
-			std::swap(pixels[row * widthBytes + col], pixels[(height - 1 - row) * widthBytes + col]);
-		}
-	}
+    if (options.destinationSize < image.size()) {
+        stbi_image_free(decoded);
+        std::cerr << "Decoded image does not fit the " << options.destinationSize << " bytes given" << std::endl;
+        return false;
+    }
+    // The copy out of stb_image's buffer flips the rows on the way
+    for (unsigned int row = 0; row < image.height; row++) {
+        unsigned int target = options.flipVertically ? image.height - 1 - row : row;
+        std::memcpy(options.destination + target * rowSize, decoded + row * rowSize, rowSize);
+    }
+    stbi_image_free(decoded);
+    image.storage.reset();
+    image.pixels = options.destination;
+    return true;
+}
 
-	PNGImage image;
-	image.width = width;
-	image.height = height;
-	image.pixels = pixels;
+bool decodeImageFile(const std::string &filename, Image &image, const ImageDecodeOptions &options)
+{
+    MappedFile file;
+    if (!file.open(filename)) {
+        std::cerr << "Failed to read image " << filename << std::endl;
+        return false;
+    }
+    if (!decodeImage(file.data(), file.size(), image, options)) {
+        std::cerr << "Failed to decode image " << filename << ": " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+    return true;
+}
 
-	return image;
+unsigned int decodeImageFiles(std::vector<ImageDecodeRequest> &requests, JobSystem *jobs)
+{
+    auto decodeRange = [&requests](unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; i++)
+            requests[i].decoded = decodeImageFile(requests[i].filename, requests[i].image, requests[i].options);
+    };
+    unsigned int count = unsigned(requests.size());
+    if (jobs)
+        jobs->parallelFor(count, 1, decodeRange);
+    else
+        decodeRange(0, count);
 
-}
\ No newline at end of file
+    unsigned int decoded = 0;
+    for (const ImageDecodeRequest &request : requests)
+        decoded += request.decoded ? 1 : 0;
+    return decoded;
+}
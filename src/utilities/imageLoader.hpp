@@ -1,13 +1,61 @@
 #pragma once
 
-#include "lodepng.h"
-#include <vector>
+#include <cstddef>
+#include <memory>
 #include <string>
+#include <vector>
+
+class JobSystem;
+
+// A decoded image with 8 bits per channel and tightly packed rows
+struct Image {
+    unsigned int width = 0;
+    unsigned int height = 0;
+    unsigned int channels = 0;
+    // Top row first, unless decoded with flipVertically
+    unsigned char *pixels = nullptr;
+    // Owns the pixels, unless they were decoded into memory the caller provided
+    std::shared_ptr<unsigned char> storage;
+
+    size_t rowSize() const { return size_t(width) * channels; }
+    size_t size() const { return rowSize() * height; }
+};
+
+struct ImageDecodeOptions {
+    // Channels to decode to; 0 keeps the file's
+    unsigned int channels = 0;
+    // Bottom row first, as glTexImage2D expects
+    bool flipVertically = false;
+    // Memory to decode into, e.g. a mapped staging buffer, with room for
+    // destinationSize bytes. Without it the image gets memory of its own.
+    unsigned char *destination = nullptr;
+    size_t destinationSize = 0;
+};
+
+// Reads the size and channel count from the header without decoding
+bool readImageInfo(const unsigned char *data, size_t size, unsigned int &width, unsigned int &height,
+                   unsigned int &channels);
+
+// Decodes a PNG, JPEG or any other format stb_image reads from memory. Safe
+// to call from several threads at once. Returns false if the data can't be
+// decoded, or doesn't fit the destination.
+bool decodeImage(const unsigned char *data, size_t size, Image &image,
+                 const ImageDecodeOptions &options = ImageDecodeOptions());
+// The same for a file, which is mapped rather than read
+bool decodeImageFile(const std::string &filename, Image &image,
+                     const ImageDecodeOptions &options = ImageDecodeOptions());
+
+// A file to decode with decodeImageFiles(), and the result
+struct ImageDecodeRequest {
+    std::string filename;
+    ImageDecodeOptions options;
+    Image image;
+    bool decoded = false;
+};
 
-typedef struct PNGImage {
-	unsigned int width;
-	unsigned int height;
-	std::vector<unsigned char> pixels;
-} PNGImage;
+// Decodes every request's file, each as a job of its own if a job system is
+// given, e.g. all six faces of a cubemap at once. Returns how many decoded.
+unsigned int decodeImageFiles(std::vector<ImageDecodeRequest> &requests, JobSystem *jobs = nullptr);
 
-PNGImage loadPNGFile(std::string fileName);
+// Reverses the order of the rows in place, a whole row at a time
+void flipRows(unsigned char *pixels, size_t rowSize, unsigned int height);
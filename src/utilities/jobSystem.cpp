@@ -0,0 +1,121 @@
+#include "jobSystem.hpp"
+
+static thread_local const JobSystem *currentJobSystem = nullptr;
+static thread_local unsigned int currentJobThread = 0;
+
+static std::unique_ptr<JobSystem> &globalJobSystem()
+{
+    static std::unique_ptr<JobSystem> instance(new JobSystem(0));
+    return instance;
+}
+
+JobSystem &jobSystem()
+{
+    return *globalJobSystem();
+}
+
+void initJobSystem(unsigned int threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::thread::hardware_concurrency();
+    if (threadCount == 0)
+        threadCount = 1;
+    globalJobSystem().reset(new JobSystem(threadCount - 1));
+}
+
+JobSystem::JobSystem(unsigned int workerCount)
+{
+    for (unsigned int i = 0; i <= workerCount; i++)
+        queues.emplace_back(new Queue());
+    for (unsigned int i = 1; i <= workerCount; i++)
+        workers.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+unsigned int JobSystem::currentThreadIndex() const
+{
+    // Threads that are neither workers nor the owner share the owner's queue
+    return currentJobSystem == this ? currentJobThread : 0;
+}
+
+void JobSystem::submit(JobCounter &counter, std::function<void()> job)
+{
+    if (workers.empty()) {
+        job();
+        return;
+    }
+    counter.pending++;
+    Queue &queue = *queues[currentThreadIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(Job{std::move(job), &counter});
+    }
+    queuedJobs++;
+    // Taking the lock orders this with a worker checking queuedJobs before it sleeps
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    wakeUp.notify_one();
+}
+
+bool JobSystem::tryRunJob(unsigned int threadIndex)
+{
+    Job job;
+    bool found = false;
+    // Newest first from our own queue, for cache locality with what we just did
+    {
+        Queue &own = *queues[threadIndex];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            found = true;
+        }
+    }
+    // Oldest first from the others, as those tend to be the largest
+    for (size_t offset = 1; !found && offset < queues.size(); offset++) {
+        Queue &victim = *queues[(threadIndex + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            found = true;
+        }
+    }
+    if (!found)
+        return false;
+
+    queuedJobs--;
+    job.function();
+    job.counter->pending--;
+    return true;
+}
+
+void JobSystem::wait(JobCounter &counter)
+{
+    unsigned int threadIndex = currentThreadIndex();
+    while (counter.pending > 0) {
+        if (!tryRunJob(threadIndex))
+            std::this_thread::yield();
+    }
+}
+
+void JobSystem::workerLoop(unsigned int threadIndex)
+{
+    currentJobSystem = this;
+    currentJobThread = threadIndex;
+    while (!stopping) {
+        if (tryRunJob(threadIndex))
+            continue;
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeUp.wait(lock, [this]() { return stopping || queuedJobs > 0; });
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the unfinished jobs of one group, see JobSystem::wait()
+struct JobCounter {
+    std::atomic<int> pending{0};
+};
+
+// A fixed pool of worker threads with one job queue per thread. A thread runs
+// its own newest jobs first and, when it runs dry, steals the oldest jobs of
+// the others. Threads waiting for a counter run jobs in the meantime, so jobs
+// may submit and wait for jobs of their own.
+//
+// With zero workers every job runs right away on the submitting thread, which
+// gives the plain single-threaded behaviour.
+class JobSystem {
+public:
+    explicit JobSystem(unsigned int workerCount);
+    ~JobSystem();
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    // Workers plus the thread that owns the JobSystem
+    unsigned int threadCount() const { return unsigned(workers.size()) + 1; }
+
+    void submit(JobCounter &counter, std::function<void()> job);
+    // Returns once every job submitted with this counter has finished
+    void wait(JobCounter &counter);
+
+    // Calls fn(begin, end) on consecutive ranges of about `grain` items
+    // covering [0, count), spread over all threads, and waits for them
+    template <class Function>
+    void parallelFor(unsigned int count, unsigned int grain, const Function &fn) {
+        if (grain == 0)
+            grain = 1;
+        if (workers.empty() || count <= grain) {
+            if (count > 0)
+                fn(0u, count);
+            return;
+        }
+        JobCounter counter;
+        for (unsigned int begin = 0; begin < count; begin += grain) {
+            unsigned int end = begin + grain < count ? begin + grain : count;
+            submit(counter, [&fn, begin, end]() { fn(begin, end); });
+        }
+        wait(counter);
+    }
+
+private:
+    struct Job {
+        std::function<void()> function;
+        JobCounter *counter;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    void workerLoop(unsigned int threadIndex);
+    bool tryRunJob(unsigned int threadIndex);
+    unsigned int currentThreadIndex() const;
+
+    std::vector<std::thread> workers;
+    // queues[0] belongs to the owning thread, queues[i] to workers[i - 1]
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    std::atomic<int> queuedJobs{0};
+    std::atomic<bool> stopping{false};
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+};
+
+// The job system used for per-frame scene work. Until initJobSystem() is
+// called it has no workers.
+JobSystem &jobSystem();
+// threadCount 0 uses every hardware thread; 1 keeps everything on the calling thread
+void initJobSystem(unsigned int threadCount);
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Bump allocator for data that only lives for one frame.
+// Allocation is a pointer increment; reset() frees everything at once.
+// Objects are never destructed, so only store trivially destructible types.
+// If a frame needs more than the current capacity, extra blocks are taken
+// from the heap and the next reset() grows the main block to fit them all.
+class LinearArena {
+public:
+    explicit LinearArena(size_t initialCapacity = 64 * 1024)
+        : capacity(initialCapacity), used(0), overflowBytes(0), block(new unsigned char[initialCapacity]) {}
+
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        uintptr_t base = reinterpret_cast<uintptr_t>(block.get());
+        size_t offset = ((base + used + alignment - 1) & ~uintptr_t(alignment - 1)) - base;
+        if (offset + size <= capacity) {
+            used = offset + size;
+            return block.get() + offset;
+        }
+        // Out of room this frame; new[] is aligned for any fundamental type
+        overflow.emplace_back(new unsigned char[size]);
+        overflowBytes += size;
+        return overflow.back().get();
+    }
+
+    template <class T>
+    T *allocate(size_t count = 1) {
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void reset() {
+        if (!overflow.empty()) {
+            capacity = 2 * (capacity + overflowBytes);
+            block.reset(new unsigned char[capacity]);
+            overflow.clear();
+            overflowBytes = 0;
+        }
+        used = 0;
+    }
+
+    size_t bytesUsed() const { return used + overflowBytes; }
+
+private:
+    size_t capacity;
+    size_t used;
+    size_t overflowBytes;
+    std::unique_ptr<unsigned char[]> block;
+    std::vector<std::unique_ptr<unsigned char[]>> overflow;
+};
@@ -1,7 +1,22 @@
 #pragma once
 
+#include <memory>
 #include <vector>
 #include <glm/glm.hpp>
+#include "bounds.hpp"
+
+struct CookedMesh;
+
+// One level of detail: a run of Mesh::indices drawing a simplified version of
+// the mesh over the same vertices. error is the largest deviation from the full
+// mesh, in model-space units.
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float error;
+};
+
+const unsigned int MAX_MESH_LODS = 8;
 
 struct Mesh {
     std::vector<glm::vec3> vertices;
@@ -9,4 +24,19 @@ struct Mesh {
     std::vector<glm::vec2> textureCoordinates;
 
     std::vector<unsigned int> indices;
+    // Finest first, see generateLodChain(). Empty means a single level using all the indices.
+    std::vector<MeshLod> lods;
+
+    // Local-space bounds of the vertices, filled in by the loaders and generators
+    AABB bounds;
+    BoundingSphere boundingSphere;
+
+    // Set when the mesh was loaded from a cooked file. The vertices and indices
+    // then stay packed in the file mapping and the vectors above are empty.
+    std::shared_ptr<const CookedMesh> cooked;
+
+    void computeBounds() {
+        bounds = AABB::fromPoints(vertices);
+        boundingSphere = BoundingSphere::fromPoints(vertices);
+    }
 };
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "meshOptimizer.hpp"
+#include <algorithm>
+#include <cmath>
+
+float computeACMR(const std::vector<unsigned int> &indices, unsigned int vertexCount, unsigned int cacheSize)
+{
+    if (indices.empty())
+        return 0.0f;
+    // Time at which each vertex entered the cache; a FIFO hit is an entry newer than `cacheSize` misses ago
+    std::vector<unsigned int> insertedAt(vertexCount, 0);
+    unsigned int misses = 0;
+    for (unsigned int index : indices) {
+        if (insertedAt[index] == 0 || misses + 1 - insertedAt[index] > cacheSize) {
+            misses++;
+            insertedAt[index] = misses;
+        }
+    }
+    return float(misses) / float(indices.size() / 3);
+}
+
+// Scoring constants from Forsyth's paper
+static const int FORSYTH_CACHE_SIZE = 32;
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+static float computeVertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+    if (remainingTriangles == 0)
+        return -1.0f;
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // The vertices of the last triangle get a fixed score, so that
+            // strips of similar triangles aren't preferred over fans
+            score = LAST_TRIANGLE_SCORE;
+        } else {
+            float scaler = 1.0f / float(FORSYTH_CACHE_SIZE - 3);
+            score = std::pow(1.0f - float(cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+        }
+    }
+    // Favour vertices with few triangles left, so that no lone triangles are left behind
+    score += VALENCE_BOOST_SCALE * std::pow(float(remainingTriangles), -VALENCE_BOOST_POWER);
+    return score;
+}
+
+// Scores for the common cases, looked up instead of calling pow() in the inner loop
+static const unsigned int SCORE_TABLE_VALENCE = 32;
+
+struct VertexScoreTable {
+    float scores[FORSYTH_CACHE_SIZE + 1][SCORE_TABLE_VALENCE];
+
+    VertexScoreTable() {
+        for (int position = -1; position < FORSYTH_CACHE_SIZE; position++) {
+            for (unsigned int valence = 0; valence < SCORE_TABLE_VALENCE; valence++)
+                scores[position + 1][valence] = computeVertexScore(position, valence);
+        }
+    }
+};
+
+static float vertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+    static const VertexScoreTable table;
+    if (remainingTriangles < SCORE_TABLE_VALENCE)
+        return table.scores[cachePosition + 1][remainingTriangles];
+    return computeVertexScore(cachePosition, remainingTriangles);
+}
+
+void optimizeVertexCache(std::vector<unsigned int> &indices, unsigned int vertexCount)
+{
+    unsigned int triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Triangles using each vertex, as ranges in one array
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for (unsigned int index : indices)
+        remaining[index]++;
+    std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+    for (unsigned int v = 0; v < vertexCount; v++)
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remaining[v];
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (unsigned int t = 0; t < triangleCount; t++) {
+        for (int corner = 0; corner < 3; corner++) {
+            unsigned int v = indices[3 * t + corner];
+            adjacency[fill[v]++] = t;
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> scores(vertexCount);
+    for (unsigned int v = 0; v < vertexCount; v++)
+        scores[v] = vertexScore(-1, remaining[v]);
+    std::vector<float> triangleScores(triangleCount);
+    for (unsigned int t = 0; t < triangleCount; t++)
+        triangleScores[t] = scores[indices[3 * t]] + scores[indices[3 * t + 1]] + scores[indices[3 * t + 2]];
+    std::vector<unsigned char> emitted(triangleCount, 0);
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    // Room for the cache plus the three vertices of the triangle being added
+    std::vector<unsigned int> cache, newCache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+    unsigned int scanCursor = 0;
+    int bestTriangle = -1;
+    for (unsigned int emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+        if (bestTriangle < 0) {
+            // Nothing in the cache is connected to what's left; take the next
+            // triangle in the original order, which is usually close by
+            while (emitted[scanCursor])
+                scanCursor++;
+            bestTriangle = int(scanCursor);
+        }
+        unsigned int triangle = unsigned(bestTriangle);
+        emitted[triangle] = 1;
+        const unsigned int *corners = &indices[3 * triangle];
+        output.insert(output.end(), corners, corners + 3);
+
+        // Remove the triangle from its vertices' lists of remaining triangles
+        for (int corner = 0; corner < 3; corner++) {
+            unsigned int v = corners[corner];
+            unsigned int *begin = &adjacency[adjacencyOffsets[v]];
+            unsigned int *end = begin + remaining[v];
+            *std::find(begin, end, triangle) = *(end - 1);
+            remaining[v]--;
+        }
+
+        // The triangle's vertices move to the front of the cache
+        newCache.assign(corners, corners + 3);
+        for (unsigned int v : cache) {
+            if (v != corners[0] && v != corners[1] && v != corners[2])
+                newCache.push_back(v);
+        }
+        for (size_t i = 0; i < newCache.size(); i++) {
+            unsigned int v = newCache[i];
+            cachePosition[v] = i < size_t(FORSYTH_CACHE_SIZE) ? int(i) : -1;
+            float newScore = vertexScore(cachePosition[v], remaining[v]);
+            float delta = newScore - scores[v];
+            scores[v] = newScore;
+            for (unsigned int a = 0; a < remaining[v]; a++)
+                triangleScores[adjacency[adjacencyOffsets[v] + a]] += delta;
+        }
+        if (newCache.size() > size_t(FORSYTH_CACHE_SIZE))
+            newCache.resize(FORSYTH_CACHE_SIZE);
+        cache.swap(newCache);
+
+        // The next triangle is the best one touching a cached vertex
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : cache) {
+            for (unsigned int a = 0; a < remaining[v]; a++) {
+                unsigned int candidate = adjacency[adjacencyOffsets[v] + a];
+                if (triangleScores[candidate] > bestScore) {
+                    bestScore = triangleScores[candidate];
+                    bestTriangle = int(candidate);
+                }
+            }
+        }
+    }
+    indices.swap(output);
+}
+
+void optimizeVertexFetch(Mesh &mesh)
+{
+    const unsigned int unassigned = ~0u;
+    std::vector<unsigned int> remap(mesh.vertices.size(), unassigned);
+    unsigned int nextVertex = 0;
+    for (unsigned int &index : mesh.indices) {
+        if (remap[index] == unassigned)
+            remap[index] = nextVertex++;
+        index = remap[index];
+    }
+
+    bool hasNormals = mesh.normals.size() == mesh.vertices.size();
+    bool hasTextureCoordinates = mesh.textureCoordinates.size() == mesh.vertices.size();
+    std::vector<glm::vec3> vertices(nextVertex), normals(hasNormals ? nextVertex : 0);
+    std::vector<glm::vec2> textureCoordinates(hasTextureCoordinates ? nextVertex : 0);
+    for (size_t old = 0; old < remap.size(); old++) {
+        unsigned int index = remap[old];
+        if (index == unassigned)
+            continue;
+        vertices[index] = mesh.vertices[old];
+        if (hasNormals)
+            normals[index] = mesh.normals[old];
+        if (hasTextureCoordinates)
+            textureCoordinates[index] = mesh.textureCoordinates[old];
+    }
+    mesh.vertices.swap(vertices);
+    if (hasNormals)
+        mesh.normals.swap(normals);
+    if (hasTextureCoordinates)
+        mesh.textureCoordinates.swap(textureCoordinates);
+}
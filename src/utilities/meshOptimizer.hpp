@@ -0,0 +1,17 @@
+#pragma once
+
+#include <vector>
+
+#include "mesh.h"
+
+// Average cache miss ratio: vertex shader invocations per triangle, modelled
+// with a FIFO post-transform cache. Ranges from about 0.5 (ideal) to 3.0 (no reuse).
+float computeACMR(const std::vector<unsigned int> &indices, unsigned int vertexCount, unsigned int cacheSize = 16);
+
+// Reorders triangles so that they reuse recently transformed vertices, using
+// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation". Runs in roughly linear time.
+void optimizeVertexCache(std::vector<unsigned int> &indices, unsigned int vertexCount);
+
+// Reorders the vertices of the mesh into the order the index buffer first
+// uses them, so vertex fetches walk memory sequentially. Unused vertices are dropped.
+void optimizeVertexFetch(Mesh &mesh);
@@ -0,0 +1,508 @@
+#include "meshSimplifier.hpp"
+#include "meshOptimizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+// Levels aren't made with fewer triangles than this
+static const unsigned int MIN_LOD_TRIANGLES = 64;
+// A level must have at most this fraction of the previous level's triangles to be kept
+static const double MIN_LOD_REDUCTION = 0.85;
+// Largest error of any level, as a fraction of the mesh's bounding radius
+static const float MAX_LOD_RELATIVE_ERROR = 0.1f;
+// Open borders are held in place by planes through them, weighted so they
+// resist erosion more than the surface does
+static const double BORDER_WEIGHT = 10.0;
+// Collapses that turn a triangle by more than about 80 degrees are rejected
+static const double MIN_NORMAL_COSINE = 0.2;
+
+static const unsigned int NO_VERTEX = ~0u;
+static const unsigned int MANY_VERTICES = ~0u - 1;
+
+// Squared distances to a set of planes, weighted by the area they came from
+struct Quadric {
+    double a00 = 0.0, a11 = 0.0, a22 = 0.0, a01 = 0.0, a02 = 0.0, a12 = 0.0;
+    double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+    double c = 0.0;
+    double weight = 0.0;
+
+    // The plane of points p with dot(normal, p) + d = 0; normal must be unit length
+    void addPlane(const glm::dvec3 &normal, double d, double w)
+    {
+        a00 += w * normal.x * normal.x;
+        a11 += w * normal.y * normal.y;
+        a22 += w * normal.z * normal.z;
+        a01 += w * normal.x * normal.y;
+        a02 += w * normal.x * normal.z;
+        a12 += w * normal.y * normal.z;
+        b0 += w * d * normal.x;
+        b1 += w * d * normal.y;
+        b2 += w * d * normal.z;
+        c += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric &other)
+    {
+        a00 += other.a00; a11 += other.a11; a22 += other.a22;
+        a01 += other.a01; a02 += other.a02; a12 += other.a12;
+        b0 += other.b0; b1 += other.b1; b2 += other.b2;
+        c += other.c;
+        weight += other.weight;
+    }
+
+    // Mean squared distance from p to the planes
+    double evaluate(const glm::dvec3 &p) const
+    {
+        if (weight <= 0.0)
+            return 0.0;
+        double rx = a00 * p.x + a01 * p.y + a02 * p.z;
+        double ry = a01 * p.x + a11 * p.y + a12 * p.z;
+        double rz = a02 * p.x + a12 * p.y + a22 * p.z;
+        double error = p.x * rx + p.y * ry + p.z * rz + 2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+        return std::max(error, 0.0) / weight;
+    }
+};
+
+// What a vertex's position may collapse onto
+enum VertexKind : unsigned char {
+    MANIFOLD_VERTEX,  // Inside the surface, with a single set of attributes; collapses onto any neighbour
+    BORDER_VERTEX,    // On an open border; collapses along it, onto another border or locked vertex
+    SEAM_VERTEX,      // On a UV or normal seam, as two vertices; collapses along the seam
+    LOCKED_VERTEX     // Corners of seams and borders, and anything more tangled; never moves
+};
+
+struct Collapse {
+    unsigned int from;
+    unsigned int to;
+    float error;
+};
+
+// Simplifies one set of triangles step by step. The quadrics are kept between
+// calls, so the error of each level is measured against the original mesh
+// rather than against the level before it.
+class LodSimplifier {
+public:
+    LodSimplifier(const std::vector<glm::vec3> &vertices, const std::vector<unsigned int> &indices);
+
+    // Collapses edges until at most targetIndexCount indices are left or every
+    // remaining collapse would exceed maxError
+    void simplify(size_t targetIndexCount, float maxError);
+
+    const std::vector<unsigned int> &indices() const { return triangles; }
+    // The largest error of any collapse so far
+    float error() const { return largestError; }
+
+private:
+    void findWedges();
+    void buildEdges();
+    bool hasEdge(unsigned int a, unsigned int b) const;
+    bool hasPositionEdge(unsigned int a, unsigned int b) const;
+    void findOpenEdges();
+    void classifyVertices();
+    void computeQuadrics();
+    void buildPositionTriangles();
+
+    unsigned int siblingTarget(unsigned int from, unsigned int to) const;
+    bool canCollapse(unsigned int from, unsigned int to) const;
+    float collapseError(unsigned int from, unsigned int to) const;
+    bool flipsTriangles(unsigned int from, unsigned int to) const;
+
+    const std::vector<glm::vec3> &positions;
+    std::vector<unsigned int> triangles;
+    float largestError = 0.0f;
+
+    // Vertices at the same position are wedges of one corner that differ in
+    // normal or texture coordinates. remap gives the first of them, which
+    // stands for the position; wedge links them in a ring.
+    std::vector<unsigned int> remap;
+    std::vector<unsigned int> wedge;
+    std::vector<unsigned char> kinds;
+    // Summed over the wedges, indexed by the remapped vertex
+    std::vector<Quadric> quadrics;
+
+    // Directed edges of the current triangles, as ranges per vertex
+    std::vector<unsigned int> edgeOffsets;
+    std::vector<unsigned int> edgeTargets;
+    // The vertex after and before each vertex along an open edge, that is one
+    // without a twin in the opposite direction: NO_VERTEX, or MANY_VERTICES
+    // if there is more than one
+    std::vector<unsigned int> openNext;
+    std::vector<unsigned int> openPrevious;
+    // Triangles around each remapped vertex
+    std::vector<unsigned int> triangleOffsets;
+    std::vector<unsigned int> positionTriangles;
+};
+
+static glm::dvec3 toDouble(const glm::vec3 &v)
+{
+    return glm::dvec3(double(v.x), double(v.y), double(v.z));
+}
+
+static double lengthOf(const glm::dvec3 &v)
+{
+    return std::sqrt(glm::dot(v, v));
+}
+
+static bool isVertex(unsigned int v)
+{
+    return v < MANY_VERTICES;
+}
+
+LodSimplifier::LodSimplifier(const std::vector<glm::vec3> &vertices, const std::vector<unsigned int> &indices)
+    : positions(vertices), triangles(indices)
+{
+    findWedges();
+    buildEdges();
+    findOpenEdges();
+    classifyVertices();
+    computeQuadrics();
+}
+
+void LodSimplifier::findWedges()
+{
+    unsigned int vertexCount = unsigned(positions.size());
+    std::vector<unsigned int> order(vertexCount);
+    std::iota(order.begin(), order.end(), 0u);
+    std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+        const glm::vec3 &pa = positions[a], &pb = positions[b];
+        if (pa.x != pb.x) return pa.x < pb.x;
+        if (pa.y != pb.y) return pa.y < pb.y;
+        if (pa.z != pb.z) return pa.z < pb.z;
+        return a < b;
+    });
+    remap.resize(vertexCount);
+    wedge.resize(vertexCount);
+    for (unsigned int begin = 0; begin < vertexCount;) {
+        unsigned int end = begin + 1;
+        while (end < vertexCount && positions[order[end]] == positions[order[begin]])
+            end++;
+        for (unsigned int i = begin; i < end; i++) {
+            remap[order[i]] = order[begin];
+            wedge[order[i]] = order[i + 1 < end ? i + 1 : begin];
+        }
+        begin = end;
+    }
+}
+
+void LodSimplifier::buildEdges()
+{
+    unsigned int vertexCount = unsigned(positions.size());
+    edgeOffsets.assign(vertexCount + 1, 0);
+    for (unsigned int index : triangles)
+        edgeOffsets[index + 1]++;
+    for (unsigned int v = 0; v < vertexCount; v++)
+        edgeOffsets[v + 1] += edgeOffsets[v];
+    edgeTargets.resize(triangles.size());
+    std::vector<unsigned int> fill(edgeOffsets.begin(), edgeOffsets.end() - 1);
+    for (size_t t = 0; t < triangles.size(); t += 3) {
+        for (int corner = 0; corner < 3; corner++)
+            edgeTargets[fill[triangles[t + corner]]++] = triangles[t + (corner + 1) % 3];
+    }
+}
+
+bool LodSimplifier::hasEdge(unsigned int a, unsigned int b) const
+{
+    const unsigned int *begin = &edgeTargets[0] + edgeOffsets[a];
+    const unsigned int *end = &edgeTargets[0] + edgeOffsets[a + 1];
+    return std::find(begin, end, b) != end;
+}
+
+// Whether any wedge of a's position has an edge to any wedge of b's
+bool LodSimplifier::hasPositionEdge(unsigned int a, unsigned int b) const
+{
+    unsigned int v = a;
+    do {
+        for (unsigned int e = edgeOffsets[v]; e < edgeOffsets[v + 1]; e++) {
+            if (remap[edgeTargets[e]] == remap[b])
+                return true;
+        }
+        v = wedge[v];
+    } while (v != a);
+    return false;
+}
+
+void LodSimplifier::findOpenEdges()
+{
+    unsigned int vertexCount = unsigned(positions.size());
+    openNext.assign(vertexCount, NO_VERTEX);
+    openPrevious.assign(vertexCount, NO_VERTEX);
+    for (unsigned int a = 0; a < vertexCount; a++) {
+        for (unsigned int e = edgeOffsets[a]; e < edgeOffsets[a + 1]; e++) {
+            unsigned int b = edgeTargets[e];
+            if (hasEdge(b, a))
+                continue;
+            openNext[a] = openNext[a] == NO_VERTEX ? b : MANY_VERTICES;
+            openPrevious[b] = openPrevious[b] == NO_VERTEX ? a : MANY_VERTICES;
+        }
+    }
+}
+
+void LodSimplifier::classifyVertices()
+{
+    unsigned int vertexCount = unsigned(positions.size());
+    kinds.assign(vertexCount, LOCKED_VERTEX);
+    for (unsigned int v = 0; v < vertexCount; v++) {
+        if (remap[v] != v)
+            continue;
+        unsigned int wedgeCount = 1;
+        for (unsigned int w = wedge[v]; w != v; w = wedge[w])
+            wedgeCount++;
+
+        VertexKind kind = LOCKED_VERTEX;
+        if (wedgeCount == 1) {
+            if (openNext[v] == NO_VERTEX && openPrevious[v] == NO_VERTEX) {
+                kind = MANIFOLD_VERTEX;
+            } else if (isVertex(openNext[v]) && isVertex(openPrevious[v])
+                       && !hasPositionEdge(openNext[v], v) && !hasPositionEdge(v, openPrevious[v])) {
+                // Where a seam ends, the open edges have twins at the same
+                // positions; that vertex stays locked
+                kind = BORDER_VERTEX;
+            }
+        } else if (wedgeCount == 2) {
+            // The seam must continue on both sides with the wedges swapped,
+            // otherwise it also runs along a border or branches
+            unsigned int w = wedge[v];
+            if (isVertex(openNext[v]) && isVertex(openPrevious[v]) && isVertex(openNext[w])
+                && isVertex(openPrevious[w]) && remap[openNext[v]] == remap[openPrevious[w]]
+                && remap[openPrevious[v]] == remap[openNext[w]])
+                kind = SEAM_VERTEX;
+        }
+        unsigned int w = v;
+        do {
+            kinds[w] = kind;
+            w = wedge[w];
+        } while (w != v);
+    }
+}
+
+void LodSimplifier::computeQuadrics()
+{
+    quadrics.assign(positions.size(), Quadric());
+    for (size_t t = 0; t < triangles.size(); t += 3) {
+        glm::dvec3 p0 = toDouble(positions[triangles[t]]);
+        glm::dvec3 p1 = toDouble(positions[triangles[t + 1]]);
+        glm::dvec3 p2 = toDouble(positions[triangles[t + 2]]);
+        glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+        double length = lengthOf(normal);
+        if (length <= 0.0)
+            continue;
+        normal = normal * (1.0 / length);
+        double d = -glm::dot(normal, p0);
+        for (int corner = 0; corner < 3; corner++)
+            quadrics[remap[triangles[t + corner]]].addPlane(normal, d, 0.5 * length);
+
+        // Edges on an open border also get a plane through them, upright on the triangle
+        for (int corner = 0; corner < 3; corner++) {
+            unsigned int a = triangles[t + corner];
+            unsigned int b = triangles[t + (corner + 1) % 3];
+            if (hasPositionEdge(b, a))
+                continue;
+            glm::dvec3 pa = toDouble(positions[a]);
+            glm::dvec3 edge = toDouble(positions[b]) - pa;
+            glm::dvec3 border = glm::cross(edge, normal);
+            double borderLength = lengthOf(border);
+            if (borderLength <= 0.0)
+                continue;
+            border = border * (1.0 / borderLength);
+            double borderD = -glm::dot(border, pa);
+            double weight = BORDER_WEIGHT * glm::dot(edge, edge);
+            quadrics[remap[a]].addPlane(border, borderD, weight);
+            quadrics[remap[b]].addPlane(border, borderD, weight);
+        }
+    }
+}
+
+void LodSimplifier::buildPositionTriangles()
+{
+    unsigned int vertexCount = unsigned(positions.size());
+    triangleOffsets.assign(vertexCount + 1, 0);
+    for (unsigned int index : triangles)
+        triangleOffsets[remap[index] + 1]++;
+    for (unsigned int v = 0; v < vertexCount; v++)
+        triangleOffsets[v + 1] += triangleOffsets[v];
+    positionTriangles.resize(triangles.size());
+    std::vector<unsigned int> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+    for (size_t i = 0; i < triangles.size(); i++)
+        positionTriangles[fill[remap[triangles[i]]]++] = unsigned(i / 3);
+}
+
+// For a seam collapse from -> to, the vertex the other wedge of `from` moves
+// to: its neighbour along the seam at the position of `to`
+unsigned int LodSimplifier::siblingTarget(unsigned int from, unsigned int to) const
+{
+    unsigned int sibling = wedge[from];
+    if (isVertex(openNext[sibling]) && remap[openNext[sibling]] == remap[to])
+        return openNext[sibling];
+    if (isVertex(openPrevious[sibling]) && remap[openPrevious[sibling]] == remap[to])
+        return openPrevious[sibling];
+    return NO_VERTEX;
+}
+
+bool LodSimplifier::canCollapse(unsigned int from, unsigned int to) const
+{
+    if (remap[from] == remap[to])
+        return false;
+    // Earlier collapses can leave odd topology behind, so the open edges are
+    // checked again rather than trusting the original classification
+    bool alongOpenEdge = openNext[from] == to || openPrevious[from] == to;
+    bool singleOpenEdges = isVertex(openNext[from]) && isVertex(openPrevious[from]);
+    switch (kinds[from]) {
+    case MANIFOLD_VERTEX:
+        return openNext[from] == NO_VERTEX && openPrevious[from] == NO_VERTEX;
+    case BORDER_VERTEX:
+        return singleOpenEdges && alongOpenEdge && (kinds[to] == BORDER_VERTEX || kinds[to] == LOCKED_VERTEX);
+    case SEAM_VERTEX:
+        return singleOpenEdges && alongOpenEdge && (kinds[to] == SEAM_VERTEX || kinds[to] == LOCKED_VERTEX)
+            && siblingTarget(from, to) != NO_VERTEX;
+    default:
+        return false;
+    }
+}
+
+float LodSimplifier::collapseError(unsigned int from, unsigned int to) const
+{
+    Quadric merged = quadrics[remap[from]];
+    merged.add(quadrics[remap[to]]);
+    return float(std::sqrt(merged.evaluate(toDouble(positions[to]))));
+}
+
+// Whether moving from's position onto to's would flip or crush a triangle
+// that survives the collapse
+bool LodSimplifier::flipsTriangles(unsigned int from, unsigned int to) const
+{
+    unsigned int fromPosition = remap[from];
+    glm::dvec3 target = toDouble(positions[to]);
+    for (unsigned int i = triangleOffsets[fromPosition]; i < triangleOffsets[fromPosition + 1]; i++) {
+        const unsigned int *corners = &triangles[3 * positionTriangles[i]];
+        glm::dvec3 before[3], after[3];
+        bool collapses = false;
+        for (int corner = 0; corner < 3; corner++) {
+            before[corner] = toDouble(positions[corners[corner]]);
+            after[corner] = remap[corners[corner]] == fromPosition ? target : before[corner];
+            collapses |= remap[corners[corner]] == remap[to];
+        }
+        if (collapses)
+            continue;
+        glm::dvec3 oldNormal = glm::cross(before[1] - before[0], before[2] - before[0]);
+        glm::dvec3 newNormal = glm::cross(after[1] - after[0], after[2] - after[0]);
+        double oldLength = lengthOf(oldNormal);
+        if (oldLength <= 0.0)
+            continue;
+        if (glm::dot(oldNormal, newNormal) <= MIN_NORMAL_COSINE * oldLength * lengthOf(newNormal))
+            return true;
+    }
+    return false;
+}
+
+void LodSimplifier::simplify(size_t targetIndexCount, float maxError)
+{
+    unsigned int vertexCount = unsigned(positions.size());
+    std::vector<Collapse> candidates;
+    std::vector<unsigned int> collapseTo(vertexCount);
+    std::vector<unsigned char> locked(vertexCount);
+
+    // Each pass makes the cheapest collapses that don't touch each other's
+    // triangles, then rebuilds the adjacency
+    while (triangles.size() > targetIndexCount) {
+        buildEdges();
+        findOpenEdges();
+        buildPositionTriangles();
+
+        candidates.clear();
+        for (size_t t = 0; t < triangles.size(); t += 3) {
+            for (int corner = 0; corner < 3; corner++) {
+                unsigned int a = triangles[t + corner];
+                unsigned int b = triangles[t + (corner + 1) % 3];
+                // Interior edges are seen from both sides; consider them once
+                if (a > b && hasEdge(b, a))
+                    continue;
+                bool forward = canCollapse(a, b), backward = canCollapse(b, a);
+                if (!forward && !backward)
+                    continue;
+                float forwardError = forward ? collapseError(a, b) : 0.0f;
+                float backwardError = backward ? collapseError(b, a) : 0.0f;
+                if (forward && (!backward || forwardError <= backwardError))
+                    candidates.push_back(Collapse{a, b, forwardError});
+                else
+                    candidates.push_back(Collapse{b, a, backwardError});
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const Collapse &x, const Collapse &y) {
+            if (x.error != y.error) return x.error < y.error;
+            if (x.from != y.from) return x.from < y.from;
+            return x.to < y.to;
+        });
+
+        std::iota(collapseTo.begin(), collapseTo.end(), 0u);
+        std::fill(locked.begin(), locked.end(), 0);
+        size_t triangleBudget = (triangles.size() - targetIndexCount) / 3;
+        size_t removed = 0;
+        unsigned int collapsed = 0;
+        for (const Collapse &collapse : candidates) {
+            if (collapse.error > maxError || removed >= triangleBudget)
+                break;
+            unsigned int fromPosition = remap[collapse.from], toPosition = remap[collapse.to];
+            if (locked[fromPosition] || locked[toPosition] || flipsTriangles(collapse.from, collapse.to))
+                continue;
+
+            collapseTo[collapse.from] = collapse.to;
+            if (kinds[collapse.from] == SEAM_VERTEX)
+                collapseTo[wedge[collapse.from]] = siblingTarget(collapse.from, collapse.to);
+            quadrics[toPosition].add(quadrics[fromPosition]);
+            largestError = std::max(largestError, collapse.error);
+            collapsed++;
+            removed += kinds[collapse.from] == BORDER_VERTEX ? 1 : 2;
+
+            // The flip test looked at these triangles as they are now, so
+            // nothing else may move them until the next pass
+            for (unsigned int i = triangleOffsets[fromPosition]; i < triangleOffsets[fromPosition + 1]; i++) {
+                const unsigned int *corners = &triangles[3 * positionTriangles[i]];
+                for (int corner = 0; corner < 3; corner++)
+                    locked[remap[corners[corner]]] = 1;
+            }
+        }
+        if (collapsed == 0)
+            break;
+
+        // Triangles with two corners at one position have collapsed away
+        size_t kept = 0;
+        for (size_t t = 0; t < triangles.size(); t += 3) {
+            unsigned int a = collapseTo[triangles[t]];
+            unsigned int b = collapseTo[triangles[t + 1]];
+            unsigned int c = collapseTo[triangles[t + 2]];
+            if (remap[a] == remap[b] || remap[b] == remap[c] || remap[c] == remap[a])
+                continue;
+            triangles[kept++] = a;
+            triangles[kept++] = b;
+            triangles[kept++] = c;
+        }
+        triangles.resize(kept);
+    }
+}
+
+void generateLodChain(Mesh &mesh, unsigned int maxLods)
+{
+    maxLods = std::min(maxLods, MAX_MESH_LODS);
+    unsigned int vertexCount = unsigned(mesh.vertices.size());
+    std::vector<unsigned int> chain = mesh.indices;
+    mesh.lods.assign(1, MeshLod{0, unsigned(chain.size()), 0.0f});
+    if (maxLods <= 1 || chain.size() / 3 < 2 * MIN_LOD_TRIANGLES)
+        return;
+
+    AABB bounds = AABB::fromPoints(mesh.vertices);
+    float maxError = MAX_LOD_RELATIVE_ERROR * 0.5f * glm::length(bounds.max - bounds.min);
+    LodSimplifier simplifier(mesh.vertices, mesh.indices);
+    size_t previousCount = mesh.indices.size();
+    while (mesh.lods.size() < maxLods && previousCount / 3 >= 2 * MIN_LOD_TRIANGLES) {
+        simplifier.simplify(previousCount / 6 * 3, maxError);
+        if (double(simplifier.indices().size()) > MIN_LOD_REDUCTION * double(previousCount))
+            break;
+        std::vector<unsigned int> level = simplifier.indices();
+        optimizeVertexCache(level, vertexCount);
+        mesh.lods.push_back(MeshLod{unsigned(chain.size()), unsigned(level.size()), simplifier.error()});
+        chain.insert(chain.end(), level.begin(), level.end());
+        previousCount = level.size();
+    }
+    mesh.indices.swap(chain);
+}
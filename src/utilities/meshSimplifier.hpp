@@ -0,0 +1,18 @@
+#pragma once
+
+#include "mesh.h"
+
+// Appends progressively simplified copies of the mesh's triangles to
+// mesh.indices, each with about half the triangles of the one before, and
+// describes them in mesh.lods with the original triangles as level 0.
+//
+// Levels are made by collapsing edges onto existing vertices in order of
+// quadric error, so all of them share the mesh's vertex buffer. Open borders
+// only slide along themselves, and vertices on UV or normal seams only collapse
+// along the seam, moving both sides together, so textures don't smear across
+// seams and no cracks open up. The chain stops early once a level can't be
+// simplified much further without exceeding a tenth of the mesh's size in error.
+//
+// Each level is reordered for the vertex cache. Call this after
+// optimizeVertexCache() and before optimizeVertexFetch().
+void generateLodChain(Mesh &mesh, unsigned int maxLods = MAX_MESH_LODS);
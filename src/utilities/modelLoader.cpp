@@ -1,41 +1,116 @@
 #include "modelLoader.hpp"
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
+#include "meshOptimizer.hpp"
+#include "meshSimplifier.hpp"
+#include "cookedAssets.hpp"
+#include "objParser.hpp"
+#include "jobSystem.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <fmt/format.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/epsilon.hpp>
 
-void computeNormalsForMesh(Mesh &mesh) {
-    // Initialize normals to zero.
-    mesh.normals.resize(mesh.vertices.size(), glm::vec3(0.0f));
-
-    // Iterate over each triangle.
-    for (size_t i = 0; i < mesh.indices.size(); i += 3) {
-        unsigned int i0 = mesh.indices[i];
-        unsigned int i1 = mesh.indices[i + 1];
-        unsigned int i2 = mesh.indices[i + 2];
-
-        const glm::vec3 &v0 = mesh.vertices[i0];
-        const glm::vec3 &v1 = mesh.vertices[i1];
-        const glm::vec3 &v2 = mesh.vertices[i2];
-
-        // Compute the face normal.
-        glm::vec3 edge1 = v1 - v0;
-        glm::vec3 edge2 = v2 - v0;
-        glm::vec3 faceNormal = glm::normalize(glm::cross(edge1, edge2));
-
-        // Add the face normal to each vertex normal.
-        mesh.normals[i0] += faceNormal;
-        mesh.normals[i1] += faceNormal;
-        mesh.normals[i2] += faceNormal;
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define NORMALS_USE_SSE 1
+#include <xmmintrin.h>
+#endif
+
+// Triangles or vertices handled by one job when computing normals in parallel
+static const unsigned int NORMALS_GRAIN = 1 << 14;
+
+// Unit normals of triangles [begin, end). Degenerate triangles get a zero
+// normal, so they don't affect their vertices.
+static void computeFaceNormals(const Mesh &mesh, unsigned int begin, unsigned int end, glm::vec3 *faceNormals) {
+    const unsigned int *indices = mesh.indices.data();
+    const glm::vec3 *vertices = mesh.vertices.data();
+    unsigned int t = begin;
+#if NORMALS_USE_SSE
+    // Four triangles at a time, one per SIMD lane
+    for (; t + 4 <= end; t += 4) {
+        alignas(16) float corner[3][3][4];
+        for (int lane = 0; lane < 4; lane++) {
+            for (int k = 0; k < 3; k++) {
+                const glm::vec3 &v = vertices[indices[3 * (t + lane) + k]];
+                corner[k][0][lane] = v.x;
+                corner[k][1][lane] = v.y;
+                corner[k][2][lane] = v.z;
+            }
+        }
+        __m128 e1x = _mm_sub_ps(_mm_load_ps(corner[1][0]), _mm_load_ps(corner[0][0]));
+        __m128 e1y = _mm_sub_ps(_mm_load_ps(corner[1][1]), _mm_load_ps(corner[0][1]));
+        __m128 e1z = _mm_sub_ps(_mm_load_ps(corner[1][2]), _mm_load_ps(corner[0][2]));
+        __m128 e2x = _mm_sub_ps(_mm_load_ps(corner[2][0]), _mm_load_ps(corner[0][0]));
+        __m128 e2y = _mm_sub_ps(_mm_load_ps(corner[2][1]), _mm_load_ps(corner[0][1]));
+        __m128 e2z = _mm_sub_ps(_mm_load_ps(corner[2][2]), _mm_load_ps(corner[0][2]));
+        __m128 nx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+        __m128 ny = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+        __m128 nz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+        __m128 nonZero = _mm_cmpgt_ps(length, _mm_setzero_ps());
+        __m128 safeLength = _mm_or_ps(_mm_and_ps(nonZero, length), _mm_andnot_ps(nonZero, _mm_set1_ps(1.0f)));
+        alignas(16) float normal[3][4];
+        _mm_store_ps(normal[0], _mm_and_ps(nonZero, _mm_div_ps(nx, safeLength)));
+        _mm_store_ps(normal[1], _mm_and_ps(nonZero, _mm_div_ps(ny, safeLength)));
+        _mm_store_ps(normal[2], _mm_and_ps(nonZero, _mm_div_ps(nz, safeLength)));
+        for (int lane = 0; lane < 4; lane++)
+            faceNormals[t + lane] = glm::vec3(normal[0][lane], normal[1][lane], normal[2][lane]);
     }
-    // Normalize all vertex normals.
-    for (auto &n : mesh.normals) {
-        n = glm::normalize(n);
+#endif
+    for (; t < end; t++) {
+        const glm::vec3 &v0 = vertices[indices[3 * t]];
+        glm::vec3 n = glm::cross(vertices[indices[3 * t + 1]] - v0, vertices[indices[3 * t + 2]] - v0);
+        float length = std::sqrt(glm::dot(n, n));
+        faceNormals[t] = length > 0.0f ? n / length : glm::vec3(0.0f);
     }
 }
 
-Mesh loadOBJModel(const std::string &filename, const std::string &baseDir, std::string &diffuseTexName) {
+void computeNormalsForMesh(Mesh &mesh, JobSystem *jobs) {
+    unsigned int vertexCount = unsigned(mesh.vertices.size());
+    unsigned int triangleCount = unsigned(mesh.indices.size() / 3);
+    auto forRange = [jobs](unsigned int count, const std::function<void(unsigned int, unsigned int)> &fn) {
+        if (jobs != nullptr)
+            jobs->parallelFor(count, NORMALS_GRAIN, fn);
+        else if (count > 0)
+            fn(0, count);
+    };
+
+    std::vector<glm::vec3> faceNormals(triangleCount);
+    forRange(triangleCount, [&](unsigned int begin, unsigned int end) {
+        computeFaceNormals(mesh, begin, end, faceNormals.data());
+    });
+
+    // The triangles around each vertex, in triangle order, so every vertex can
+    // sum its own normals without any writes conflicting between jobs
+    std::vector<unsigned int> firstTriangle(vertexCount + 1, 0);
+    for (unsigned int index : mesh.indices)
+        firstTriangle[index + 1]++;
+    for (unsigned int v = 0; v < vertexCount; v++)
+        firstTriangle[v + 1] += firstTriangle[v];
+    std::vector<unsigned int> vertexTriangles(mesh.indices.size());
+    std::vector<unsigned int> cursor(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t i = 0; i < mesh.indices.size(); i++)
+        vertexTriangles[cursor[mesh.indices[i]]++] = unsigned(i / 3);
+
+    mesh.normals.resize(vertexCount);
+    forRange(vertexCount, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int v = begin; v < end; v++) {
+            glm::vec3 sum(0.0f);
+            for (unsigned int i = firstTriangle[v]; i < firstTriangle[v + 1]; i++)
+                sum += faceNormals[vertexTriangles[i]];
+            float length = std::sqrt(glm::dot(sum, sum));
+            mesh.normals[v] = length > 0.0f ? sum / length : glm::vec3(0.0f);
+        }
+    });
+}
+
+bool readOBJWithTinyobj(const std::string &filename, const std::string &baseDir, Mesh &mesh,
+                        std::string &diffuseTexName) {
+    mesh = Mesh();
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
     std::vector<tinyobj::material_t> materials;
@@ -51,14 +126,45 @@ Mesh loadOBJModel(const std::string &filename, const std::string &baseDir, std::
     }
     if (!ret) {
         std::cerr << "Failed to load/parse OBJ file: " << filename << std::endl;
-        return Mesh();
+        return false;
     }
 
-    Mesh mesh;
-    // Iterate over shapes and build the mesh.
+    // As in readOBJ, normals and texture coordinates are only read if every
+    // corner has them, so that there is one of each per vertex or none at all
+    size_t indexCount = 0, normalCorners = 0, texcoordCorners = 0;
+    for (const tinyobj::shape_t &shape : shapes) {
+        indexCount += shape.mesh.indices.size();
+        for (const tinyobj::index_t &index : shape.mesh.indices) {
+            normalCorners += index.normal_index >= 0;
+            texcoordCorners += index.texcoord_index >= 0;
+        }
+    }
+    bool hasNormals = indexCount > 0 && normalCorners == indexCount;
+    bool hasTexcoords = indexCount > 0 && texcoordCorners == indexCount;
+
+    // Welded meshes usually have far fewer vertices than indices, but reserving
+    // for the worst case avoids any reallocation while loading
+    mesh.indices.reserve(indexCount);
+    mesh.vertices.reserve(indexCount);
+    if (hasNormals)
+        mesh.normals.reserve(indexCount);
+    if (hasTexcoords)
+        mesh.textureCoordinates.reserve(indexCount);
+
+    // Iterate over shapes and build the mesh. Corners that share position,
+    // normal and texture coordinates share one vertex.
+    size_t positionCount = attrib.vertices.size() / 3;
+    VertexWeldTable weldTable(std::min(indexCount, positionCount + positionCount / 4));
     for (size_t s = 0; s < shapes.size(); s++) {
         for (size_t i = 0; i < shapes[s].mesh.indices.size(); i++) {
             tinyobj::index_t index = shapes[s].mesh.indices[i];
+            bool isNew;
+            OBJCorner corner = {index.vertex_index, hasTexcoords ? index.texcoord_index : -1,
+                                hasNormals ? index.normal_index : -1};
+            unsigned int vertexIndex = weldTable.findOrInsert(corner, unsigned(mesh.vertices.size()), isNew);
+            mesh.indices.push_back(vertexIndex);
+            if (!isNew)
+                continue;
             // Vertex
             glm::vec3 vertex;
             vertex.x = attrib.vertices[3 * index.vertex_index + 0];
@@ -66,7 +172,7 @@ Mesh loadOBJModel(const std::string &filename, const std::string &baseDir, std::
             vertex.z = attrib.vertices[3 * index.vertex_index + 2];
             mesh.vertices.push_back(vertex);
             // Normal (if available)
-            if (!attrib.normals.empty() && index.normal_index >= 0) {
+            if (hasNormals) {
                 glm::vec3 normal;
                 normal.x = attrib.normals[3 * index.normal_index + 0];
                 normal.y = attrib.normals[3 * index.normal_index + 1];
@@ -74,32 +180,76 @@ Mesh loadOBJModel(const std::string &filename, const std::string &baseDir, std::
                 mesh.normals.push_back(normal);
             }
             // Texture Coordinates (if available)
-            if (!attrib.texcoords.empty() && index.texcoord_index >= 0) {
+            if (hasTexcoords) {
                 glm::vec2 texcoord;
                 texcoord.x = attrib.texcoords[2 * index.texcoord_index + 0];
                 // Flip the V coordinate to match OpenGL's expected origin.
                 texcoord.y = 1.0f - attrib.texcoords[2 * index.texcoord_index + 1];
                 mesh.textureCoordinates.push_back(texcoord);
             }
-            // Since we're reordering vertices, simply add the new index.
-            mesh.indices.push_back(static_cast<unsigned int>(mesh.indices.size()));
         }
     }
+    mesh.vertices.shrink_to_fit();
+    mesh.normals.shrink_to_fit();
+    mesh.textureCoordinates.shrink_to_fit();
     
     if (!materials.empty()) {
-    const tinyobj::material_t &mat = materials[0];
-    if (!mat.diffuse_texname.empty()) {
-        diffuseTexName = mat.diffuse_texname;
-        std::cout << "Found diffuse texture in MTL: " << diffuseTexName << std::endl;
-    } else {
-        std::cout << "No diffuse texture specified in the MTL file." << std::endl;
+        const tinyobj::material_t &mat = materials[0];
+        if (!mat.diffuse_texname.empty()) {
+            diffuseTexName = mat.diffuse_texname;
+            std::cout << "Found diffuse texture in MTL: " << diffuseTexName << std::endl;
+        } else {
+            std::cout << "No diffuse texture specified in the MTL file." << std::endl;
+        }
     }
+    return true;
+}
+
+Mesh parseOBJModel(const std::string &filename, const std::string &baseDir, std::string &diffuseTexName,
+                   JobSystem *jobs) {
+    Mesh mesh;
+    if (!readOBJ(filename, baseDir, mesh, diffuseTexName, jobs))
+        return Mesh();
+
+    // Normals are only kept if every face has them
     if (mesh.normals.empty()) {
         std::cout << "No normals found, computing normals..." << std::endl;
-        computeNormalsForMesh(mesh);
+        computeNormalsForMesh(mesh, jobs);
     }
+
+    // Reorder for the post-transform cache, simplify the result into the lower
+    // levels of detail, then lay the vertices out in the order they're used
+    size_t cornerCount = mesh.indices.size();
+    float acmrBefore = computeACMR(mesh.indices, mesh.vertices.size());
+    optimizeVertexCache(mesh.indices, mesh.vertices.size());
+    float acmrAfter = computeACMR(mesh.indices, mesh.vertices.size());
+    std::cout << fmt::format("Welded {} corners into {} vertices; ACMR {:.3f} before and {:.3f} after reordering.",
+                             cornerCount, mesh.vertices.size(), acmrBefore, acmrAfter) << std::endl;
+    generateLodChain(mesh);
+    optimizeVertexFetch(mesh);
+    std::string levels;
+    for (const MeshLod &lod : mesh.lods)
+        levels += fmt::format("{}{} ({:.4f})", levels.empty() ? "" : ", ", lod.indexCount / 3, lod.error);
+    std::cout << fmt::format("Generated {} levels of detail, in triangles (error): {}.", mesh.lods.size(), levels)
+              << std::endl;
+
+    mesh.computeBounds();
+    return mesh;
 }
 
-    
+Mesh loadOBJModel(const std::string &filename, const std::string &baseDir, std::string &diffuseTexName,
+                  JobSystem *jobs) {
+    std::shared_ptr<const CookedMesh> cooked = openCookedMesh(filename + COOKED_MESH_EXTENSION);
+    if (!cooked)
+        return parseOBJModel(filename, baseDir, diffuseTexName, jobs);
+
+    Mesh mesh;
+    mesh.bounds = cooked->bounds();
+    mesh.boundingSphere = cooked->boundingSphere();
+    mesh.cooked = cooked;
+    const CookedMeshHeader &header = *cooked->header;
+    diffuseTexName = std::string(header.diffuseTexture, strnlen(header.diffuseTexture, sizeof(header.diffuseTexture)));
+    std::cout << fmt::format("Mapped cooked mesh {}{} with {} vertices and {} indices.",
+                             filename, COOKED_MESH_EXTENSION, header.vertexCount, header.indexCount) << std::endl;
     return mesh;
 }
@@ -2,6 +2,27 @@
 #include "mesh.h"
 #include <string>
 
+class JobSystem;
+
 // Loads an OBJ file and converts it into a Mesh.
 // If the MTL file is found and contains a diffuse texture, the filename is returned via diffuseTexName.
-Mesh loadOBJModel(const std::string &filename, const std::string &baseDir, std::string &diffuseTexName);
+// An up to date cooked file (filename + COOKED_MESH_EXTENSION) is mapped instead of parsing
+// the OBJ; the mesh then only carries the bounds and Mesh::cooked.
+// Parsing and normal generation are spread over `jobs` when given.
+Mesh loadOBJModel(const std::string &filename, const std::string &baseDir, std::string &diffuseTexName,
+                  JobSystem *jobs = nullptr);
+
+// Always parses the OBJ, ignoring any cooked file
+Mesh parseOBJModel(const std::string &filename, const std::string &baseDir, std::string &diffuseTexName,
+                   JobSystem *jobs = nullptr);
+
+// Parses the OBJ with tinyobjloader into a welded mesh, without normals
+// generation or reordering. Kept as the reference readOBJ is benchmarked against.
+bool readOBJWithTinyobj(const std::string &filename, const std::string &baseDir, Mesh &mesh,
+                        std::string &diffuseTexName);
+
+// Fills mesh.normals with the normalised sum of the unit normals of each
+// vertex's triangles. Face normals are computed four at a time with SSE where
+// available; with a job system both passes run in parallel. The result doesn't
+// depend on the thread count.
+void computeNormalsForMesh(Mesh &mesh, JobSystem *jobs = nullptr);
@@ -0,0 +1,463 @@
+#include "objParser.hpp"
+#include "jobSystem.hpp"
+#include "mappedFile.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "positions are copied into Mesh::vertices as raw floats");
+
+// Bytes of OBJ text parsed by one job
+static const size_t CHUNK_BYTES = 1 << 22;
+
+// What one chunk of the file contains. Corner indices are absolute and zero
+// based, except those listed in the relative* arrays: those came from negative
+// indices and are relative to the chunk's first element until merged.
+struct OBJChunk {
+    std::vector<float> positions;  // xyz
+    std::vector<float> texcoords;  // uv
+    std::vector<float> normals;    // xyz
+    std::vector<int> cornerPositions;
+    std::vector<int> cornerTexcoords;
+    std::vector<int> cornerNormals;
+    std::vector<unsigned int> relativePositions;
+    std::vector<unsigned int> relativeTexcoords;
+    std::vector<unsigned int> relativeNormals;
+    // Corners that do have a texture coordinate or normal
+    size_t texcoordCorners = 0;
+    size_t normalCorners = 0;
+    std::vector<std::string> materialLibraries;
+    size_t malformedLines = 0;
+};
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static const char *skipSpaces(const char *p, const char *end)
+{
+    while (p < end && isSpace(*p))
+        p++;
+    return p;
+}
+
+// Parses a decimal float such as -1.25e-3. Up to 19 significant digits are
+// gathered exactly in an integer and scaled once by an exact power of ten, so
+// the result is within an ulp of the correctly rounded one. Returns p unchanged
+// if there is no number.
+static const char *parseFloat(const char *p, const char *end, float &value)
+{
+    static const double powersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    std::uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+    for (; p < end && isDigit(*p); p++, any = true) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + unsigned(*p - '0');
+            digits += mantissa != 0;
+        } else {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && isDigit(*p); p++, any = true) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + unsigned(*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+    if (!any) {
+        value = 0.0f;
+        return start;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+'))
+            negativeExponent = *q++ == '-';
+        if (q < end && isDigit(*q)) {
+            int explicitExponent = 0;
+            for (; q < end && isDigit(*q); q++)
+                explicitExponent = explicitExponent < 10000 ? explicitExponent * 10 + (*q - '0') : explicitExponent;
+            exponent += negativeExponent ? -explicitExponent : explicitExponent;
+            p = q;
+        }
+    }
+
+    double result = double(mantissa);
+    while (exponent > 22) {
+        result *= 1e22;
+        exponent -= 22;
+    }
+    while (exponent < -22) {
+        result /= 1e22;
+        exponent += 22;
+    }
+    result = exponent >= 0 ? result * powersOfTen[exponent] : result / powersOfTen[-exponent];
+    value = float(negative ? -result : result);
+    return p;
+}
+
+static const char *parseInt(const char *p, const char *end, int &value)
+{
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    if (p == end || !isDigit(*p)) {
+        value = 0;
+        return start;
+    }
+    long long result = 0;
+    for (; p < end && isDigit(*p); p++)
+        result = result < (1ll << 40) ? result * 10 + (*p - '0') : result;
+    value = int(negative ? -result : result);
+    return p;
+}
+
+// Reads `count` floats into `out`; missing ones are zero
+static bool parseFloats(const char *p, const char *end, int count, std::vector<float> &out)
+{
+    bool complete = true;
+    for (int i = 0; i < count; i++) {
+        p = skipSpaces(p, end);
+        float value;
+        const char *next = parseFloat(p, end, value);
+        complete &= next != p;
+        p = next;
+        out.push_back(value);
+    }
+    return complete;
+}
+
+// A face corner before triangulation
+struct PolygonCorner {
+    int index[3];        // Position, texture coordinate, normal; zero based
+    bool present[3];
+    bool relative[3];    // Came from a negative index, so relative to the chunk
+};
+
+// Parses one face corner, "v", "v/vt", "v//vn" or "v/vt/vn". Returns p
+// unchanged if there is no valid position index.
+static const char *parseCorner(const char *p, const char *end, const OBJChunk &chunk, PolygonCorner &corner)
+{
+    int raw[3] = {0, 0, 0};
+    const char *start = p;
+    p = parseInt(p, end, raw[0]);
+    if (p == start || raw[0] == 0)
+        return start;
+    if (p < end && *p == '/') {
+        p = parseInt(p + 1, end, raw[1]);
+        if (p < end && *p == '/')
+            p = parseInt(p + 1, end, raw[2]);
+    }
+    // Negative indices count back from the latest element, which is only known within the chunk
+    size_t elementsSoFar[3] = {chunk.positions.size() / 3, chunk.texcoords.size() / 2, chunk.normals.size() / 3};
+    for (int a = 0; a < 3; a++) {
+        corner.present[a] = raw[a] != 0;
+        corner.relative[a] = raw[a] < 0;
+        corner.index[a] = raw[a] > 0 ? raw[a] - 1 : raw[a] < 0 ? int(elementsSoFar[a]) + raw[a] : -1;
+    }
+    return p;
+}
+
+static void emitCorner(OBJChunk &chunk, const PolygonCorner &corner)
+{
+    std::vector<int> *corners[3] = {&chunk.cornerPositions, &chunk.cornerTexcoords, &chunk.cornerNormals};
+    std::vector<unsigned int> *relative[3] = {&chunk.relativePositions, &chunk.relativeTexcoords,
+                                              &chunk.relativeNormals};
+    for (int a = 0; a < 3; a++) {
+        if (corner.relative[a])
+            relative[a]->push_back(unsigned(corners[a]->size()));
+        corners[a]->push_back(corner.index[a]);
+    }
+    chunk.texcoordCorners += corner.present[1];
+    chunk.normalCorners += corner.present[2];
+}
+
+// Parses a face, fanning polygons into triangles: (0, 1, 2), (0, 2, 3), ...
+static bool parseFace(const char *p, const char *end, OBJChunk &chunk, std::vector<PolygonCorner> &polygon)
+{
+    polygon.clear();
+    while ((p = skipSpaces(p, end)) < end) {
+        PolygonCorner corner;
+        const char *next = parseCorner(p, end, chunk, corner);
+        if (next == p)
+            return false;
+        p = next;
+        polygon.push_back(corner);
+    }
+    if (polygon.size() < 3)
+        return false;
+    for (size_t i = 1; i + 1 < polygon.size(); i++) {
+        emitCorner(chunk, polygon[0]);
+        emitCorner(chunk, polygon[i]);
+        emitCorner(chunk, polygon[i + 1]);
+    }
+    return true;
+}
+
+static void parseChunk(const char *p, const char *end, OBJChunk &chunk)
+{
+    std::vector<PolygonCorner> polygon;
+    while (p < end) {
+        const char *lineEnd = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+        if (lineEnd == nullptr)
+            lineEnd = end;
+        const char *line = skipSpaces(p, lineEnd);
+        p = lineEnd + 1;
+        if (line + 1 >= lineEnd)
+            continue;
+
+        bool valid = true;
+        if (line[0] == 'v' && isSpace(line[1])) {
+            valid = parseFloats(line + 2, lineEnd, 3, chunk.positions);
+        } else if (line[0] == 'v' && line[1] == 't' && line + 2 < lineEnd && isSpace(line[2])) {
+            valid = parseFloats(line + 3, lineEnd, 2, chunk.texcoords);
+        } else if (line[0] == 'v' && line[1] == 'n' && line + 2 < lineEnd && isSpace(line[2])) {
+            valid = parseFloats(line + 3, lineEnd, 3, chunk.normals);
+        } else if (line[0] == 'f' && isSpace(line[1])) {
+            valid = parseFace(line + 2, lineEnd, chunk, polygon);
+        } else if (lineEnd - line > 7 && std::strncmp(line, "mtllib", 6) == 0 && isSpace(line[6])) {
+            const char *name = skipSpaces(line + 7, lineEnd);
+            const char *nameEnd = lineEnd;
+            while (nameEnd > name && isSpace(nameEnd[-1]))
+                nameEnd--;
+            if (nameEnd > name)
+                chunk.materialLibraries.emplace_back(name, nameEnd);
+        }
+        if (!valid)
+            chunk.malformedLines++;
+    }
+}
+
+// The map_Kd of the first material in the MTL file, empty if there is none
+static std::string readDiffuseTexture(const std::string &path)
+{
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cout << "Warning: material library " << path << " not found." << std::endl;
+        return std::string();
+    }
+    const char *p = reinterpret_cast<const char*>(file.data());
+    const char *end = p + file.size();
+    int materials = 0;
+    while (p < end) {
+        const char *lineEnd = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+        if (lineEnd == nullptr)
+            lineEnd = end;
+        const char *line = skipSpaces(p, lineEnd);
+        p = lineEnd + 1;
+        if (lineEnd - line > 6 && std::strncmp(line, "newmtl", 6) == 0 && isSpace(line[6])) {
+            if (++materials > 1)
+                break;
+        } else if (lineEnd - line > 6 && std::strncmp(line, "map_Kd", 6) == 0 && isSpace(line[6])) {
+            // Options such as -s 1 1 1 come first; the file name is the last token
+            const char *nameEnd = lineEnd;
+            while (nameEnd > line && isSpace(nameEnd[-1]))
+                nameEnd--;
+            const char *name = nameEnd;
+            while (name > line + 6 && !isSpace(name[-1]))
+                name--;
+            return std::string(name, nameEnd);
+        }
+    }
+    return std::string();
+}
+
+// Splits [0, size) at line starts into pieces of about CHUNK_BYTES
+static std::vector<size_t> chunkBoundaries(const char *text, size_t size)
+{
+    std::vector<size_t> boundaries = {0};
+    size_t position = CHUNK_BYTES;
+    while (position < size) {
+        const char *newline = static_cast<const char*>(std::memchr(text + position, '\n', size - position));
+        if (newline == nullptr)
+            break;
+        position = size_t(newline - text) + 1;
+        if (position < size)
+            boundaries.push_back(position);
+        position += CHUNK_BYTES;
+    }
+    boundaries.push_back(size);
+    return boundaries;
+}
+
+// Makes the relative corner indices of a chunk absolute and checks all of them
+// against the number of elements in the file
+static bool finishCorners(std::vector<int> &corners, const std::vector<unsigned int> &relative, size_t chunkBase,
+                          size_t elementCount)
+{
+    for (unsigned int slot : relative)
+        corners[slot] += int(chunkBase);
+    for (int index : corners) {
+        if (index < 0 || size_t(index) >= elementCount)
+            return false;
+    }
+    return true;
+}
+
+bool readOBJ(const std::string &filename, const std::string &baseDir, Mesh &mesh, std::string &diffuseTexName,
+             JobSystem *jobs)
+{
+    mesh = Mesh();
+    MappedFile file;
+    if (!file.open(filename)) {
+        std::cerr << "Failed to load/parse OBJ file: " << filename << std::endl;
+        return false;
+    }
+    const char *text = reinterpret_cast<const char*>(file.data());
+    std::vector<size_t> boundaries = chunkBoundaries(text, file.size());
+    unsigned int chunkCount = unsigned(boundaries.size() - 1);
+    std::vector<OBJChunk> chunks(chunkCount);
+
+    auto forEachChunk = [&](const std::function<void(unsigned int)> &fn) {
+        if (jobs != nullptr) {
+            jobs->parallelFor(chunkCount, 1, [&](unsigned int begin, unsigned int end) {
+                for (unsigned int c = begin; c < end; c++)
+                    fn(c);
+            });
+        } else {
+            for (unsigned int c = 0; c < chunkCount; c++)
+                fn(c);
+        }
+    };
+    forEachChunk([&](unsigned int c) {
+        parseChunk(text + boundaries[c], text + boundaries[c + 1], chunks[c]);
+    });
+
+    // Where each chunk's elements go in the merged arrays
+    std::vector<size_t> positionBase(chunkCount + 1, 0), texcoordBase(chunkCount + 1, 0);
+    std::vector<size_t> normalBase(chunkCount + 1, 0), cornerBase(chunkCount + 1, 0);
+    size_t texcoordCorners = 0, normalCorners = 0, malformedLines = 0;
+    std::vector<std::string> materialLibraries;
+    for (unsigned int c = 0; c < chunkCount; c++) {
+        const OBJChunk &chunk = chunks[c];
+        positionBase[c + 1] = positionBase[c] + chunk.positions.size() / 3;
+        texcoordBase[c + 1] = texcoordBase[c] + chunk.texcoords.size() / 2;
+        normalBase[c + 1] = normalBase[c] + chunk.normals.size() / 3;
+        cornerBase[c + 1] = cornerBase[c] + chunk.cornerPositions.size();
+        texcoordCorners += chunk.texcoordCorners;
+        normalCorners += chunk.normalCorners;
+        malformedLines += chunk.malformedLines;
+        materialLibraries.insert(materialLibraries.end(), chunk.materialLibraries.begin(), chunk.materialLibraries.end());
+    }
+    size_t positionCount = positionBase[chunkCount];
+    size_t cornerCount = cornerBase[chunkCount];
+    if (malformedLines > 0)
+        std::cout << "Warning: skipped " << malformedLines << " malformed lines in " << filename << std::endl;
+    // Attributes only some corners have are dropped; missing normals get computed later
+    bool hasTexcoords = cornerCount > 0 && texcoordCorners == cornerCount;
+    bool hasNormals = cornerCount > 0 && normalCorners == cornerCount;
+
+    std::vector<unsigned char> validChunks(chunkCount, 1);
+    forEachChunk([&](unsigned int c) {
+        OBJChunk &chunk = chunks[c];
+        bool valid = finishCorners(chunk.cornerPositions, chunk.relativePositions, positionBase[c], positionCount);
+        if (hasTexcoords)
+            valid &= finishCorners(chunk.cornerTexcoords, chunk.relativeTexcoords, texcoordBase[c], texcoordBase[chunkCount]);
+        if (hasNormals)
+            valid &= finishCorners(chunk.cornerNormals, chunk.relativeNormals, normalBase[c], normalBase[chunkCount]);
+        validChunks[c] = valid;
+    });
+    for (unsigned char valid : validChunks) {
+        if (!valid) {
+            std::cerr << "Error: face index out of range in " << filename << std::endl;
+            std::cerr << "Failed to load/parse OBJ file: " << filename << std::endl;
+            return false;
+        }
+    }
+
+    if (!hasTexcoords && !hasNormals) {
+        // Corners are plain positions, so positions are the vertices and need no welding
+        mesh.vertices.resize(positionCount);
+        mesh.indices.resize(cornerCount);
+        forEachChunk([&](unsigned int c) {
+            const OBJChunk &chunk = chunks[c];
+            if (!chunk.positions.empty())
+                std::memcpy(&mesh.vertices[positionBase[c]].x, chunk.positions.data(),
+                            chunk.positions.size() * sizeof(float));
+            if (!chunk.cornerPositions.empty())
+                std::memcpy(&mesh.indices[cornerBase[c]], chunk.cornerPositions.data(),
+                            chunk.cornerPositions.size() * sizeof(int));
+        });
+    } else {
+        std::vector<glm::vec3> positions(positionCount);
+        std::vector<glm::vec2> texcoords(hasTexcoords ? texcoordBase[chunkCount] : 0);
+        std::vector<glm::vec3> normals(hasNormals ? normalBase[chunkCount] : 0);
+        forEachChunk([&](unsigned int c) {
+            OBJChunk &chunk = chunks[c];
+            if (!chunk.positions.empty())
+                std::memcpy(&positions[positionBase[c]].x, chunk.positions.data(),
+                            chunk.positions.size() * sizeof(float));
+            if (hasTexcoords) {
+                for (size_t i = 0; i < chunk.texcoords.size() / 2; i++) {
+                    // Flip the V coordinate to match OpenGL's expected origin.
+                    texcoords[texcoordBase[c] + i] = glm::vec2(chunk.texcoords[2 * i], 1.0f - chunk.texcoords[2 * i + 1]);
+                }
+            }
+            if (hasNormals && !chunk.normals.empty())
+                std::memcpy(&normals[normalBase[c]].x, chunk.normals.data(), chunk.normals.size() * sizeof(float));
+            // The text-side copies aren't needed any more
+            std::vector<float>().swap(chunk.positions);
+            std::vector<float>().swap(chunk.texcoords);
+            std::vector<float>().swap(chunk.normals);
+        });
+
+        // Corners that share position, normal and texture coordinates share one vertex
+        mesh.indices.reserve(cornerCount);
+        mesh.vertices.reserve(std::min(cornerCount, positionCount * 2));
+        // Most corners repeat a vertex; seams add a few more than there are positions
+        VertexWeldTable weldTable(std::min(cornerCount, positionCount + positionCount / 4));
+        for (const OBJChunk &chunk : chunks) {
+            for (size_t i = 0; i < chunk.cornerPositions.size(); i++) {
+                OBJCorner corner = {chunk.cornerPositions[i], hasTexcoords ? chunk.cornerTexcoords[i] : -1,
+                                    hasNormals ? chunk.cornerNormals[i] : -1};
+                bool isNew;
+                unsigned int vertexIndex = weldTable.findOrInsert(corner, unsigned(mesh.vertices.size()), isNew);
+                mesh.indices.push_back(vertexIndex);
+                if (!isNew)
+                    continue;
+                mesh.vertices.push_back(positions[corner.position]);
+                if (hasNormals)
+                    mesh.normals.push_back(normals[corner.normal]);
+                if (hasTexcoords)
+                    mesh.textureCoordinates.push_back(texcoords[corner.texcoord]);
+            }
+        }
+        mesh.vertices.shrink_to_fit();
+        mesh.normals.shrink_to_fit();
+        mesh.textureCoordinates.shrink_to_fit();
+    }
+
+    if (!materialLibraries.empty()) {
+        diffuseTexName = readDiffuseTexture(baseDir + materialLibraries.front());
+        if (!diffuseTexName.empty())
+            std::cout << "Found diffuse texture in MTL: " << diffuseTexName << std::endl;
+        else
+            std::cout << "No diffuse texture specified in the MTL file." << std::endl;
+    }
+    std::cout << fmt::format("Read {} in {} chunks: {} positions, {} triangles.", filename, chunkCount,
+                             positionCount, cornerCount / 3) << std::endl;
+    return true;
+}
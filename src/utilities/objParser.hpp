@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+
+class JobSystem;
+
+// One face corner of an OBJ file: zero-based position, texture coordinate and
+// normal indices, -1 where the corner has none
+struct OBJCorner {
+    int position;
+    int texcoord;
+    int normal;
+};
+
+// Maps OBJ corners to welded vertex indices. Open addressing with linear
+// probing; it doubles once half full, so it is sized from an estimate of the
+// welded vertices rather than from the corners, which are usually many more.
+class VertexWeldTable {
+public:
+    explicit VertexWeldTable(size_t expectedEntries) {
+        size_t capacity = 16;
+        while (capacity < expectedEntries * 2)
+            capacity *= 2;
+        slots.assign(capacity, Slot());
+        mask = capacity - 1;
+    }
+
+    // Returns the vertex for the corner, or assigns it `next` if it's new
+    unsigned int findOrInsert(const OBJCorner &key, unsigned int next, bool &inserted) {
+        for (size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+            Slot &slot = slots[i];
+            if (slot.vertex == EMPTY) {
+                if ((count + 1) * 2 > slots.size()) {
+                    grow();
+                    return findOrInsert(key, next, inserted);
+                }
+                slot.key = key;
+                slot.vertex = next;
+                count++;
+                inserted = true;
+                return next;
+            }
+            if (slot.key.position == key.position && slot.key.normal == key.normal
+                && slot.key.texcoord == key.texcoord) {
+                inserted = false;
+                return slot.vertex;
+            }
+        }
+    }
+
+private:
+    static const unsigned int EMPTY = ~0u;
+    struct Slot {
+        OBJCorner key;
+        unsigned int vertex = EMPTY;
+    };
+
+    static size_t hash(const OBJCorner &key) {
+        return (size_t(unsigned(key.position)) * 73856093u)
+             ^ (size_t(unsigned(key.normal)) * 19349663u)
+             ^ (size_t(unsigned(key.texcoord)) * 83492791u);
+    }
+
+    void grow() {
+        std::vector<Slot> old(slots.size() * 2);
+        old.swap(slots);
+        mask = slots.size() - 1;
+        for (const Slot &slot : old) {
+            if (slot.vertex == EMPTY)
+                continue;
+            size_t i = hash(slot.key) & mask;
+            while (slots[i].vertex != EMPTY)
+                i = (i + 1) & mask;
+            slots[i] = slot;
+        }
+    }
+
+    std::vector<Slot> slots;
+    size_t mask;
+    size_t count = 0;
+};
+
+// Reads an OBJ file straight from a memory mapping. The file is cut into
+// line-aligned chunks that are parsed in parallel, and their output is merged
+// directly into the welded mesh. Understands v, vt, vn, f (polygons are fanned
+// into triangles, negative indices are allowed) and mtllib, whose first map_Kd
+// is returned in diffuseTexName; everything else is skipped.
+// Files whose faces only reference positions, as most scans do, skip welding.
+// Returns false and leaves the mesh empty if the file can't be read or is malformed.
+bool readOBJ(const std::string &filename, const std::string &baseDir, Mesh &mesh, std::string &diffuseTexName,
+             JobSystem *jobs = nullptr);
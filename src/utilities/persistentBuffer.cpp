@@ -0,0 +1,89 @@
+#include "persistentBuffer.hpp"
+#include <iostream>
+
+static size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void PersistentRingBuffer::init(GLenum bufferTarget, size_t initialSectionSize)
+{
+    target = bufferTarget;
+    section = sectionCount - 1;
+    allocate(initialSectionSize);
+}
+
+void PersistentRingBuffer::allocate(size_t newSectionSize)
+{
+    // Every section has to start at an offset the binding point accepts
+    GLint alignment = 256;
+    if (target == GL_UNIFORM_BUFFER)
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    else if (target == GL_SHADER_STORAGE_BUFFER)
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    sectionSize = alignUp(newSectionSize, size_t(alignment));
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    glBufferStorage(target, sectionSize * sectionCount, nullptr, flags);
+    mapping = static_cast<unsigned char*>(glMapBufferRange(target, 0, sectionSize * sectionCount, flags));
+    glBindBuffer(target, 0);
+    if (!mapping)
+        std::cerr << "Failed to persistently map a ring buffer of " << sectionSize * sectionCount << " bytes" << std::endl;
+}
+
+void PersistentRingBuffer::destroy()
+{
+    for (unsigned int i = 0; i < sectionCount; i++)
+        waitForSection(i);
+    if (buffer) {
+        glBindBuffer(target, buffer);
+        glUnmapBuffer(target);
+        glBindBuffer(target, 0);
+        glDeleteBuffers(1, &buffer);
+    }
+    buffer = 0;
+    mapping = nullptr;
+}
+
+void PersistentRingBuffer::waitForSection(unsigned int index)
+{
+    if (!fences[index])
+        return;
+    // Flush on the first wait so the fence is guaranteed to signal eventually
+    GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (true) {
+        GLenum result = glClientWaitSync(fences[index], waitFlags, 1000000);
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+            break;
+        waitFlags = 0;
+    }
+    glDeleteSync(fences[index]);
+    fences[index] = nullptr;
+}
+
+void *PersistentRingBuffer::beginWrite(size_t size)
+{
+    if (size > sectionSize) {
+        destroy();
+        allocate(size * 2);
+    }
+    section = (section + 1) % sectionCount;
+    waitForSection(section);
+    writtenSize = size;
+    return mapping + section * sectionSize;
+}
+
+void PersistentRingBuffer::bind(GLuint bindingIndex) const
+{
+    if (writtenSize > 0)
+        glBindBufferRange(target, bindingIndex, buffer, GLintptr(section * sectionSize), GLsizeiptr(writtenSize));
+}
+
+void PersistentRingBuffer::endFrame()
+{
+    if (fences[section])
+        glDeleteSync(fences[section]);
+    fences[section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+
+// A buffer object that stays mapped for its whole lifetime and is split into
+// a few sections used round-robin, one per frame. Before a section is written
+// again, we wait on the fence placed after the frame that last read it, so
+// the CPU never overwrites data the GPU is still using.
+class PersistentRingBuffer {
+public:
+    static const unsigned int sectionCount = 3;
+
+    // target is e.g. GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER or GL_DRAW_INDIRECT_BUFFER
+    void init(GLenum target, size_t initialSectionSize);
+    void destroy();
+
+    // Moves to the next section and returns a pointer `size` bytes can be
+    // written to. The buffer is reallocated if a section is too small.
+    void *beginWrite(size_t size);
+
+    // Binds the section written this frame to an indexed binding point.
+    // For non-indexed targets, bind get() and add currentOffset() instead.
+    void bind(GLuint bindingIndex) const;
+
+    // Call once all draws reading the current section have been submitted
+    void endFrame();
+
+    GLuint get() const { return buffer; }
+    size_t currentOffset() const { return section * sectionSize; }
+
+private:
+    void allocate(size_t newSectionSize);
+    void waitForSection(unsigned int index);
+
+    GLenum target = 0;
+    GLuint buffer = 0;
+    unsigned char *mapping = nullptr;
+    size_t sectionSize = 0;
+    size_t writtenSize = 0;
+    unsigned int section = 0;
+    GLsync fences[sectionCount] = {};
+};
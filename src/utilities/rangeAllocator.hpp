@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+
+// First-fit free-list allocator for ranges of elements in a larger buffer.
+// It only does the bookkeeping; the caller owns the actual memory.
+class RangeAllocator {
+public:
+    explicit RangeAllocator(unsigned int capacity = 0) : capacity(0) { grow(capacity); }
+
+    // Returns false if no free range is large enough
+    bool allocate(unsigned int count, unsigned int &offset) {
+        for (size_t i = 0; i < freeRanges.size(); i++) {
+            Range &range = freeRanges[i];
+            if (range.count < count)
+                continue;
+            offset = range.offset;
+            range.offset += count;
+            range.count -= count;
+            if (range.count == 0)
+                freeRanges.erase(freeRanges.begin() + i);
+            return true;
+        }
+        return false;
+    }
+
+    // Returns a range to the free list, merging it with adjacent free ranges
+    void release(unsigned int offset, unsigned int count) {
+        if (count == 0)
+            return;
+        size_t i = 0;
+        while (i < freeRanges.size() && freeRanges[i].offset < offset)
+            i++;
+        freeRanges.insert(freeRanges.begin() + i, Range{offset, count});
+
+        if (i + 1 < freeRanges.size() && freeRanges[i].offset + freeRanges[i].count == freeRanges[i + 1].offset) {
+            freeRanges[i].count += freeRanges[i + 1].count;
+            freeRanges.erase(freeRanges.begin() + i + 1);
+        }
+        if (i > 0 && freeRanges[i - 1].offset + freeRanges[i - 1].count == freeRanges[i].offset) {
+            freeRanges[i - 1].count += freeRanges[i].count;
+            freeRanges.erase(freeRanges.begin() + i);
+        }
+    }
+
+    // Adds free space at the end, after the underlying buffer has been enlarged
+    void grow(unsigned int newCapacity) {
+        if (newCapacity > capacity) {
+            release(capacity, newCapacity - capacity);
+            capacity = newCapacity;
+        }
+    }
+
+    unsigned int size() const { return capacity; }
+
+private:
+    struct Range {
+        unsigned int offset;
+        unsigned int count;
+    };
+
+    // Sorted by offset, never adjacent to each other
+    std::vector<Range> freeRanges;
+    unsigned int capacity;
+};
@@ -7,22 +7,68 @@
 
 // Standard headers
 #include <cassert>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
+#include <locale>
 #include <memory>
+#include <sstream>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+// GLM headers, for the typed uniform uploads
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 
 
 namespace Gloom
 {
+    class Shader;
+
+    /* A pre-resolved handle to a uniform of type T. Setting a value the
+       uniform already holds is skipped without calling into GL. Handles to
+       uniforms that are not active in the program are valid but do nothing. */
+    template <class T>
+    class Uniform
+    {
+    public:
+        Uniform() : mShader(nullptr), mSlot(-1) {}
+
+        void set(T const &value);
+        bool isActive() const { return mSlot != -1; }
+
+    private:
+        friend class Shader;
+        Uniform(Shader *shader, int slot) : mShader(shader), mSlot(slot) {}
+
+        Shader *mShader;
+        int     mSlot;
+    };
+
     class Shader
     {
     private:
 
+        // An active uniform found at link time, with the last value uploaded to it
+        struct UniformSlot
+        {
+            GLint         location;
+            GLenum        type;
+            bool          hasValue;
+            unsigned char value[sizeof(glm::mat4)];
+        };
+
         // Private member variables
         GLuint mProgram;
         GLint  mStatus;
         GLint  mLength;
 
+        std::vector<UniformSlot> mUniforms;
+        std::unordered_map<std::string, int> mUniformSlots;
+        // Inserted after the #version line of every file attached from now on
+        std::string mDefines;
+
     public:
         Shader() {
             mProgram = glCreateProgram();
@@ -34,6 +80,31 @@ namespace Gloom
         GLuint get()        { return mProgram; }
         void   destroy()    { glDeleteProgram(mProgram); }
 
+        /* Defines a preprocessor symbol in the shaders attached after this
+           call, for selecting variants of the same source */
+        void define(std::string const &name)
+        {
+            mDefines += "#define " + name + "\n";
+        }
+
+        void define(std::string const &name, int value)
+        {
+            mDefines += "#define " + name + " " + std::to_string(value) + "\n";
+        }
+
+        /* Written as a GLSL float literal, with all of the float's digits
+           and a decimal point whatever the locale */
+        void define(std::string const &name, float value)
+        {
+            std::ostringstream literal;
+            literal.imbue(std::locale::classic());
+            literal << std::setprecision(9) << value;
+            std::string text = literal.str();
+            if (text.find_first_of(".e") == std::string::npos)
+                text += ".0";
+            mDefines += "#define " + name + " " + text + "\n";
+        }
+
         /* Attach a shader to the current shader program */
         void attach(std::string const &filename)
         {
@@ -49,6 +120,12 @@ namespace Gloom
             }
             auto src = std::string(std::istreambuf_iterator<char>(fd),
                                   (std::istreambuf_iterator<char>()));
+            // #version has to stay first, so defines go on the line after it
+            if (!mDefines.empty())
+            {
+                auto versionEnd = src.find('\n', src.find("#version"));
+                src.insert(versionEnd == std::string::npos ? 0 : versionEnd + 1, mDefines);
+            }
 
             // Create shader object
             const char * source = src.c_str();
@@ -91,6 +168,8 @@ namespace Gloom
             }
 
             assert(mStatus);
+
+            reflectUniforms();
         }
 
 
@@ -107,7 +186,44 @@ namespace Gloom
         /* Convenience function to get a uniforms ID from a string
            containing its name */
         GLint getUniformFromName(std::string const &uniformName) {
-            return glGetUniformLocation(this->get(), uniformName.c_str());
+            auto found = mUniformSlots.find(uniformName);
+            if (found == mUniformSlots.end())
+                return -1;
+            return mUniforms[found->second].location;
+        }
+
+
+        /* Returns a typed handle to a uniform. Look these up once, after
+           linking, and keep them around instead of looking them up per draw */
+        template <class T>
+        Uniform<T> uniform(std::string const &uniformName)
+        {
+            auto found = mUniformSlots.find(uniformName);
+            if (found == mUniformSlots.end())
+                return Uniform<T>(this, -1);
+
+            GLenum type = mUniforms[found->second].type;
+            if (!typeMatches(type, static_cast<T*>(nullptr)))
+            {
+                fprintf(stderr,
+                    "Uniform \"%s\" has GL type 0x%x, which does not match the requested handle type.\n",
+                    uniformName.c_str(), type);
+                return Uniform<T>(this, -1);
+            }
+            return Uniform<T>(this, found->second);
+        }
+
+
+        /* Uploads a value through a handle's slot; used by Uniform<T>::set */
+        template <class T>
+        void setUniform(int slot, T const &value)
+        {
+            UniformSlot &uniform = mUniforms[slot];
+            if (uniform.hasValue && std::memcmp(uniform.value, &value, sizeof(T)) == 0)
+                return;
+            std::memcpy(uniform.value, &value, sizeof(T));
+            uniform.hasValue = true;
+            upload(uniform.location, value);
         }
 
 
@@ -147,11 +263,83 @@ namespace Gloom
         }
 
     private:
+        /* Enumerates the active uniforms, so that later lookups never need to
+           go through the driver. Array uniforms are registered under their
+           base name, e.g. "lights" rather than "lights[0]" */
+        void reflectUniforms()
+        {
+            mUniforms.clear();
+            mUniformSlots.clear();
+
+            GLint count = 0, maxNameLength = 0;
+            glGetProgramiv(mProgram, GL_ACTIVE_UNIFORMS, &count);
+            glGetProgramiv(mProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+            std::unique_ptr<char[]> name(new char[maxNameLength + 1]);
+
+            for (GLint i = 0; i < count; i++)
+            {
+                GLint size = 0;
+                GLenum type = 0;
+                GLsizei nameLength = 0;
+                glGetActiveUniform(mProgram, GLuint(i), maxNameLength + 1, &nameLength, &size, &type, name.get());
+
+                GLint location = glGetUniformLocation(mProgram, name.get());
+                // Uniforms inside uniform blocks have no location
+                if (location == -1)
+                    continue;
+
+                std::string uniformName(name.get(), nameLength);
+                auto bracket = uniformName.find('[');
+                if (bracket != std::string::npos)
+                    uniformName.resize(bracket);
+
+                UniformSlot slot;
+                slot.location = location;
+                slot.type = type;
+                slot.hasValue = false;
+                mUniformSlots[uniformName] = int(mUniforms.size());
+                mUniforms.push_back(slot);
+            }
+        }
+
+        static bool isSampler(GLenum type)
+        {
+            return type == GL_SAMPLER_2D || type == GL_SAMPLER_2D_SHADOW
+                || type == GL_SAMPLER_2D_ARRAY || type == GL_SAMPLER_2D_ARRAY_SHADOW
+                || type == GL_SAMPLER_CUBE || type == GL_SAMPLER_3D;
+        }
+
+        static bool typeMatches(GLenum type, int*)       { return type == GL_INT || type == GL_BOOL || isSampler(type); }
+        static bool typeMatches(GLenum type, GLuint*)    { return type == GL_UNSIGNED_INT; }
+        static bool typeMatches(GLenum type, float*)     { return type == GL_FLOAT; }
+        static bool typeMatches(GLenum type, glm::vec2*) { return type == GL_FLOAT_VEC2; }
+        static bool typeMatches(GLenum type, glm::vec3*) { return type == GL_FLOAT_VEC3; }
+        static bool typeMatches(GLenum type, glm::vec4*) { return type == GL_FLOAT_VEC4; }
+        static bool typeMatches(GLenum type, glm::mat3*) { return type == GL_FLOAT_MAT3; }
+        static bool typeMatches(GLenum type, glm::mat4*) { return type == GL_FLOAT_MAT4; }
+
+        // glProgramUniform* does not need the program to be bound
+        void upload(GLint location, int value)              { glProgramUniform1i(mProgram, location, value); }
+        void upload(GLint location, GLuint value)           { glProgramUniform1ui(mProgram, location, value); }
+        void upload(GLint location, float value)            { glProgramUniform1f(mProgram, location, value); }
+        void upload(GLint location, glm::vec2 const &value) { glProgramUniform2fv(mProgram, location, 1, glm::value_ptr(value)); }
+        void upload(GLint location, glm::vec3 const &value) { glProgramUniform3fv(mProgram, location, 1, glm::value_ptr(value)); }
+        void upload(GLint location, glm::vec4 const &value) { glProgramUniform4fv(mProgram, location, 1, glm::value_ptr(value)); }
+        void upload(GLint location, glm::mat3 const &value) { glProgramUniformMatrix3fv(mProgram, location, 1, GL_FALSE, glm::value_ptr(value)); }
+        void upload(GLint location, glm::mat4 const &value) { glProgramUniformMatrix4fv(mProgram, location, 1, GL_FALSE, glm::value_ptr(value)); }
+
         // Disable copying and assignment
         Shader(Shader const &) = delete;
         Shader & operator =(Shader const &) = delete;
 
     };
+
+    template <class T>
+    void Uniform<T>::set(T const &value)
+    {
+        if (mSlot != -1)
+            mShader->setUniform(mSlot, value);
+    }
 }
 
 #endif
@@ -87,6 +87,7 @@ Mesh cube(glm::vec3 scale, glm::vec2 textureScale, bool tilingTextures, bool inv
         }
     }
 
+    m.computeBounds();
     return m;
 }
 
@@ -203,5 +204,6 @@ Mesh generateSphere(float sphereRadius, int slices, int layers) {
     mesh.normals = normals;
     mesh.indices = indices;
     mesh.textureCoordinates = uvs;
+    mesh.computeBounds();
     return mesh;
 }
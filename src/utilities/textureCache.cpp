@@ -0,0 +1,347 @@
+#include "textureCache.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+TextureCache &sharedTextureCache()
+{
+    static TextureCache cache;
+    return cache;
+}
+
+static const unsigned int NO_ARRAY = ~0u;
+
+// The absolute path with every link and "..", so any name for a file finds its entry
+static std::string canonicalPath(const std::string &path)
+{
+#ifdef _WIN32
+    char resolved[_MAX_PATH];
+    if (_fullpath(resolved, path.c_str(), _MAX_PATH) != nullptr)
+        return resolved;
+#else
+    char *resolved = realpath(path.c_str(), nullptr);
+    if (resolved != nullptr) {
+        std::string result(resolved);
+        free(resolved);
+        return result;
+    }
+#endif
+    // Missing files can't be resolved; they will fail to load under any name
+    return path;
+}
+
+void TextureCache::init(bool allowBindless)
+{
+    useBindless = allowBindless && GLAD_GL_ARB_bindless_texture;
+    // Entry 0 is the untextured material and is never freed
+    entries.assign(1, Entry());
+    entries[NO_MATERIAL].references = 1;
+    entries[NO_MATERIAL].state = TEXTURE_RESIDENT;
+    glCreateBuffers(1, &materialBuffer);
+    materialsChanged = true;
+    std::cout << (useBindless ? "Textures are read through bindless handles."
+                              : "Textures are bound as arrays, ARB_bindless_texture is not in use.") << std::endl;
+}
+
+void TextureCache::destroy()
+{
+    for (TextureArray &array : arrays)
+        destroyArray(array);
+    glDeleteBuffers(1, &materialBuffer);
+    materialBuffer = 0;
+    materialBufferSize = 0;
+    entries.clear();
+    freeEntries.clear();
+    byPath.clear();
+    byContent.clear();
+    arrays.clear();
+    materials.clear();
+    liveTextures = 0;
+}
+
+MaterialIndex TextureCache::newEntry()
+{
+    MaterialIndex material;
+    if (!freeEntries.empty()) {
+        material = freeEntries.back();
+        freeEntries.pop_back();
+    } else {
+        material = MaterialIndex(entries.size());
+        entries.emplace_back();
+    }
+    entries[material].references = 1;
+    liveTextures++;
+    materialsChanged = true;
+    return material;
+}
+
+const TextureCache::Entry &TextureCache::owner(MaterialIndex material) const
+{
+    const Entry &entry = entries[material];
+    return entry.sharedWith != NO_MATERIAL ? entries[entry.sharedWith] : entry;
+}
+
+MaterialIndex TextureCache::acquire(const std::string &path, bool &added)
+{
+    std::string key = canonicalPath(path);
+    auto found = byPath.find(key);
+    if (found != byPath.end()) {
+        entries[found->second].references++;
+        sharedLoads++;
+        added = false;
+        return found->second;
+    }
+    MaterialIndex material = newEntry();
+    entries[material].path = key;
+    byPath[key] = material;
+    added = true;
+    return material;
+}
+
+void TextureCache::addReference(MaterialIndex material)
+{
+    if (material != NO_MATERIAL)
+        entries[material].references++;
+}
+
+void TextureCache::release(MaterialIndex material)
+{
+    if (material == NO_MATERIAL)
+        return;
+    Entry &entry = entries[material];
+    if (--entry.references > 0)
+        return;
+
+    if (!entry.path.empty())
+        byPath.erase(entry.path);
+    MaterialIndex sharedWith = entry.sharedWith;
+    if (sharedWith == NO_MATERIAL) {
+        auto found = byContent.find(entry.contentHash);
+        if (found != byContent.end() && found->second == material)
+            byContent.erase(found);
+        if (entry.array != NO_ARRAY) {
+            TextureArray &array = arrays[entry.array];
+            array.freeLayers.push_back(entry.layer);
+            if (array.freeLayers.size() == array.used)
+                destroyArray(array);
+        }
+    }
+    entry = Entry();
+    freeEntries.push_back(material);
+    liveTextures--;
+    materialsChanged = true;
+    // The copy's reference to the texture it showed goes with it
+    if (sharedWith != NO_MATERIAL)
+        release(sharedWith);
+}
+
+bool TextureCache::shareContent(MaterialIndex material, std::uint64_t contentHash)
+{
+    entries[material].contentHash = contentHash;
+    if (contentHash == 0)
+        return false;
+    auto found = byContent.find(contentHash);
+    if (found == byContent.end()) {
+        byContent[contentHash] = material;
+        return false;
+    }
+    entries[material].sharedWith = found->second;
+    entries[found->second].references++;
+    sharedLoads++;
+    materialsChanged = true;
+    return true;
+}
+
+unsigned int TextureCache::findArray(const DecodedTexture &texture)
+{
+    GLenum format = textureStorageFormat(texture);
+    unsigned int levels = textureStorageLevels(texture);
+    bool generatesMips = !texture.cooked;
+    unsigned int unused = NO_ARRAY;
+    for (unsigned int i = 0; i < arrays.size(); i++) {
+        const TextureArray &array = arrays[i];
+        if (array.texture == 0) {
+            unused = std::min(unused, i);
+            continue;
+        }
+        if (array.format == format && array.width == texture.width && array.height == texture.height
+            && array.levels == levels && array.generatesMips == generatesMips)
+            return i;
+    }
+    if (unused == NO_ARRAY) {
+        unused = unsigned(arrays.size());
+        arrays.emplace_back();
+    }
+
+    // Most textures have a size of their own, so start with a single layer
+    TextureArray &array = arrays[unused];
+    array.texture = createTextureArrayStorage(texture, 1);
+    array.format = format;
+    array.width = texture.width;
+    array.height = texture.height;
+    array.levels = levels;
+    array.generatesMips = generatesMips;
+    array.capacity = 1;
+    makeHandleResident(array);
+    return unused;
+}
+
+// Doubles the layers, copying the used ones over on the GPU
+void TextureCache::growArray(TextureArray &array, const DecodedTexture &texture)
+{
+    unsigned int capacity = array.capacity * 2;
+    GLuint grown = createTextureArrayStorage(texture, capacity);
+    for (unsigned int level = 0; level < array.levels; level++) {
+        GLsizei width = GLsizei(std::max(1u, array.width >> level));
+        GLsizei height = GLsizei(std::max(1u, array.height >> level));
+        glCopyImageSubData(array.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+                           grown, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, width, height, GLsizei(array.used));
+    }
+    if (array.handle != 0)
+        glMakeTextureHandleNonResidentARB(array.handle);
+    glDeleteTextures(1, &array.texture);
+    array.texture = grown;
+    array.capacity = capacity;
+    makeHandleResident(array);
+    // Every material in the array has a new handle
+    materialsChanged = true;
+}
+
+void TextureCache::makeHandleResident(TextureArray &array)
+{
+    if (!useBindless)
+        return;
+    // Takes the sampling parameters as they are now; they can't change afterwards
+    array.handle = glGetTextureHandleARB(array.texture);
+    glMakeTextureHandleResidentARB(array.handle);
+}
+
+void TextureCache::destroyArray(TextureArray &array)
+{
+    if (array.texture == 0)
+        return;
+    if (array.handle != 0)
+        glMakeTextureHandleNonResidentARB(array.handle);
+    glDeleteTextures(1, &array.texture);
+    array = TextureArray();
+}
+
+void TextureCache::allocateLayer(MaterialIndex material, const DecodedTexture &texture)
+{
+    unsigned int index = findArray(texture);
+    TextureArray &array = arrays[index];
+    unsigned int layer;
+    if (!array.freeLayers.empty()) {
+        layer = array.freeLayers.back();
+        array.freeLayers.pop_back();
+    } else {
+        if (array.used == array.capacity)
+            growArray(array, texture);
+        layer = array.used++;
+    }
+    entries[material].array = index;
+    entries[material].layer = layer;
+}
+
+void TextureCache::markResident(MaterialIndex material)
+{
+    Entry &entry = entries[material];
+    entry.state = TEXTURE_RESIDENT;
+    materialsChanged = true;
+    // Decoded images only bring the base level. This remakes the levels of the
+    // array's other layers too, from the same base levels, so they don't change.
+    if (entry.sharedWith == NO_MATERIAL && entry.array != NO_ARRAY && arrays[entry.array].generatesMips)
+        glGenerateTextureMipmap(arrays[entry.array].texture);
+}
+
+void TextureCache::markFailed(MaterialIndex material)
+{
+    entries[material].state = TEXTURE_FAILED;
+    materialsChanged = true;
+}
+
+void TextureCache::upload(MaterialIndex material, const DecodedTexture &texture)
+{
+    allocateLayer(material, texture);
+    const Entry &entry = entries[material];
+    GLuint arrayTexture = arrays[entry.array].texture;
+    // Rows are tightly packed, whatever their width
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (unsigned int level = 0; level < texture.mipCount; level++)
+        uploadTextureRows(arrayTexture, texture, level, 0, texture.mipHeight(level), texture.mip(level),
+                          int(entry.layer));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+MaterialIndex TextureCache::add(const DecodedTexture &texture)
+{
+    MaterialIndex material = newEntry();
+    // A copy may only be resident once the texture it shows is. The streamer
+    // sees to that by uploading in request order, but this one is resident
+    // straight away, so the same image still streaming gets a layer of its own.
+    auto found = byContent.find(texture.contentHash);
+    if (found != byContent.end() && entries[found->second].state != TEXTURE_RESIDENT)
+        upload(material, texture);
+    else if (!shareContent(material, texture.contentHash))
+        upload(material, texture);
+    markResident(material);
+    return material;
+}
+
+TextureState TextureCache::state(MaterialIndex material) const
+{
+    return entries[material].state;
+}
+
+GLuint TextureCache::arrayTexture(MaterialIndex material) const
+{
+    const Entry &entry = owner(material);
+    return entry.array != NO_ARRAY ? arrays[entry.array].texture : 0;
+}
+
+unsigned int TextureCache::layer(MaterialIndex material) const
+{
+    return owner(material).layer;
+}
+
+GLuint TextureCache::bindingFor(MaterialIndex material) const
+{
+    if (useBindless || material == NO_MATERIAL || entries[material].state != TEXTURE_RESIDENT)
+        return 0;
+    return arrayTexture(material);
+}
+
+unsigned int TextureCache::arrayCount() const
+{
+    return unsigned(std::count_if(arrays.begin(), arrays.end(),
+                                  [](const TextureArray &array) { return array.texture != 0; }));
+}
+
+void TextureCache::bindMaterials(GLuint binding)
+{
+    if (materialsChanged) {
+        // Rebuilt whole, as changes are rare and the table is small
+        materials.assign(entries.size(), MaterialData());
+        for (MaterialIndex material = 1; material < entries.size(); material++) {
+            if (entries[material].references == 0 || entries[material].state != TEXTURE_RESIDENT)
+                continue;
+            // A copy shows nothing until the texture it shares has a layer
+            const Entry &entry = owner(material);
+            if (entry.state != TEXTURE_RESIDENT || entry.array == NO_ARRAY)
+                continue;
+            MaterialData &data = materials[material];
+            data.textureHandle = arrays[entry.array].handle;
+            data.layer = entry.layer;
+            data.textured = 1;
+        }
+        size_t size = materials.size() * sizeof(MaterialData);
+        if (size > materialBufferSize) {
+            glNamedBufferData(materialBuffer, size, materials.data(), GL_DYNAMIC_DRAW);
+            materialBufferSize = size;
+        } else {
+            glNamedBufferSubData(materialBuffer, 0, size, materials.data());
+        }
+        materialsChanged = false;
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, materialBuffer);
+}
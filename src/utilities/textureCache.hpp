@@ -0,0 +1,140 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "textureLoader.hpp"
+
+// A texture in the TextureCache. It doubles as the index of the texture's
+// entry in the material buffer, which is how the shaders find it, so drawing
+// with another texture needs no binds. 0 is an untextured material.
+typedef unsigned int MaterialIndex;
+const MaterialIndex NO_MATERIAL = 0;
+
+// Mirrors one element of the std430 Materials storage buffer in model.frag
+struct MaterialData {
+    // Bindless handle of the texture array, read as a uvec2. 0 without bindless textures.
+    std::uint64_t textureHandle;
+    std::uint32_t layer;     // Of the texture within its array
+    std::uint32_t textured;  // 0 until the texture is resident
+};
+
+enum TextureState {
+    TEXTURE_LOADING,   // Known, but still being decoded or uploaded
+    TEXTURE_RESIDENT,
+    TEXTURE_FAILED
+};
+
+// Shares scene textures between their users. Textures are keyed by canonical
+// path, so every name for a file gives the same texture, and by the hash of
+// their source file, so copies of an image under different names are only
+// uploaded once. Each texture is reference counted and freed with its last user.
+//
+// Textures of the same size and format are layers of one GL_TEXTURE_2D_ARRAY,
+// which grows by copying on the GPU when it runs out of layers. With
+// ARB_bindless_texture, each array's handle is resident and stored in the
+// material buffer, so nothing is bound per draw at all. Without it, draws are
+// batched by array and only a change of array costs a bind.
+//
+// Only use it from the GL thread.
+class TextureCache {
+public:
+    // Uses bindless handles when the driver has ARB_bindless_texture, unless allowBindless is false
+    void init(bool allowBindless = true);
+    void destroy();
+
+    // Takes a reference to the texture at `path`. If the path is new, an entry
+    // is added for it and `added` is set: the caller then either loads it with
+    // shareContent(), allocateLayer() and markResident(), or gives up with markFailed().
+    MaterialIndex acquire(const std::string &path, bool &added);
+    void addReference(MaterialIndex material);
+    void release(MaterialIndex material);
+
+    // Once a new texture has been decoded: if the same image is already known,
+    // makes the material show that one and returns true, and there is nothing
+    // to upload. Textures it is shared with are loaded or loading already, so
+    // uploading in request order finishes them first.
+    bool shareContent(MaterialIndex material, std::uint64_t contentHash);
+    // Gives a new texture a layer of an array matching its size and format,
+    // to be uploaded into with uploadTextureRows() and then markResident()
+    void allocateLayer(MaterialIndex material, const DecodedTexture &texture);
+    void markResident(MaterialIndex material);
+    void markFailed(MaterialIndex material);
+
+    // Adds a texture made in memory with one reference. It is never shared by path.
+    MaterialIndex add(const DecodedTexture &texture);
+
+    TextureState state(MaterialIndex material) const;
+    // The array holding the texture's layer and the layer within it, for uploads.
+    // Arrays are replaced when they grow, so don't hold on to the name.
+    GLuint arrayTexture(MaterialIndex material) const;
+    unsigned int layer(MaterialIndex material) const;
+    // The array to bind for drawing with the material: 0 with bindless
+    // textures, or if there is nothing to show yet
+    GLuint bindingFor(MaterialIndex material) const;
+    bool bindless() const { return useBindless; }
+
+    // Uploads the material buffer if it changed and binds it
+    void bindMaterials(GLuint binding);
+
+    // For the stats line
+    unsigned int textureCount() const { return liveTextures; }
+    unsigned int arrayCount() const;
+    // Loads avoided, by path and by content
+    unsigned int sharedLoads = 0;
+
+private:
+    struct Entry {
+        std::string path;  // Canonical; empty for textures made in memory
+        std::uint64_t contentHash = 0;
+        unsigned int references = 0;
+        TextureState state = TEXTURE_LOADING;
+        // Entry whose layer this one shows, if it was found to be a copy
+        MaterialIndex sharedWith = NO_MATERIAL;
+        unsigned int array = ~0u;
+        unsigned int layer = 0;
+    };
+
+    struct TextureArray {
+        GLuint texture = 0;  // 0 if the slot is unused
+        GLuint64 handle = 0;
+        GLenum format = 0;
+        unsigned int width = 0, height = 0, levels = 0;
+        // Decoded images get their levels made on the GPU, which compressed arrays can't do
+        bool generatesMips = false;
+        unsigned int capacity = 0;
+        // Layers handed out so far, including the free ones
+        unsigned int used = 0;
+        std::vector<unsigned int> freeLayers;
+    };
+
+    MaterialIndex newEntry();
+    // Follows sharedWith to the entry that owns the layer
+    const Entry &owner(MaterialIndex material) const;
+    unsigned int findArray(const DecodedTexture &texture);
+    void growArray(TextureArray &array, const DecodedTexture &texture);
+    void makeHandleResident(TextureArray &array);
+    void destroyArray(TextureArray &array);
+    // Allocates a layer and uploads every level of the texture at once
+    void upload(MaterialIndex material, const DecodedTexture &texture);
+
+    bool useBindless = false;
+    std::vector<Entry> entries;
+    std::vector<MaterialIndex> freeEntries;
+    std::unordered_map<std::string, MaterialIndex> byPath;
+    std::unordered_map<std::uint64_t, MaterialIndex> byContent;
+    std::vector<TextureArray> arrays;
+    unsigned int liveTextures = 0;
+
+    GLuint materialBuffer = 0;
+    size_t materialBufferSize = 0;
+    bool materialsChanged = true;
+    std::vector<MaterialData> materials;
+};
+
+// The cache used for scene textures. Call init() once a GL context exists.
+TextureCache &sharedTextureCache();
@@ -0,0 +1,279 @@
+#include "textureCompression.hpp"
+#include "jobSystem.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+size_t encodedRowSize(TextureEncoding encoding, unsigned int width, unsigned int channels)
+{
+    if (!isBlockCompressed(encoding))
+        return size_t(width) * channels;
+    return size_t((width + 3) / 4) * bytesPerBlock(encoding);
+}
+
+size_t encodedImageSize(TextureEncoding encoding, unsigned int width, unsigned int height, unsigned int channels)
+{
+    unsigned int rows = isBlockCompressed(encoding) ? (height + 3) / 4 : height;
+    return encodedRowSize(encoding, width, channels) * rows;
+}
+
+TextureEncoding chooseBlockEncoding(const unsigned char *pixels, unsigned int width, unsigned int height,
+                                    unsigned int channels)
+{
+    if (channels == 1)
+        return TEXTURE_BC4;
+    if (channels == 4) {
+        size_t count = size_t(width) * height;
+        for (size_t i = 0; i < count; i++)
+            if (pixels[i * 4 + 3] != 255)
+                return TEXTURE_BC3;
+    }
+    return TEXTURE_BC1;
+}
+
+// --- Single channel blocks ---
+
+// Eight levels between the endpoints, the BC4 and BC3 alpha mode used when first > second
+static void channelPalette(int first, int second, int palette[8])
+{
+    palette[0] = first;
+    palette[1] = second;
+    for (int i = 2; i < 8; i++)
+        palette[i] = ((8 - i) * first + (i - 1) * second) / 7;
+}
+
+// Writes the 8 bytes of a BC4 block: the two endpoints, then a 3-bit index per pixel
+static void encodeChannelBlock(const int values[16], unsigned char *out)
+{
+    int low = values[0], high = values[0];
+    for (int i = 1; i < 16; i++) {
+        low = std::min(low, values[i]);
+        high = std::max(high, values[i]);
+    }
+    std::uint64_t indices = 0;
+    if (high > low) {
+        int palette[8];
+        channelPalette(high, low, palette);
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestError = 1 << 30;
+            for (int code = 0; code < 8; code++) {
+                int error = std::abs(values[i] - palette[code]);
+                if (error < bestError) {
+                    bestError = error;
+                    best = code;
+                }
+            }
+            indices |= std::uint64_t(best) << (3 * i);
+        }
+    }
+    // A flat block keeps every index at 0, the first endpoint
+    out[0] = (unsigned char)high;
+    out[1] = (unsigned char)low;
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+// --- Colour blocks ---
+
+struct Colour {
+    float r, g, b;
+};
+
+static Colour operator+(Colour a, Colour b) { return Colour{a.r + b.r, a.g + b.g, a.b + b.b}; }
+static Colour operator-(Colour a, Colour b) { return Colour{a.r - b.r, a.g - b.g, a.b - b.b}; }
+static Colour operator*(Colour a, float s) { return Colour{a.r * s, a.g * s, a.b * s}; }
+static float dot(Colour a, Colour b) { return a.r * b.r + a.g * b.g + a.b * b.b; }
+
+static std::uint16_t quantise565(Colour c)
+{
+    int r = int(std::lround(std::min(std::max(c.r, 0.0f), 255.0f) * 31.0f / 255.0f));
+    int g = int(std::lround(std::min(std::max(c.g, 0.0f), 255.0f) * 63.0f / 255.0f));
+    int b = int(std::lround(std::min(std::max(c.b, 0.0f), 255.0f) * 31.0f / 255.0f));
+    return std::uint16_t((r << 11) | (g << 5) | b);
+}
+
+// The colour the GPU decodes the endpoint to
+static Colour expand565(std::uint16_t packed)
+{
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    return Colour{float((r << 3) | (r >> 2)), float((g << 2) | (g >> 4)), float((b << 3) | (b >> 2))};
+}
+
+// Picks the nearest of the four colours between the endpoints for each pixel.
+// Returns the squared error; indices are 2 bits per pixel, pixel 0 lowest.
+static float chooseColourIndices(const Colour pixels[16], std::uint16_t first, std::uint16_t second,
+                                 std::uint32_t &indices)
+{
+    Colour c0 = expand565(first), c1 = expand565(second);
+    Colour palette[4] = {c0, c1, c0 * (2.0f / 3.0f) + c1 * (1.0f / 3.0f), c0 * (1.0f / 3.0f) + c1 * (2.0f / 3.0f)};
+    float total = 0.0f;
+    indices = 0;
+    for (int i = 0; i < 16; i++) {
+        int best = 0;
+        float bestError = 1e30f;
+        for (int code = 0; code < 4; code++) {
+            Colour d = pixels[i] - palette[code];
+            float error = dot(d, d);
+            if (error < bestError) {
+                bestError = error;
+                best = code;
+            }
+        }
+        indices |= std::uint32_t(best) << (2 * i);
+        total += bestError;
+    }
+    return total;
+}
+
+// The endpoints that best reproduce the pixels with the given indices, by least squares
+static bool refineEndpoints(const Colour pixels[16], std::uint32_t indices, Colour &first, Colour &second)
+{
+    static const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    Colour ax{0, 0, 0}, bx{0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        float a = weights[(indices >> (2 * i)) & 3];
+        float b = 1.0f - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        ax = ax + pixels[i] * a;
+        bx = bx + pixels[i] * b;
+    }
+    float determinant = aa * bb - ab * ab;
+    if (std::fabs(determinant) < 1e-6f)
+        return false;
+    float inverse = 1.0f / determinant;
+    first = (ax * bb - bx * ab) * inverse;
+    second = (bx * aa - ax * ab) * inverse;
+    return true;
+}
+
+// Writes the 8 bytes of a BC1 block in four colour mode
+static void encodeColourBlock(const Colour pixels[16], unsigned char *out)
+{
+    Colour mean{0, 0, 0};
+    for (int i = 0; i < 16; i++)
+        mean = mean + pixels[i];
+    mean = mean * (1.0f / 16.0f);
+
+    // Principal axis of the colours by power iteration on their covariance
+    float covariance[6] = {};
+    for (int i = 0; i < 16; i++) {
+        Colour d = pixels[i] - mean;
+        covariance[0] += d.r * d.r;
+        covariance[1] += d.r * d.g;
+        covariance[2] += d.r * d.b;
+        covariance[3] += d.g * d.g;
+        covariance[4] += d.g * d.b;
+        covariance[5] += d.b * d.b;
+    }
+    Colour axis{1.0f, 1.0f, 1.0f};
+    for (int iteration = 0; iteration < 8; iteration++) {
+        Colour next{covariance[0] * axis.r + covariance[1] * axis.g + covariance[2] * axis.b,
+                    covariance[1] * axis.r + covariance[3] * axis.g + covariance[4] * axis.b,
+                    covariance[2] * axis.r + covariance[4] * axis.g + covariance[5] * axis.b};
+        float length = std::sqrt(dot(next, next));
+        if (length < 1e-6f)
+            break;
+        axis = next * (1.0f / length);
+    }
+
+    // The extremes along the axis, pulled in a little as the palette's ends are rarely the best fit
+    float low = 1e30f, high = -1e30f;
+    for (int i = 0; i < 16; i++) {
+        float t = dot(pixels[i] - mean, axis);
+        low = std::min(low, t);
+        high = std::max(high, t);
+    }
+    float inset = (high - low) / 16.0f;
+    Colour firstColour = mean + axis * (high - inset);
+    Colour secondColour = mean + axis * (low + inset);
+
+    std::uint16_t first = quantise565(firstColour), second = quantise565(secondColour);
+    std::uint32_t indices;
+    float error = chooseColourIndices(pixels, first, second, indices);
+    for (int iteration = 0; iteration < 2 && error > 0.0f; iteration++) {
+        if (!refineEndpoints(pixels, indices, firstColour, secondColour))
+            break;
+        std::uint16_t refinedFirst = quantise565(firstColour), refinedSecond = quantise565(secondColour);
+        std::uint32_t refinedIndices;
+        float refinedError = chooseColourIndices(pixels, refinedFirst, refinedSecond, refinedIndices);
+        if (refinedError >= error)
+            break;
+        first = refinedFirst;
+        second = refinedSecond;
+        indices = refinedIndices;
+        error = refinedError;
+    }
+
+    // Four colour mode needs first > second. Swapping the endpoints swaps
+    // codes 0 and 1 and codes 2 and 3, i.e. flips the low bit of every index.
+    if (first < second) {
+        std::swap(first, second);
+        indices ^= 0x55555555u;
+    } else if (first == second) {
+        indices = 0;
+    }
+    out[0] = (unsigned char)(first & 0xff);
+    out[1] = (unsigned char)(first >> 8);
+    out[2] = (unsigned char)(second & 0xff);
+    out[3] = (unsigned char)(second >> 8);
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+// --- Images ---
+
+static void compressBlockRow(const unsigned char *pixels, unsigned int width, unsigned int height,
+                             unsigned int channels, TextureEncoding encoding, unsigned int blockRow, unsigned char *out)
+{
+    unsigned int blocksWide = (width + 3) / 4;
+    size_t blockSize = bytesPerBlock(encoding);
+    for (unsigned int blockX = 0; blockX < blocksWide; blockX++) {
+        Colour colours[16];
+        int values[16];
+        int alphas[16];
+        for (unsigned int i = 0; i < 16; i++) {
+            // Partial blocks repeat the last row and column
+            unsigned int x = std::min(blockX * 4 + i % 4, width - 1);
+            unsigned int y = std::min(blockRow * 4 + i / 4, height - 1);
+            const unsigned char *pixel = pixels + (size_t(y) * width + x) * channels;
+            if (channels >= 3)
+                colours[i] = Colour{float(pixel[0]), float(pixel[1]), float(pixel[2])};
+            else
+                colours[i] = Colour{float(pixel[0]), float(pixel[0]), float(pixel[0])};
+            values[i] = pixel[0];
+            alphas[i] = channels == 4 ? pixel[3] : 255;
+        }
+        unsigned char *block = out + blockX * blockSize;
+        if (encoding == TEXTURE_BC4) {
+            encodeChannelBlock(values, block);
+        } else if (encoding == TEXTURE_BC3) {
+            encodeChannelBlock(alphas, block);
+            encodeColourBlock(colours, block + 8);
+        } else {
+            encodeColourBlock(colours, block);
+        }
+    }
+}
+
+void compressImage(const unsigned char *pixels, unsigned int width, unsigned int height, unsigned int channels,
+                   TextureEncoding encoding, unsigned char *out, JobSystem *jobs)
+{
+    if (!isBlockCompressed(encoding)) {
+        std::memcpy(out, pixels, encodedImageSize(encoding, width, height, channels));
+        return;
+    }
+    unsigned int blockRows = (height + 3) / 4;
+    size_t rowSize = encodedRowSize(encoding, width, channels);
+    auto compressRows = [&](unsigned int begin, unsigned int end) {
+        for (unsigned int row = begin; row < end; row++)
+            compressBlockRow(pixels, width, height, channels, encoding, row, out + row * rowSize);
+    };
+    // A row of blocks of a 4K texture is a few hundred microseconds of work
+    if (jobs)
+        jobs->parallelFor(blockRows, 4, compressRows);
+    else
+        compressRows(0, blockRows);
+}
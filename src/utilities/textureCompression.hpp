@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class JobSystem;
+
+// How the texels of a cooked texture are stored. The block formats encode
+// 4x4 pixel blocks; images whose sides aren't multiples of 4 get partial
+// blocks at the edges, padded with copies of the last row and column.
+enum TextureEncoding : std::uint32_t {
+    TEXTURE_RAW = 0,  // 1, 3 or 4 bytes per pixel, rows tightly packed
+    TEXTURE_BC1 = 1,  // RGB in 8 bytes per block (DXT1)
+    TEXTURE_BC3 = 2,  // RGBA in 16 bytes per block: BC1 colour after a BC4 style alpha block (DXT5)
+    TEXTURE_BC4 = 3   // One channel in 8 bytes per block (RGTC1)
+};
+
+inline bool isBlockCompressed(TextureEncoding encoding) {
+    return encoding != TEXTURE_RAW;
+}
+
+inline size_t bytesPerBlock(TextureEncoding encoding) {
+    return encoding == TEXTURE_BC3 ? 16 : 8;
+}
+
+// For logs and stats, e.g. "BC1"
+inline const char *encodingName(TextureEncoding encoding) {
+    static const char *const names[] = {"raw", "BC1", "BC3", "BC4"};
+    return names[encoding];
+}
+
+// Bytes of one row of pixels, or of one row of 4x4 blocks for block encodings
+size_t encodedRowSize(TextureEncoding encoding, unsigned int width, unsigned int channels);
+// Bytes of a whole image
+size_t encodedImageSize(TextureEncoding encoding, unsigned int width, unsigned int height, unsigned int channels);
+
+// The block encoding that suits the image: BC4 for one channel, BC3 when any
+// pixel is translucent and BC1 otherwise
+TextureEncoding chooseBlockEncoding(const unsigned char *pixels, unsigned int width, unsigned int height,
+                                    unsigned int channels);
+
+// Encodes an image with 1, 3 or 4 channels into `out`, which must hold
+// encodedImageSize() bytes. Endpoints are fitted along the principal axis of
+// each block's colours and refined by least squares. Rows of blocks are
+// spread over `jobs` when given.
+void compressImage(const unsigned char *pixels, unsigned int width, unsigned int height, unsigned int channels,
+                   TextureEncoding encoding, unsigned char *out, JobSystem *jobs = nullptr);
@@ -1,42 +1,174 @@
 // textureLoader.cpp
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
 #include "textureLoader.hpp"
-#include <glad/glad.h>
+#include "cookedAssets.hpp"
+#include "imageLoader.hpp"
+#include "mappedFile.hpp"
+#include <fmt/format.h>
+#include <algorithm>
 #include <iostream>
 
-unsigned int loadTexture(const std::string &filename) {
-    int width, height, nrChannels;
-    // stb_image can load JPEG, PNG, etc.
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrChannels, 0);
-    if (!data) {
+static float requestedAnisotropy = 8.0f;
+
+static GLenum formatForChannels(unsigned int channels) {
+    if (channels == 1)
+        return GL_RED;
+    if (channels == 4)
+        return GL_RGBA;
+    return GL_RGB;
+}
+
+// Sized formats, so the storage can be immutable and its size is known.
+// The S3TC sRGB formats come from EXT_texture_sRGB, which every desktop
+// driver exposes alongside S3TC.
+static GLenum internalFormatFor(const DecodedTexture &texture) {
+    switch (texture.encoding) {
+    case TEXTURE_BC1:
+        return texture.srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case TEXTURE_BC3:
+        return texture.srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case TEXTURE_BC4:
+        return GL_COMPRESSED_RED_RGTC1;
+    default:
+        break;
+    }
+    if (texture.channels == 1)
+        return GL_R8;
+    if (texture.channels == 4)
+        return texture.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    return texture.srgb ? GL_SRGB8 : GL_RGB8;
+}
+
+// Levels down to 1x1
+static unsigned int fullMipCount(unsigned int width, unsigned int height) {
+    unsigned int levels = 1;
+    while ((std::max(width, height) >> levels) > 0)
+        levels++;
+    return levels;
+}
+
+// Levels of the storage: cooked chains may stop short of 1x1, and then the storage has to as well
+unsigned int textureStorageLevels(const DecodedTexture &texture) {
+    return texture.cooked ? texture.mipCount : fullMipCount(texture.width, texture.height);
+}
+
+GLenum textureStorageFormat(const DecodedTexture &texture) {
+    return internalFormatFor(texture);
+}
+
+unsigned int DecodedTexture::mipWidth(unsigned int level) const {
+    return cooked ? cooked->header->mips[level].width : std::max(1u, width >> level);
+}
+
+unsigned int DecodedTexture::mipHeight(unsigned int level) const {
+    return cooked ? cooked->header->mips[level].height : std::max(1u, height >> level);
+}
+
+const unsigned char *DecodedTexture::mip(unsigned int level) const {
+    return cooked ? cooked->mip(level) : pixels.get();
+}
+
+bool decodeTexture(const std::string &filename, DecodedTexture &texture) {
+    std::shared_ptr<const CookedTexture> cooked = openCookedTexture(filename + COOKED_TEXTURE_EXTENSION);
+    if (cooked) {
+        const CookedTextureHeader &header = *cooked->header;
+        texture.width = header.mips[0].width;
+        texture.height = header.mips[0].height;
+        texture.channels = header.channels;
+        texture.mipCount = header.mipCount;
+        texture.encoding = TextureEncoding(header.encoding);
+        texture.srgb = header.srgb != 0;
+        texture.cooked = cooked;
+        // The cooker records the source's hash, so cooked and plain copies of an image match
+        texture.contentHash = header.common.sourceCount > 0 ? header.common.sources[0].contentHash
+                                                            : hashBytes(cooked->mip(0), header.mips[0].size);
+        std::cout << "Mapped cooked texture " << filename << COOKED_TEXTURE_EXTENSION << " with "
+                  << header.mipCount << " mip levels." << std::endl;
+        return true;
+    }
+
+    // Mapped rather than read, so the file can be hashed without a second pass over the disk
+    MappedFile file;
+    if (!file.open(filename)) {
         std::cerr << "Failed to load texture: " << filename << std::endl;
-        return 0;
+        return false;
     }
-    
-    GLenum format;
-    if (nrChannels == 1)
-        format = GL_RED;
-    else if (nrChannels == 3)
-        format = GL_RGB;
-    else if (nrChannels == 4)
-        format = GL_RGBA;
-    else
-        format = GL_RGB;
-        
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    
+    // Grey and alpha has no matching format; widen it like the cooker does
+    unsigned int width, height, channels;
+    ImageDecodeOptions options;
+    if (readImageInfo(file.data(), file.size(), width, height, channels) && channels == 2)
+        options.channels = 4;
+    Image image;
+    if (!decodeImage(file.data(), file.size(), image, options)) {
+        std::cerr << "Failed to load texture: " << filename << std::endl;
+        return false;
+    }
+    texture.width = image.width;
+    texture.height = image.height;
+    texture.channels = image.channels;
+    texture.mipCount = 1;
+    texture.encoding = TEXTURE_RAW;
+    texture.srgb = image.channels >= 3;
+    texture.pixels = std::move(image.storage);
+    texture.contentHash = hashBytes(file.data(), file.size());
+    return true;
+}
+
+void setTextureAnisotropy(float anisotropy) {
+    requestedAnisotropy = std::max(anisotropy, 1.0f);
+}
+
+// Wrapping, filtering and anisotropy, which have to be set before any bindless handle is taken
+static void setSamplingParameters(unsigned int textureID) {
     // Set texture wrapping/filtering options.
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    
-    stbi_image_free(data);
+    glTextureParameteri(textureID, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTextureParameteri(textureID, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // Core since 4.6, and an extension everywhere before that
+    if (requestedAnisotropy > 1.0f
+        && (GLAD_GL_VERSION_4_6 || GLAD_GL_ARB_texture_filter_anisotropic || GLAD_GL_EXT_texture_filter_anisotropic)) {
+        float maxAnisotropy = 1.0f;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &maxAnisotropy);
+        glTextureParameterf(textureID, GL_TEXTURE_MAX_ANISOTROPY, std::min(requestedAnisotropy, maxAnisotropy));
+    }
+}
+
+unsigned int createTextureArrayStorage(const DecodedTexture &texture, unsigned int layers) {
+    unsigned int textureID;
+    glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &textureID);
+    glTextureStorage3D(textureID, textureStorageLevels(texture), internalFormatFor(texture), texture.width,
+                       texture.height, layers);
+    setSamplingParameters(textureID);
     return textureID;
-}
\ No newline at end of file
+}
+
+void uploadTextureRows(unsigned int textureID, const DecodedTexture &texture, unsigned int level,
+                       unsigned int firstRow, unsigned int rowCount, const void *data, int layer) {
+    unsigned int width = texture.mipWidth(level);
+    if (isBlockCompressed(texture.encoding)) {
+        GLsizei size = GLsizei(encodedImageSize(texture.encoding, width, rowCount, texture.channels));
+        glCompressedTextureSubImage3D(textureID, level, 0, firstRow, layer, width, rowCount, 1,
+                                      internalFormatFor(texture), size, data);
+    } else {
+        glTextureSubImage3D(textureID, level, 0, firstRow, layer, width, rowCount, 1,
+                            formatForChannels(texture.channels), GL_UNSIGNED_BYTE, data);
+    }
+}
+
+size_t textureMemorySize(const DecodedTexture &texture) {
+    size_t size = 0;
+    for (unsigned int level = 0; level < textureStorageLevels(texture); level++) {
+        unsigned int width = std::max(1u, texture.width >> level);
+        unsigned int height = std::max(1u, texture.height >> level);
+        // Drivers pad RGB8 texels to four bytes
+        unsigned int channels = texture.channels == 3 ? 4 : texture.channels;
+        size += encodedImageSize(texture.encoding, width, height, channels);
+    }
+    return size;
+}
+
+std::string describeTexture(const DecodedTexture &texture) {
+    return fmt::format("{}x{} {} {}, {} mips, {:.2f} MB of video memory", texture.width, texture.height,
+                       encodingName(texture.encoding), texture.srgb ? "sRGB" : "linear",
+                       textureStorageLevels(texture), textureMemorySize(texture) / double(1 << 20));
+}
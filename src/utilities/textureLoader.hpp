@@ -1,3 +1,67 @@
 #pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <memory>
 #include <string>
-unsigned int loadTexture(const std::string &filename);
+#include "textureCompression.hpp"
+
+struct CookedTexture;
+
+// An image in memory, ready to upload: either a decoded file or the mapping of
+// a cooked one with its prebuilt, possibly block compressed, mips. Rows are in
+// file order.
+struct DecodedTexture {
+    unsigned int width = 0;
+    unsigned int height = 0;
+    unsigned int channels = 0;
+    // Levels stored here; decoded files only have the base level and get the
+    // rest generated on the GPU
+    unsigned int mipCount = 0;
+    TextureEncoding encoding = TEXTURE_RAW;
+    // Colour textures are sRGB, so they are filtered and blended in linear space
+    bool srgb = false;
+    // Of the source image file, cooked or not, for spotting copies under other names
+    std::uint64_t contentHash = 0;
+
+    unsigned int mipWidth(unsigned int level) const;
+    unsigned int mipHeight(unsigned int level) const;
+    const unsigned char *mip(unsigned int level) const;
+    // Uploads go in whole rows of blocks: 4 pixel rows for block encodings, 1 otherwise
+    unsigned int rowsPerBlock() const { return isBlockCompressed(encoding) ? 4 : 1; }
+    // Bytes of one row of blocks of the level
+    size_t blockRowSize(unsigned int level) const { return encodedRowSize(encoding, mipWidth(level), channels); }
+
+    std::shared_ptr<unsigned char> pixels;
+    std::shared_ptr<const CookedTexture> cooked;
+};
+
+// Maps the up to date cooked file (filename + COOKED_TEXTURE_EXTENSION) if
+// there is one, and decodes the image otherwise. Only touches the CPU, so any
+// thread may call it. Returns false if the image can't be read.
+bool decodeTexture(const std::string &filename, DecodedTexture &texture);
+
+// Creates an immutable GL_TEXTURE_2D_ARRAY in the sized format matching the
+// texture, with room for `layers` textures of its size and their full mip
+// chains, and the usual wrapping, filtering and anisotropy, but without any
+// contents yet
+unsigned int createTextureArrayStorage(const DecodedTexture &texture, unsigned int layers);
+// The sized internal format and number of levels createTextureArrayStorage() would
+// use. Textures agreeing on these and on their size can share an array.
+GLenum textureStorageFormat(const DecodedTexture &texture);
+unsigned int textureStorageLevels(const DecodedTexture &texture);
+
+// Uploads rows [firstRow, firstRow + rowCount) of a level into the given
+// layer of a GL_TEXTURE_2D_ARRAY. firstRow must start a row of
+// blocks. With a GL_PIXEL_UNPACK_BUFFER bound, `data` is an offset into it.
+// Expects GL_UNPACK_ALIGNMENT to be 1.
+void uploadTextureRows(unsigned int textureID, const DecodedTexture &texture, unsigned int level,
+                       unsigned int firstRow, unsigned int rowCount, const void *data, int layer);
+
+// Video memory taken by the texture's storage, counting the levels made on the GPU
+size_t textureMemorySize(const DecodedTexture &texture);
+// Size, format and memory, for logging
+std::string describeTexture(const DecodedTexture &texture);
+
+// Maximum anisotropy for textures created from now on, clamped to what the
+// driver supports; 1 turns anisotropic filtering off
+void setTextureAnisotropy(float anisotropy);
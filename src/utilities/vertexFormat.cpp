@@ -0,0 +1,110 @@
+#include "vertexFormat.hpp"
+#include "geometryPool.hpp"
+#include <glm/gtc/packing.hpp>
+#include <cmath>
+#include <cstring>
+
+PositionQuantization positionQuantizationFor(const Mesh &mesh)
+{
+    AABB bounds = mesh.bounds.isEmpty() ? AABB::fromPoints(mesh.vertices) : mesh.bounds;
+    PositionQuantization quantization;
+    if (bounds.isEmpty())
+        return quantization;
+    quantization.offset = bounds.center();
+    // Flat meshes have no extent along one axis; keep the scale invertible
+    quantization.scale = glm::max(bounds.extent(), glm::vec3(1e-6f));
+    return quantization;
+}
+
+static float signNotZero(float value)
+{
+    return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+glm::vec2 encodeOctahedral(glm::vec3 normal)
+{
+    float sum = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+    if (sum == 0.0f)
+        return glm::vec2(0.0f);
+    normal /= sum;
+    glm::vec2 encoded(normal.x, normal.y);
+    // Fold the lower hemisphere over the diagonals
+    if (normal.z < 0.0f) {
+        encoded = glm::vec2((1.0f - std::fabs(normal.y)) * signNotZero(normal.x),
+                            (1.0f - std::fabs(normal.x)) * signNotZero(normal.y));
+    }
+    return encoded;
+}
+
+glm::vec3 decodeOctahedral(glm::vec2 encoded)
+{
+    glm::vec3 normal(encoded.x, encoded.y, 1.0f - std::fabs(encoded.x) - std::fabs(encoded.y));
+    if (normal.z < 0.0f) {
+        normal.x = (1.0f - std::fabs(encoded.y)) * signNotZero(encoded.x);
+        normal.y = (1.0f - std::fabs(encoded.x)) * signNotZero(encoded.y);
+    }
+    return glm::normalize(normal);
+}
+
+void packVertices(const Mesh &mesh, PositionEncoding encoding, const PositionQuantization &quantization,
+                  PackedVertex *out)
+{
+    size_t vertexCount = mesh.vertices.size();
+    bool hasNormals = mesh.normals.size() >= vertexCount;
+    bool hasTextureCoordinates = mesh.textureCoordinates.size() >= vertexCount;
+    glm::vec3 inverseScale = 1.0f / quantization.scale;
+
+    for (size_t i = 0; i < vertexCount; i++) {
+        // Build the vertex locally, as `out` is usually write-only mapped memory
+        PackedVertex vertex;
+        if (encoding == POSITION_SNORM16) {
+            glm::vec3 position = (mesh.vertices[i] - quantization.offset) * inverseScale;
+            for (int axis = 0; axis < 3; axis++)
+                vertex.position[axis] = glm::packSnorm1x16(position[axis]);
+        } else {
+            for (int axis = 0; axis < 3; axis++)
+                vertex.position[axis] = glm::packHalf1x16(mesh.vertices[i][axis]);
+        }
+        vertex.position[3] = 0;
+
+        glm::vec2 normal = hasNormals ? encodeOctahedral(mesh.normals[i]) : glm::vec2(0.0f);
+        vertex.normal[0] = std::int16_t(glm::packSnorm1x16(normal.x));
+        vertex.normal[1] = std::int16_t(glm::packSnorm1x16(normal.y));
+
+        glm::vec2 textureCoordinates = hasTextureCoordinates ? mesh.textureCoordinates[i] : glm::vec2(0.0f);
+        vertex.textureCoordinates[0] = glm::packHalf1x16(textureCoordinates.x);
+        vertex.textureCoordinates[1] = glm::packHalf1x16(textureCoordinates.y);
+        out[i] = vertex;
+    }
+}
+
+void packIndices(const std::vector<unsigned int> &indices, GLenum indexType, void *out)
+{
+    if (indexType == GL_UNSIGNED_INT) {
+        std::memcpy(out, indices.data(), indices.size() * sizeof(unsigned int));
+        return;
+    }
+    std::uint16_t *shortIndices = static_cast<std::uint16_t*>(out);
+    for (size_t i = 0; i < indices.size(); i++)
+        shortIndices[i] = std::uint16_t(indices[i]);
+}
+
+void setPackedVertexFormat(GLuint vao, GLuint bindingIndex, PositionEncoding encoding)
+{
+    glEnableVertexArrayAttrib(vao, POSITION_ATTRIBUTE);
+    if (encoding == POSITION_SNORM16)
+        glVertexArrayAttribFormat(vao, POSITION_ATTRIBUTE, 3, GL_SHORT, GL_TRUE, offsetof(PackedVertex, position));
+    else
+        glVertexArrayAttribFormat(vao, POSITION_ATTRIBUTE, 3, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, position));
+    glVertexArrayAttribBinding(vao, POSITION_ATTRIBUTE, bindingIndex);
+
+    // Decoded from the octahedral square in the vertex shader
+    glEnableVertexArrayAttrib(vao, NORMAL_ATTRIBUTE);
+    glVertexArrayAttribFormat(vao, NORMAL_ATTRIBUTE, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, normal));
+    glVertexArrayAttribBinding(vao, NORMAL_ATTRIBUTE, bindingIndex);
+
+    glEnableVertexArrayAttrib(vao, TEXCOORD_ATTRIBUTE);
+    glVertexArrayAttribFormat(vao, TEXCOORD_ATTRIBUTE, 2, GL_HALF_FLOAT, GL_FALSE,
+                              offsetof(PackedVertex, textureCoordinates));
+    glVertexArrayAttribBinding(vao, TEXCOORD_ATTRIBUTE, bindingIndex);
+}
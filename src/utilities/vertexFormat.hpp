@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mesh.h"
+
+// How PackedVertex::position is stored
+enum PositionEncoding {
+    // Normalised int16 relative to the mesh bounds; the shaders map it back
+    // with the object's positionScale and positionOffset
+    POSITION_SNORM16,
+    // Half floats in model space, for when nobody keeps the bounds around
+    POSITION_HALF
+};
+
+// The interleaved, quantised vertex used by all scene geometry: 16 bytes,
+// half of the three float streams it replaces.
+struct PackedVertex {
+    std::uint16_t position[4];           // xyz as given by the PositionEncoding; w is padding
+    std::int16_t normal[2];              // Octahedral encoding, normalised int16
+    std::uint16_t textureCoordinates[2]; // Half floats, so tiling coordinates outside [0, 1] still work
+};
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must match the attribute layout in setPackedVertexFormat");
+
+// Maps quantised positions in [-1, 1] back to model space: position * scale + offset
+struct PositionQuantization {
+    glm::vec3 scale = glm::vec3(1.0f);
+    glm::vec3 offset = glm::vec3(0.0f);
+};
+
+// Fits the quantisation to the mesh bounds, computing them if the mesh has none
+PositionQuantization positionQuantizationFor(const Mesh &mesh);
+
+// Maps a unit vector onto the [-1, 1] square (Cigolle et al., "A Survey of
+// Efficient Representations for Independent Unit Vectors")
+glm::vec2 encodeOctahedral(glm::vec3 normal);
+glm::vec3 decodeOctahedral(glm::vec2 encoded);
+
+// Encodes the vertices of the mesh into `out`, which must have room for
+// mesh.vertices.size() vertices. Missing normals or coordinates are zeroed.
+void packVertices(const Mesh &mesh, PositionEncoding encoding, const PositionQuantization &quantization,
+                  PackedVertex *out);
+
+// 16-bit indices whenever they can address every vertex of the mesh
+inline GLenum indexTypeFor(size_t vertexCount) {
+    return vertexCount <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+inline size_t indexSize(GLenum indexType) {
+    return indexType == GL_UNSIGNED_SHORT ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+}
+
+// Writes the indices into `out` as indexType
+void packIndices(const std::vector<unsigned int> &indices, GLenum indexType, void *out);
+
+// Points the position, normal and texture coordinate attributes of the VAO at
+// PackedVertex data in the given vertex buffer binding
+void setPackedVertexFormat(GLuint vao, GLuint bindingIndex, PositionEncoding encoding);
@@ -13,7 +13,23 @@ const std::string windowTitle     = "Glowbox";
 const GLint       windowResizable = GL_FALSE;
 const int         windowSamples   = 4;
 
+// How shadow edges are filtered, from cheapest to softest
+enum ShadowQuality {
+    SHADOW_QUALITY_PCF,      // One bilinear depth-compare tap
+    SHADOW_QUALITY_POISSON,  // shadowTaps compare taps on a rotated Poisson disc
+    SHADOW_QUALITY_EVSM      // Exponential variance shadow maps, blurred by a compute pass
+};
+
 struct CommandLineOptions {
     bool enableMusic;
     bool enableAutoplay;
+    bool enableStats;
+    int sundialCopies;
+    int threadCount;     // 0 means one per hardware thread
+    int anisotropy;      // Maximum texture anisotropy; 1 is plain trilinear filtering
+    int shadowCascades;  // Slices of the view frustum with a shadow map each, 1 to 4
+    int shadowMapSize;   // Width and height of each cascade's shadow map
+    float shadowCacheAngle;  // Degrees the sun moves before cached shadows are redrawn; 0 disables the cache
+    ShadowQuality shadowQuality;
+    int shadowTaps;      // Taps of SHADOW_QUALITY_POISSON, 4 to 16
 };
\ No newline at end of file
@@ -0,0 +1,448 @@
+// Offline asset cooker. Converts OBJ/MTL models and their diffuse textures into
+// cooked files next to the sources, which the game maps instead of parsing.
+// Run it from the build directory, like the game:
+//
+//     ./glowbox_cook                  cooks ../res/models/sundial.obj if it is stale
+//     ./glowbox_cook --force a.obj    rebuilds the cooked files of a.obj regardless
+//     ./glowbox_cook --measure        also times cold and warm loads, cooked against source
+//     ./glowbox_cook --uncompressed   stores textures as raw texels instead of BC1/BC3/BC4 blocks
+
+#include "utilities/cookedAssets.hpp"
+#include "utilities/imageLoader.hpp"
+#include "utilities/jobSystem.hpp"
+#include "utilities/mappedFile.hpp"
+#include "utilities/modelLoader.hpp"
+#include "utilities/textureCompression.hpp"
+
+#include <fmt/format.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const char *DEFAULT_MODEL = "../res/models/sundial.obj";
+
+static std::string directoryOf(const std::string &path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The MTL files named by `mtllib` lines, as paths next to the OBJ
+static std::vector<std::string> findMaterialLibraries(const std::string &objPath)
+{
+    std::vector<std::string> libraries;
+    MappedFile file;
+    if (!file.open(objPath))
+        return libraries;
+    const char *text = reinterpret_cast<const char*>(file.data());
+    const char *end = text + file.size();
+    for (const char *line = text; line < end;)
+    {
+        const char *lineEnd = static_cast<const char*>(std::memchr(line, '\n', size_t(end - line)));
+        if (lineEnd == nullptr)
+            lineEnd = end;
+        if (lineEnd - line > 7 && std::strncmp(line, "mtllib", 6) == 0 && (line[6] == ' ' || line[6] == '\t'))
+        {
+            std::string name(line + 7, lineEnd);
+            name.erase(0, name.find_first_not_of(" \t"));
+            name.erase(name.find_last_not_of(" \t\r") + 1);
+            if (!name.empty())
+                libraries.push_back(directoryOf(objPath) + name);
+        }
+        line = lineEnd + 1;
+    }
+    return libraries;
+}
+
+// --- Mip chain ---
+
+static float srgbToLinear(float value)
+{
+    return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float value)
+{
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+// A level of the chain in floats, with the colour channels in linear space,
+// so every level is filtered from the one above without rounding in between
+struct MipImage
+{
+    unsigned int width, height;
+    std::vector<float> texels;
+};
+
+// Taps of the halving filter, centred between the two source pixels each target pixel covers
+static const int MIP_FILTER_TAPS = 8;
+
+// The modified Bessel function of the first kind, for the Kaiser window
+static double besselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 20; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// A sinc cut off at the new Nyquist frequency under a Kaiser window (beta 4),
+// which keeps detail a box filter blurs away without visible ringing
+static void mipFilterWeights(float weights[MIP_FILTER_TAPS])
+{
+    const double pi = 3.14159265358979323846;
+    const double radius = MIP_FILTER_TAPS / 2;
+    const double beta = 4.0;
+    double sum = 0.0;
+    for (int k = 0; k < MIP_FILTER_TAPS; k++)
+    {
+        double distance = k - (MIP_FILTER_TAPS - 1) / 2.0;
+        double t = distance / 2.0;
+        double sinc = std::sin(pi * t) / (pi * t);
+        double ratio = distance / radius;
+        double window = besselI0(beta * std::sqrt(std::max(0.0, 1.0 - ratio * ratio))) / besselI0(beta);
+        weights[k] = float(sinc * window);
+        sum += weights[k];
+    }
+    for (int k = 0; k < MIP_FILTER_TAPS; k++)
+        weights[k] = float(weights[k] / sum);
+}
+
+// Halves one axis of the image; `stride` and `lineStride` say how texels are
+// laid out along and across it. Edges are clamped.
+static void halveAxis(const MipImage &source, MipImage &target, unsigned int channels, bool horizontal,
+                      const float *weights)
+{
+    unsigned int length = horizontal ? source.width : source.height;
+    unsigned int newLength = std::max(length / 2, 1u);
+    target.width = horizontal ? newLength : source.width;
+    target.height = horizontal ? source.height : newLength;
+    target.texels.assign(size_t(target.width) * target.height * channels, 0.0f);
+    if (length == 1)
+    {
+        target.texels = source.texels;
+        return;
+    }
+    unsigned int lines = horizontal ? source.height : source.width;
+    size_t stride = horizontal ? channels : size_t(source.width) * channels;
+    size_t lineStride = horizontal ? size_t(source.width) * channels : channels;
+    size_t targetStride = horizontal ? channels : size_t(target.width) * channels;
+    size_t targetLineStride = horizontal ? size_t(target.width) * channels : channels;
+    jobSystem().parallelFor(lines, 64, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int line = begin; line < end; line++)
+        {
+            const float *in = &source.texels[line * lineStride];
+            float *out = &target.texels[line * targetLineStride];
+            for (unsigned int i = 0; i < newLength; i++)
+            {
+                for (int k = 0; k < MIP_FILTER_TAPS; k++)
+                {
+                    int position = int(2 * i) + k - (MIP_FILTER_TAPS / 2 - 1);
+                    position = std::min(std::max(position, 0), int(length) - 1);
+                    const float *texel = in + position * stride;
+                    for (unsigned int c = 0; c < channels; c++)
+                        out[i * targetStride + c] += weights[k] * texel[c];
+                }
+            }
+        }
+    });
+}
+
+// Rounds the level back to bytes; the negative lobes of the filter can overshoot, so clamp first
+static std::vector<unsigned char> quantiseMip(const MipImage &image, unsigned int channels)
+{
+    std::vector<unsigned char> result(image.texels.size());
+    for (size_t i = 0; i < result.size(); i++)
+    {
+        bool colour = channels >= 3 && i % channels < 3;
+        float value = std::min(std::max(image.texels[i], 0.0f), 1.0f);
+        if (colour)
+            value = linearToSrgb(value);
+        result[i] = (unsigned char)std::lround(value * 255.0f);
+    }
+    return result;
+}
+
+// Colour channels of 3 and 4 channel images are filtered in linear space so
+// the mips don't darken; alpha and single channel images are filtered as they are.
+static std::vector<std::vector<unsigned char>> buildMipChain(const unsigned char *pixels, unsigned int width,
+                                                             unsigned int height, unsigned int channels)
+{
+    float toLinear[256];
+    for (int i = 0; i < 256; i++)
+        toLinear[i] = srgbToLinear(float(i) / 255.0f);
+    float weights[MIP_FILTER_TAPS];
+    mipFilterWeights(weights);
+
+    MipImage level{width, height, std::vector<float>(size_t(width) * height * channels)};
+    for (size_t i = 0; i < level.texels.size(); i++)
+    {
+        bool colour = channels >= 3 && i % channels < 3;
+        level.texels[i] = colour ? toLinear[pixels[i]] : float(pixels[i]) / 255.0f;
+    }
+
+    std::vector<std::vector<unsigned char>> mips;
+    mips.emplace_back(pixels, pixels + size_t(width) * height * channels);
+    while ((level.width > 1 || level.height > 1) && mips.size() < MAX_COOKED_MIPS)
+    {
+        MipImage halfWidth, next;
+        halveAxis(level, halfWidth, channels, true, weights);
+        halveAxis(halfWidth, next, channels, false, weights);
+        level = std::move(next);
+        mips.push_back(quantiseMip(level, channels));
+    }
+    return mips;
+}
+
+// --- Cooking ---
+
+// Block compresses every level unless `compress` is false
+static bool cookTexture(const std::string &texturePath, bool force, bool compress)
+{
+    std::string cookedPath = texturePath + COOKED_TEXTURE_EXTENSION;
+    if (!force && isCookedFileFresh(cookedPath))
+    {
+        std::cout << cookedPath << " is up to date." << std::endl;
+        return true;
+    }
+    MappedFile file;
+    if (!file.open(texturePath))
+    {
+        std::cerr << "Failed to read image " << texturePath << std::endl;
+        return false;
+    }
+    // The runtime uploads 1, 3 or 4 channels; widen grey and alpha to RGBA.
+    // The header says which it is, so the image is only decoded once.
+    unsigned int fileWidth, fileHeight, fileChannels;
+    ImageDecodeOptions options;
+    if (readImageInfo(file.data(), file.size(), fileWidth, fileHeight, fileChannels) && fileChannels == 2)
+    {
+        options.channels = 4;
+    }
+    Image image;
+    if (!decodeImage(file.data(), file.size(), image, options))
+    {
+        std::cerr << "Failed to decode image " << texturePath << std::endl;
+        return false;
+    }
+    int width = int(image.width), height = int(image.height), channels = int(image.channels);
+    const unsigned char *pixels = image.pixels;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::vector<unsigned char>> mips = buildMipChain(pixels, width, height, channels);
+    double filterTime = millisecondsSince(start);
+    TextureEncoding encoding = compress ? chooseBlockEncoding(pixels, width, height, channels) : TEXTURE_RAW;
+    image = Image();
+
+    start = std::chrono::steady_clock::now();
+    size_t rawSize = 0, encodedSize = 0;
+    for (unsigned int level = 0; level < mips.size(); level++)
+    {
+        unsigned int mipWidth = std::max(unsigned(width) >> level, 1u);
+        unsigned int mipHeight = std::max(unsigned(height) >> level, 1u);
+        std::vector<unsigned char> encoded(encodedImageSize(encoding, mipWidth, mipHeight, channels));
+        compressImage(mips[level].data(), mipWidth, mipHeight, channels, encoding, encoded.data(), &jobSystem());
+        rawSize += mips[level].size();
+        encodedSize += encoded.size();
+        mips[level] = std::move(encoded);
+    }
+    double encodeTime = millisecondsSince(start);
+
+    // Colour is stored as sRGB and single channel maps as linear data
+    bool srgb = channels >= 3;
+    bool written = writeCookedTexture(cookedPath, width, height, channels, encoding, srgb, mips, {texturePath});
+    if (written)
+        std::cout << fmt::format("Cooked {} ({}x{}, {} channels, {} mips filtered in {:.0f} ms; {} {} in {:.0f} ms, "
+                                 "{:.1f} MB instead of {:.1f} MB).", cookedPath, width, height, channels, mips.size(),
+                                 filterTime, encodingName(encoding), srgb ? "sRGB" : "linear", encodeTime,
+                                 encodedSize / double(1 << 20), rawSize / double(1 << 20)) << std::endl;
+    return written;
+}
+
+// Cooks the model and its diffuse texture, setting texturePath to the texture (empty if
+// there is none). Returns false if anything failed to cook.
+static bool cookModel(const std::string &objPath, bool force, bool compress, std::string &texturePath)
+{
+    std::string cookedPath = objPath + COOKED_MESH_EXTENSION;
+    std::string diffuseTexName;
+    std::shared_ptr<const CookedMesh> cooked;
+    if (!force && isCookedFileFresh(cookedPath))
+        cooked = openCookedMesh(cookedPath);
+    if (cooked)
+    {
+        std::cout << cookedPath << " is up to date." << std::endl;
+        const char *name = cooked->header->diffuseTexture;
+        diffuseTexName = std::string(name, strnlen(name, sizeof(cooked->header->diffuseTexture)));
+    }
+    else
+    {
+        Mesh mesh = parseOBJModel(objPath, directoryOf(objPath), diffuseTexName, &jobSystem());
+        if (mesh.vertices.empty())
+            return false;
+        std::vector<std::string> sources = findMaterialLibraries(objPath);
+        sources.insert(sources.begin(), objPath);
+        if (sources.size() > MAX_COOKED_SOURCES)
+            sources.resize(MAX_COOKED_SOURCES);
+        if (!writeCookedMesh(cookedPath, mesh, diffuseTexName, sources))
+            return false;
+        std::cout << fmt::format("Cooked {} ({} vertices, {}-bit indices).", cookedPath, mesh.vertices.size(),
+                                 indexTypeFor(mesh.vertices.size()) == GL_UNSIGNED_SHORT ? 16 : 32) << std::endl;
+    }
+    texturePath = diffuseTexName.empty() ? std::string() : directoryOf(objPath) + diffuseTexName;
+    return texturePath.empty() || cookTexture(texturePath, force, compress);
+}
+
+// --- Startup measurement ---
+
+// Drops the files from the OS page cache, so the next read comes from disk.
+// Only possible on Linux; elsewhere the "cold" runs are warm too.
+static bool evictFromPageCache(const std::vector<std::string> &paths)
+{
+#ifdef __linux__
+    for (const std::string &path : paths)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            continue;
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+    return true;
+#else
+    (void)paths;
+    return false;
+#endif
+}
+
+// What loading the sources took before cooking: parse, weld and optimise
+// the OBJ and decode the texture. The GPU mip generation that
+// follows at runtime is not included.
+static double timeSourceLoad(const std::string &objPath, const std::string &texturePath)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::string diffuseTexName;
+    Mesh mesh = parseOBJModel(objPath, directoryOf(objPath), diffuseTexName, &jobSystem());
+    if (!texturePath.empty())
+    {
+        Image image;
+        decodeImageFile(texturePath, image);
+    }
+    return millisecondsSince(start);
+}
+
+// Sums one byte per page, standing in for the driver reading the mapping during upload
+static unsigned int touchPages(const MappedFile &file)
+{
+    unsigned int sum = 0;
+    for (size_t offset = 0; offset < file.size(); offset += 4096)
+        sum += file.data()[offset];
+    return sum;
+}
+
+static double timeCookedLoad(const std::string &objPath, const std::string &texturePath, unsigned int &checksum)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<const CookedMesh> mesh = openCookedMesh(objPath + COOKED_MESH_EXTENSION);
+    if (mesh)
+        checksum += touchPages(mesh->file);
+    if (!texturePath.empty())
+    {
+        std::shared_ptr<const CookedTexture> texture = openCookedTexture(texturePath + COOKED_TEXTURE_EXTENSION);
+        if (texture)
+            checksum += touchPages(texture->file);
+    }
+    return millisecondsSince(start);
+}
+
+static void measureStartup(const std::string &objPath, const std::string &texturePath)
+{
+    std::vector<std::string> sourceFiles = findMaterialLibraries(objPath);
+    sourceFiles.push_back(objPath);
+    std::vector<std::string> cookedFiles = {objPath + COOKED_MESH_EXTENSION};
+    if (!texturePath.empty())
+    {
+        sourceFiles.push_back(texturePath);
+        cookedFiles.push_back(texturePath + COOKED_TEXTURE_EXTENSION);
+    }
+    // The cooked load also stats the sources to check they haven't changed
+    std::vector<std::string> allFiles = sourceFiles;
+    allFiles.insert(allFiles.end(), cookedFiles.begin(), cookedFiles.end());
+
+    unsigned int checksum = 0;
+    bool evicted = evictFromPageCache(allFiles);
+    double coldSource = timeSourceLoad(objPath, texturePath);
+    double warmSource = timeSourceLoad(objPath, texturePath);
+    evictFromPageCache(allFiles);
+    double coldCooked = timeCookedLoad(objPath, texturePath, checksum);
+    double warmCooked = timeCookedLoad(objPath, texturePath, checksum);
+
+    std::cout << fmt::format("Load times of {} (ms){}:", objPath,
+                             evicted ? "" : ", cold runs not available on this platform") << std::endl;
+    std::cout << fmt::format("{:>8} {:>10} {:>10} {:>9}", "", "source", "cooked", "speedup") << std::endl;
+    std::cout << fmt::format("{:>8} {:>10.2f} {:>10.2f} {:>8.1f}x", "cold", coldSource, coldCooked,
+                             coldSource / std::max(coldCooked, 1e-3)) << std::endl;
+    std::cout << fmt::format("{:>8} {:>10.2f} {:>10.2f} {:>8.1f}x", "warm", warmSource, warmCooked,
+                             warmSource / std::max(warmCooked, 1e-3)) << std::endl;
+    std::cout << fmt::format("(source excludes GPU mip generation; checksum {})", checksum) << std::endl;
+}
+
+int main(int argc, const char *argv[])
+{
+    bool force = false;
+    bool measure = false;
+    bool compress = true;
+    std::vector<std::string> models;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--force") == 0)
+            force = true;
+        else if (std::strcmp(argv[i], "--measure") == 0)
+            measure = true;
+        else if (std::strcmp(argv[i], "--uncompressed") == 0)
+            compress = false;
+        else if (argv[i][0] == '-')
+        {
+            std::cerr << "Usage: glowbox_cook [--force] [--measure] [--uncompressed] [model.obj ...]" << std::endl;
+            return EXIT_FAILURE;
+        }
+        else
+            models.push_back(argv[i]);
+    }
+    if (models.empty())
+        models.push_back(DEFAULT_MODEL);
+    // OBJ parsing, normal generation, mip filtering and block compression spread over every core
+    initJobSystem(0);
+
+    bool succeeded = true;
+    for (const std::string &model : models)
+    {
+        std::string texturePath;
+        if (!cookModel(model, force, compress, texturePath))
+        {
+            std::cerr << "Failed to cook " << model << std::endl;
+            succeeded = false;
+            continue;
+        }
+        if (measure)
+            measureStartup(model, texturePath);
+    }
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}